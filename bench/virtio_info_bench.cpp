@@ -0,0 +1,687 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2025 Petr Vyazovik <xen@f-m.fm>
+
+// Micro-benchmarks for the parse, decode and render hot paths.
+// Results are printed as JSON so they can be stored and compared
+// between commits.
+
+#include "config.h"
+#include "dev_table.h"
+#include "ui_elements.h"
+#include "virtio_bus.h"
+#include "vi_version.h"
+
+#include <malloc.h>
+#include <unistd.h>
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <atomic>
+#include <bitset>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <new>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <CLI/CLI.hpp>
+#include <ftxui/dom/table.hpp>
+#include <ftxui/screen/screen.hpp>
+
+// referenced by the ui:: element builders
+cfg::CmdLOpts cmdl_opts;
+
+// Live heap bytes, for the memory footprint measurements
+static std::atomic<size_t> heap_live_bytes {0};
+
+void *operator new(size_t size)
+{
+    void *ptr = std::malloc(size ? size : 1);
+    if (ptr == nullptr)
+        throw std::bad_alloc();
+    heap_live_bytes += malloc_usable_size(ptr);
+    return ptr;
+}
+
+void operator delete(void *ptr) noexcept
+{
+    if (ptr != nullptr)
+        heap_live_bytes -= malloc_usable_size(ptr);
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+    operator delete(ptr);
+}
+
+namespace bench {
+
+namespace fs = std::filesystem;
+
+struct BenchOpts
+{
+    std::string    filter_ {};
+    // minimal measurement time per benchmark
+    uint32_t  min_time_ms_ {200};
+    // number of devices in the synthetic bus
+    uint32_t   dev_count_ {1000};
+    bool            text_ {false};
+    // number of randomized parser cross-check rounds, 0 to skip
+    uint64_t  fuzz_iterations_ {0};
+    // duration of the hotplug race check, 0 to skip
+    uint32_t  hotplug_stress_s_ {0};
+};
+
+struct BenchResult
+{
+    std::string name_;
+    uint64_t    iterations_;
+    double      ns_per_op_;
+};
+
+struct MemResult
+{
+    std::string name_;
+    uint64_t    dev_count_;
+    uint64_t    bytes_;
+};
+
+template <typename T>
+static inline void DoNotOptimize(const T &val)
+{
+    asm volatile("" : : "m"(val) : "memory");
+}
+
+class BenchRunner
+{
+    public:
+        explicit BenchRunner(const BenchOpts &opts) : opts_(opts) {}
+
+        // @fn performs a single operation
+        void Run(const std::string &name, const std::function<void()> &fn)
+        {
+            if (!opts_.filter_.empty() && name.find(opts_.filter_) == std::string::npos)
+                return;
+
+            using clock = std::chrono::steady_clock;
+            const auto min_time = std::chrono::milliseconds(opts_.min_time_ms_);
+
+            uint64_t iters = 1;
+            for (;;) {
+                auto start = clock::now();
+                for (uint64_t i = 0; i < iters; i++)
+                    fn();
+                auto elapsed = clock::now() - start;
+
+                if (elapsed >= min_time || iters >= (1ULL << 40)) {
+                    auto ns = std::chrono::duration<double, std::nano>(elapsed).count();
+                    results_.push_back({name, iters, ns / iters});
+                    return;
+                }
+
+                iters *= 2;
+            }
+        }
+
+        // Heap bytes held by the structure built by @build
+        template <typename F>
+        void Footprint(const std::string &name, const uint64_t dev_count, F build)
+        {
+            if (!opts_.filter_.empty() && name.find(opts_.filter_) == std::string::npos)
+                return;
+
+            auto before = heap_live_bytes.load();
+            auto obj = build();
+            auto bytes = heap_live_bytes.load() - before;
+            DoNotOptimize(obj);
+
+            mem_results_.push_back({name, dev_count, bytes});
+        }
+
+        void Report() const
+        {
+            if (opts_.text_) {
+                for (const auto &res : results_)
+                    fmt::print("{:<40} {:>12} iters {:>14.1f} ns/op\n",
+                               res.name_, res.iterations_, res.ns_per_op_);
+                for (const auto &res : mem_results_)
+                    fmt::print("{:<40} {:>12} bytes {:>14.1f} bytes/dev\n",
+                               res.name_, res.bytes_,
+                               static_cast<double>(res.bytes_) / res.dev_count_);
+                return;
+            }
+
+            fmt::print("{{\"version\":\"{}\",\"commit\":\"{}\",\"benchmarks\":[",
+                       vi_current_version, vi_current_hash);
+            for (size_t i = 0; i < results_.size(); i++) {
+                const auto &res = results_[i];
+                fmt::print("{}\n  {{\"name\":\"{}\",\"iterations\":{},\"ns_per_op\":{:.2f}}}",
+                           i ? "," : "", res.name_, res.iterations_, res.ns_per_op_);
+            }
+            fmt::print("\n],\"memory\":[");
+            for (size_t i = 0; i < mem_results_.size(); i++) {
+                const auto &res = mem_results_[i];
+                fmt::print("{}\n  {{\"name\":\"{}\",\"devices\":{},\"bytes\":{},\"bytes_per_dev\":{:.1f}}}",
+                           i ? "," : "", res.name_, res.dev_count_, res.bytes_,
+                           static_cast<double>(res.bytes_) / res.dev_count_);
+            }
+            fmt::print("\n]}}\n");
+        }
+
+    private:
+        const BenchOpts          &opts_;
+        std::vector<BenchResult>  results_;
+        std::vector<MemResult>    mem_results_;
+};
+
+// Previous sscanf()/std::bitset based attribute parsers,
+// kept as a baseline for the current ones
+namespace legacy {
+
+static bool
+ParseDevTypeAttr(const std::string &buf, uint32_t &type)
+{
+    return std::sscanf(buf.c_str(), "0x%04x", &type) == 1;
+}
+
+static bool
+ParseDevStatusAttr(const std::string &buf, uint32_t &status)
+{
+    return std::sscanf(buf.c_str(), "0x%08x", &status) == 1;
+}
+
+static bool
+ParseDevFeaturesAttr(std::string buf, uint64_t &features)
+{
+    std::ranges::reverse(buf);
+
+    try {
+        std::bitset<64> feat_bset(buf);
+        features = feat_bset.to_ullong();
+    } catch (const std::invalid_argument &) {
+        return false;
+    }
+
+    return true;
+}
+
+} // namespace legacy
+
+// Straightforward reference parsers used for randomized cross-checks
+namespace reference {
+
+static virtio::AttrParseResult
+ParseFeatures(const std::string &buf, uint64_t &features)
+{
+    if (buf.size() != 64)
+        return {virtio::AttrParseError::bad_length, static_cast<uint32_t>(buf.size())};
+
+    uint64_t val = 0;
+    for (uint32_t i = 0; i < 64; i++) {
+        if (buf[i] != '0' && buf[i] != '1')
+            return {virtio::AttrParseError::bad_digit, i};
+        if (buf[i] == '1')
+            val |= 1ULL << i;
+    }
+
+    features = val;
+    return {};
+}
+
+static virtio::AttrParseResult
+ParseHex(const std::string &buf, uint32_t digits, uint32_t &val)
+{
+    if (buf.size() != digits + 2)
+        return {virtio::AttrParseError::bad_length, static_cast<uint32_t>(buf.size())};
+    if (buf[0] != '0')
+        return {virtio::AttrParseError::bad_prefix, 0};
+    if (buf[1] != 'x' && buf[1] != 'X')
+        return {virtio::AttrParseError::bad_prefix, 1};
+
+    uint32_t acc = 0;
+    for (uint32_t i = 2; i < buf.size(); i++) {
+        if (!std::isxdigit(static_cast<unsigned char>(buf[i])))
+            return {virtio::AttrParseError::bad_digit, i};
+        auto c = std::tolower(static_cast<unsigned char>(buf[i]));
+        acc = (acc << 4) | static_cast<uint32_t>(c <= '9' ? c - '0' : c - 'a' + 10);
+    }
+
+    val = acc;
+    return {};
+}
+
+} // namespace reference
+
+static bool
+SameResult(const virtio::AttrParseResult &a, const virtio::AttrParseResult &b)
+{
+    return a.err_ == b.err_ && a.pos_ == b.pos_;
+}
+
+// Feed random (mostly well-formed) inputs to the attribute parsers and
+// compare them against the reference ones. Returns number of mismatches.
+static uint64_t
+FuzzAttrParsers(const uint64_t iterations)
+{
+    std::mt19937_64 rng {0x5eed};
+    uint64_t mismatches = 0;
+
+    auto random_char = [&](std::string_view alphabet) {
+        // ~1/16 of the characters are arbitrary bytes
+        if ((rng() & 0xf) == 0)
+            return static_cast<char>(rng() & 0xff);
+        return alphabet[rng() % alphabet.size()];
+    };
+
+    for (uint64_t i = 0; i < iterations; i++) {
+        // occasionally produce a string of wrong length
+        size_t feat_len = (rng() & 0x1f) == 0 ? rng() % 70 : 64;
+        std::string feat_buf;
+        for (size_t pos = 0; pos < feat_len; pos++)
+            feat_buf.push_back(random_char("01"));
+
+        uint64_t f1 = 0, f2 = 0;
+        auto r1 = virtio::ParseDevFeaturesAttr(feat_buf, f1);
+        auto r2 = reference::ParseFeatures(feat_buf, f2);
+        if (!SameResult(r1, r2) || (r1 && f1 != f2)) {
+            fmt::print(stderr, "features mismatch for \"{}\"\n", feat_buf);
+            mismatches++;
+        }
+
+        for (uint32_t digits : {4u, 8u}) {
+            size_t hex_len = (rng() & 0x1f) == 0 ? rng() % 12 : digits + 2;
+            std::string hex_buf;
+            for (size_t pos = 0; pos < hex_len; pos++) {
+                if (pos == 0)
+                    hex_buf.push_back(random_char("0"));
+                else if (pos == 1)
+                    hex_buf.push_back(random_char("xX"));
+                else
+                    hex_buf.push_back(random_char("0123456789abcdefABCDEF"));
+            }
+
+            uint32_t v1 = 0, v2 = 0;
+            auto h1 = digits == 4 ? virtio::ParseDevTypeAttr(hex_buf, v1)
+                                  : virtio::ParseDevStatusAttr(hex_buf, v1);
+            auto h2 = reference::ParseHex(hex_buf, digits, v2);
+            if (!SameResult(h1, h2) || (h1 && v1 != v2)) {
+                fmt::print(stderr, "hex mismatch for \"{}\"\n", hex_buf);
+                mismatches++;
+            }
+        }
+    }
+
+    return mismatches;
+}
+
+// sysfs-formatted features string, see drivers/virtio/virtio.c: features_show()
+static std::string
+FeaturesAttr(const uint64_t features)
+{
+    std::string buf(64, '0');
+    for (uint32_t bit = 0; bit < 64; bit++)
+        if ((features >> bit) & 0x1)
+            buf[bit] = '1';
+    return buf;
+}
+
+constexpr uint64_t net_features_sample {0x130af8424};
+constexpr uint64_t blk_features_sample {0x130000e54};
+
+static void
+WriteAttr(const fs::path &path, const std::string &val)
+{
+    std::ofstream file {path};
+    file << val << '\n';
+}
+
+// Device directory is populated aside and then moved into place,
+// so that it appears at once, as a kernfs one does
+static void
+CreateFixtureDev(const fs::path &root, const uint32_t idx, const bool is_net)
+{
+    auto name = fmt::format("virtio{}", idx);
+    auto tmp_dir = root / "devices" / fmt::format(".{}", name);
+    fs::create_directory(tmp_dir);
+
+    WriteAttr(tmp_dir / "device", is_net ? "0x0001" : "0x0002");
+    WriteAttr(tmp_dir / "status", "0x0000000f");
+    WriteAttr(tmp_dir / "features",
+              FeaturesAttr(is_net ? net_features_sample : blk_features_sample));
+
+    if (is_net)
+        fs::create_directories(tmp_dir / "net" / fmt::format("eth{}", idx / 2));
+    else
+        fs::create_directories(tmp_dir / "block" / fmt::format("vd{}", idx / 2));
+
+    fs::rename(tmp_dir, root / "devices" / name);
+    fs::create_directory_symlink(fs::path {".."} / "devices" / name, root / "bus" / name);
+}
+
+// Fake sysfs layout:
+//   <root>/devices/virtioN/{device,status,features,net/ethN | block/vdN}
+//   <root>/bus/virtioN -> ../devices/virtioN
+static fs::path
+CreateFixtureTree(const fs::path &root, const uint32_t dev_count)
+{
+    fs::create_directories(root / "devices");
+    fs::create_directories(root / "bus");
+
+    for (uint32_t i = 0; i < dev_count; i++)
+        CreateFixtureDev(root, i, i % 2 == 0);
+
+    return root / "bus";
+}
+
+// Device read from the fixture must not mix attributes of
+// the unplugged device and of the one that replaced it
+static bool
+FixtureDescConsistent(const virtio::VirtIODevDesc &desc)
+{
+    switch (desc.dev_type_) {
+    case virtio::VirtIODevType::network_card:
+        return desc.features_ == net_features_sample && desc.aux_info_.starts_with("eth");
+    case virtio::VirtIODevType::block:
+        return desc.features_ == blk_features_sample && desc.aux_info_.starts_with("/dev/vd");
+    default:
+        return false;
+    }
+}
+
+// Scan the fixture bus while another thread keeps unplugging random
+// devices and plugging them back with the other type. Every device has
+// to be either read consistently or reported as removed, the scan itself
+// must never fail. Returns number of violations.
+static uint64_t
+HotplugStress(const uint32_t dev_count, const uint32_t duration_s)
+{
+    auto root = fs::temp_directory_path() /
+                fmt::format("virtio-info-hotplug.{}", getpid());
+    fs::remove_all(root);
+    auto bus_dir = CreateFixtureTree(root, dev_count);
+
+    std::atomic<bool> stop {false};
+    std::atomic<uint64_t> replugs {0};
+
+    std::thread churn {[&]() {
+        std::mt19937 rng {0x5eed};
+        std::vector<bool> is_net(dev_count);
+        for (uint32_t i = 0; i < dev_count; i++)
+            is_net[i] = i % 2 == 0;
+
+        while (!stop) {
+            auto idx = rng() % dev_count;
+            auto name = fmt::format("virtio{}", idx);
+            // bus entry goes first, as in device_del()
+            fs::remove(bus_dir / name);
+            fs::remove_all(root / "devices" / name);
+            is_net[idx] = !is_net[idx];
+            CreateFixtureDev(root, idx, is_net[idx]);
+            replugs++;
+        }
+    }};
+
+    uint64_t scans = 0, devices = 0, removed = 0, violations = 0;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(duration_s);
+
+    try {
+        while (std::chrono::steady_clock::now() < deadline) {
+            auto scan = virtio::ScanVirtioDevs(bus_dir);
+            scans++;
+            devices += scan.devs_.size();
+
+            for (const auto &[name, desc] : scan.devs_) {
+                if (!FixtureDescConsistent(desc)) {
+                    fmt::print(stderr, "{}: inconsistent descriptor\n", name);
+                    violations++;
+                }
+            }
+
+            for (const auto &err : scan.errors_) {
+                if (err.err_ == virtio::DevScanError::removed) {
+                    removed++;
+                    continue;
+                }
+                fmt::print(stderr, "{}: {}\n", err.name_, virtio::DevScanErrorMsg(err));
+                violations++;
+            }
+        }
+    } catch (std::exception &ex) {
+        fmt::print(stderr, "scan failed: {}\n", ex.what());
+        violations++;
+    }
+
+    stop = true;
+    churn.join();
+    fs::remove_all(root);
+
+    fmt::print("{} scans, {} replugs, {} devices read, {} removed during scan, {} violations\n",
+               scans, replugs.load(), devices, removed, violations);
+    return violations;
+}
+
+static virtio::virtio_devs_ct
+CreateDevMap(const uint32_t dev_count)
+{
+    virtio::virtio_devs_ct devs;
+
+    for (uint32_t i = 0; i < dev_count; i++) {
+        auto name = fmt::format("virtio{}", i);
+        bool is_net = i % 2 == 0;
+        devs.insert({name, virtio::VirtIODevDesc {
+                    is_net ? virtio::VirtIODevType::network_card : virtio::VirtIODevType::block,
+                    0xf,
+                    is_net ? net_features_sample : blk_features_sample,
+                    is_net ? fmt::format("eth{}", i / 2) : fmt::format("/dev/vd{}", i / 2),
+                    fs::path {virtio::virtio_devs_path} / name}});
+    }
+
+    return devs;
+}
+
+static std::string
+RenderToString(ftxui::Element elem)
+{
+    auto screen = ftxui::Screen::Create(ftxui::Dimension::Fit(elem, true));
+    ftxui::Render(screen, elem);
+    return screen.ToString();
+}
+
+static void
+RunAll(BenchRunner &runner, const BenchOpts &opts)
+{
+    // attribute parsers
+    const std::string features_attr = FeaturesAttr(net_features_sample);
+    runner.Run("parse/features_bitstring", [&] {
+        uint64_t features;
+        virtio::ParseDevFeaturesAttr(features_attr, features);
+        DoNotOptimize(features);
+    });
+
+    runner.Run("parse/features_bitstring_legacy", [&] {
+        uint64_t features;
+        legacy::ParseDevFeaturesAttr(features_attr, features);
+        DoNotOptimize(features);
+    });
+
+    const std::string type_attr {"0x0001"};
+    runner.Run("parse/dev_type_hex", [&] {
+        uint32_t type;
+        virtio::ParseDevTypeAttr(type_attr, type);
+        DoNotOptimize(type);
+    });
+
+    runner.Run("parse/dev_type_hex_legacy", [&] {
+        uint32_t type;
+        legacy::ParseDevTypeAttr(type_attr, type);
+        DoNotOptimize(type);
+    });
+
+    const std::string status_attr {"0x0000000f"};
+    runner.Run("parse/dev_status_hex", [&] {
+        uint32_t status;
+        virtio::ParseDevStatusAttr(status_attr, status);
+        DoNotOptimize(status);
+    });
+
+    runner.Run("parse/dev_status_hex_legacy", [&] {
+        uint32_t status;
+        legacy::ParseDevStatusAttr(status_attr, status);
+        DoNotOptimize(status);
+    });
+
+    // device descriptors read from a fixture tree
+    auto fixture_root = fs::temp_directory_path() /
+                        fmt::format("virtio-info-bench.{}", getpid());
+    fs::remove_all(fixture_root);
+    auto bus_dir = CreateFixtureTree(fixture_root, opts.dev_count_);
+
+    runner.Run("desc/create_dev_desc_net", [&] {
+        auto desc = virtio::CreateDevDesc(bus_dir / "virtio0");
+        DoNotOptimize(desc);
+    });
+
+    runner.Run("desc/create_dev_desc_blk", [&] {
+        auto desc = virtio::CreateDevDesc(bus_dir / "virtio1");
+        DoNotOptimize(desc);
+    });
+
+    runner.Run(fmt::format("scan/get_dev_map_{}", opts.dev_count_), [&] {
+        auto devs = virtio::GetVirtioDevMap(bus_dir);
+        DoNotOptimize(devs);
+    });
+
+    // features tables
+    runner.Run("table/features_single", [&] {
+        std::vector<ftxui::Elements> tbl;
+        ui::VirtIODevFeaturesTablePopulate(net_features_sample, 0, false,
+                                           virtio::VirtIODevType::network_card, tbl);
+        DoNotOptimize(tbl);
+    });
+
+    runner.Run("table/features_diff", [&] {
+        std::vector<ftxui::Elements> tbl;
+        ui::VirtIODevFeaturesTablePopulate(net_features_sample, ~net_features_sample, true,
+                                           virtio::VirtIODevType::network_card, tbl);
+        DoNotOptimize(tbl);
+    });
+
+    runner.Run("render/features_element", [&] {
+        auto out = RenderToString(
+                ui::VirtIODevCreateFeaturesElement(net_features_sample,
+                                                   virtio::VirtIODevType::network_card));
+        DoNotOptimize(out);
+    });
+
+    // full device list
+    for (uint32_t count : {10u, opts.dev_count_}) {
+        auto devs = CreateDevMap(count);
+        runner.Run(fmt::format("render/list_{}", count), [&] {
+            auto out = RenderToString(ui::CreateDevListElement(devs));
+            DoNotOptimize(out);
+        });
+    }
+
+    // map vs struct-of-arrays devices table
+    runner.Footprint(fmt::format("mem/dev_map_{}", opts.dev_count_), opts.dev_count_, [&] {
+        return CreateDevMap(opts.dev_count_);
+    });
+
+    auto dev_map = CreateDevMap(opts.dev_count_);
+    runner.Footprint(fmt::format("mem/dev_table_{}", opts.dev_count_), opts.dev_count_, [&] {
+        return virtio::DevTable::FromMap(dev_map);
+    });
+
+    runner.Run(fmt::format("scan/get_dev_table_{}", opts.dev_count_), [&] {
+        auto table = virtio::GetVirtioDevTable(bus_dir);
+        DoNotOptimize(table);
+    });
+
+    auto dev_table = virtio::DevTable::FromMap(dev_map);
+    std::vector<std::string> lookup_names;
+    for (uint32_t i = 0; i < opts.dev_count_; i += std::max(1u, opts.dev_count_ / 64))
+        lookup_names.push_back(fmt::format("virtio{}", i));
+
+    runner.Run("lookup/dev_map_find", [&] {
+        for (const auto &name : lookup_names)
+            DoNotOptimize(dev_map.find(name));
+    });
+
+    runner.Run("lookup/dev_table_find", [&] {
+        for (const auto &name : lookup_names)
+            DoNotOptimize(dev_table.Find(name));
+    });
+
+    // e.g. "how many devices have VIRTIO_F_VERSION_1" over all devices
+    runner.Run(fmt::format("aggregate/dev_map_features_{}", opts.dev_count_), [&] {
+        uint64_t cnt = 0;
+        for (const auto &[name, desc] : dev_map)
+            cnt += (desc.features_ >> 32) & 0x1;
+        DoNotOptimize(cnt);
+    });
+
+    runner.Run(fmt::format("aggregate/dev_table_features_{}", opts.dev_count_), [&] {
+        uint64_t cnt = 0;
+        for (auto features : dev_table.FeaturesColumn())
+            cnt += (features >> 32) & 0x1;
+        DoNotOptimize(cnt);
+    });
+
+    runner.Run(fmt::format("list/scan_and_render_{}", opts.dev_count_), [&] {
+        auto devs = virtio::GetVirtioDevMap(bus_dir);
+        auto out = RenderToString(ui::CreateDevListElement(devs));
+        DoNotOptimize(out);
+    });
+
+    fs::remove_all(fixture_root);
+}
+
+} // namespace bench
+
+int main(int argc, char *argv[])
+{
+    bench::BenchOpts opts;
+
+    CLI::App app{"virtio-info micro-benchmarks", "virtio-info-bench"};
+    app.add_option("--filter", opts.filter_, "run only benchmarks containing this substring");
+    app.add_option("--min-time", opts.min_time_ms_, "minimal time per benchmark, ms")
+        ->check(CLI::Range(1u, 60000u));
+    app.add_option("--devices", opts.dev_count_, "number of devices in the synthetic bus")
+        ->check(CLI::Range(1u, 100000u));
+    app.add_flag("--text", opts.text_, "print human-readable results instead of JSON");
+    app.add_option("--fuzz", opts.fuzz_iterations_,
+                   "cross-check attribute parsers on N random inputs and exit");
+    app.add_option("--hotplug-stress", opts.hotplug_stress_s_,
+                   "scan synthetic bus with devices being replugged for N seconds and exit");
+
+    CLI11_PARSE(app, argc, argv);
+
+    if (opts.fuzz_iterations_) {
+        auto mismatches = bench::FuzzAttrParsers(opts.fuzz_iterations_);
+        fmt::print("{} iterations, {} mismatches\n", opts.fuzz_iterations_, mismatches);
+        return mismatches ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
+    if (opts.hotplug_stress_s_) {
+        auto violations = bench::HotplugStress(opts.dev_count_, opts.hotplug_stress_s_);
+        return violations ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
+    try {
+        bench::BenchRunner runner {opts};
+        bench::RunAll(runner, opts);
+        runner.Report();
+    } catch (std::exception &ex) {
+        fmt::print("{}\n", ex.what());
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,167 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2025 Petr Vyazovik <xen@f-m.fm>
+
+#include "attr_parse.h"
+
+#include <array>
+#include <bit>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace virtio {
+
+constexpr uint32_t features_bit_string_len {64};
+constexpr uint32_t hex_digits_max {8};
+
+#if defined(__AVX2__)
+
+// Returns mask of '1' characters, @invalid gets mask of characters
+// which are neither '0' nor '1'.
+static inline uint64_t
+BitStringToMask(const char *buf, uint64_t &invalid)
+{
+    const __m256i zeros = _mm256_set1_epi8('0');
+    const __m256i ones = _mm256_set1_epi8('1');
+
+    uint64_t set = 0;
+    uint64_t valid = 0;
+
+    for (uint32_t i = 0; i < 2; i++) {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(buf + i * 32));
+        __m256i is_one = _mm256_cmpeq_epi8(chunk, ones);
+        __m256i is_zero = _mm256_cmpeq_epi8(chunk, zeros);
+
+        set |= static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(is_one))) << (i * 32);
+        valid |= static_cast<uint64_t>(static_cast<uint32_t>(
+                    _mm256_movemask_epi8(_mm256_or_si256(is_one, is_zero)))) << (i * 32);
+    }
+
+    invalid = ~valid;
+    return set;
+}
+
+#elif defined(__SSE2__)
+
+static inline uint64_t
+BitStringToMask(const char *buf, uint64_t &invalid)
+{
+    const __m128i zeros = _mm_set1_epi8('0');
+    const __m128i ones = _mm_set1_epi8('1');
+
+    uint64_t set = 0;
+    uint64_t valid = 0;
+
+    for (uint32_t i = 0; i < 4; i++) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(buf + i * 16));
+        __m128i is_one = _mm_cmpeq_epi8(chunk, ones);
+        __m128i is_zero = _mm_cmpeq_epi8(chunk, zeros);
+
+        set |= static_cast<uint64_t>(_mm_movemask_epi8(is_one)) << (i * 16);
+        valid |= static_cast<uint64_t>(_mm_movemask_epi8(_mm_or_si128(is_one, is_zero))) << (i * 16);
+    }
+
+    invalid = ~valid;
+    return set;
+}
+
+#else
+
+// SWAR fallback: 8 characters per step
+static inline uint64_t
+BitStringToMask(const char *buf, uint64_t &invalid)
+{
+    constexpr uint64_t ascii_zeros {0x3030303030303030ULL};
+    constexpr uint64_t low_bits {0x0101010101010101ULL};
+    // gathers bit 0 of every byte into the top byte, byte N -> bit N
+    constexpr uint64_t gather_mul {0x0102040810204080ULL};
+
+    uint64_t set = 0;
+    invalid = 0;
+
+    for (uint32_t i = 0; i < 8; i++) {
+        uint64_t word;
+        std::memcpy(&word, buf + i * 8, sizeof(word));
+        if constexpr (std::endian::native == std::endian::big)
+            word = __builtin_bswap64(word);
+
+        word ^= ascii_zeros;
+
+        // any bits other than bit 0 set -> not a '0'/'1' character
+        uint64_t bad = word & ~low_bits;
+        if (bad) {
+            // move the per-byte "bad" flag into bit 0 of the byte
+            bad |= bad >> 4;
+            bad |= bad >> 2;
+            bad |= bad >> 1;
+            invalid |= (((bad & low_bits) * gather_mul) >> 56) << (i * 8);
+        }
+
+        set |= (((word & low_bits) * gather_mul) >> 56) << (i * 8);
+    }
+
+    return set;
+}
+
+#endif
+
+AttrParseResult
+ParseFeaturesBitString(std::string_view buf, uint64_t &features)
+{
+    if (buf.size() != features_bit_string_len)
+        return {AttrParseError::bad_length, static_cast<uint32_t>(buf.size())};
+
+    uint64_t invalid;
+    uint64_t set = BitStringToMask(buf.data(), invalid);
+    if (invalid)
+        return {AttrParseError::bad_digit, static_cast<uint32_t>(std::countr_zero(invalid))};
+
+    features = set;
+    return {};
+}
+
+// hex digit value, or 0x80 for anything else
+static constexpr auto hex_lut = [] {
+    std::array<uint8_t, 256> lut;
+    lut.fill(0x80);
+    for (uint8_t c = '0'; c <= '9'; c++)
+        lut[c] = c - '0';
+    for (uint8_t c = 'a'; c <= 'f'; c++)
+        lut[c] = c - 'a' + 10;
+    for (uint8_t c = 'A'; c <= 'F'; c++)
+        lut[c] = c - 'A' + 10;
+    return lut;
+}();
+
+AttrParseResult
+ParseFixedHex(std::string_view buf, uint32_t digits, uint32_t &val)
+{
+    if (digits == 0 || digits > hex_digits_max || buf.size() != digits + 2)
+        return {AttrParseError::bad_length, static_cast<uint32_t>(buf.size())};
+
+    if (buf[0] != '0' || (buf[1] | 0x20) != 'x')
+        return {AttrParseError::bad_prefix, buf[0] != '0' ? 0u : 1u};
+
+    // no data-dependent branches: invalid digits are accumulated
+    // and checked once at the end
+    uint32_t acc = 0;
+    uint32_t bad = 0;
+    for (uint32_t i = 0; i < digits; i++) {
+        uint8_t d = hex_lut[static_cast<uint8_t>(buf[2 + i])];
+        bad |= d;
+        acc = (acc << 4) | (d & 0xf);
+    }
+
+    if (bad & 0x80) {
+        for (uint32_t i = 0; i < digits; i++)
+            if (hex_lut[static_cast<uint8_t>(buf[2 + i])] & 0x80)
+                return {AttrParseError::bad_digit, 2 + i};
+    }
+
+    val = acc;
+    return {};
+}
+
+} // namespace virtio
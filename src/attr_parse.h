@@ -0,0 +1,55 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2025 Petr Vyazovik <xen@f-m.fm>
+
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+// Parsers for fixed-format sysfs attributes of virtio devices.
+// Output format is defined in drivers/virtio/virtio.c
+namespace virtio {
+
+enum class AttrParseError
+{
+    none,
+    bad_length,
+    bad_prefix,
+    bad_digit
+};
+
+constexpr std::string_view AttrParseErrorDesc(const AttrParseError err)
+{
+    switch (err) {
+    case AttrParseError::none:
+	return "no error";
+    case AttrParseError::bad_length:
+	return "unexpected length";
+    case AttrParseError::bad_prefix:
+	return "missing 0x prefix";
+    case AttrParseError::bad_digit:
+	return "invalid digit";
+    default:
+	return "< unknown >";
+    }
+}
+
+struct AttrParseResult
+{
+    AttrParseError err_ {AttrParseError::none};
+    // offset of the offending character (or the actual length
+    // of the input for AttrParseError::bad_length)
+    uint32_t       pos_ {0};
+
+    explicit operator bool() const { return err_ == AttrParseError::none; }
+};
+
+// "features" attribute: 64 '0'/'1' characters, character N is bit N.
+// SIMD compare+movemask is used where available, SWAR otherwise.
+AttrParseResult ParseFeaturesBitString(std::string_view buf, uint64_t &features);
+
+// "0x" followed by exactly @digits hex digits (at most 8), e.g. "device"
+// ("0x%04x") or "status" ("0x%08x").
+AttrParseResult ParseFixedHex(std::string_view buf, uint32_t digits, uint32_t &val);
+
+} // namespace virtio
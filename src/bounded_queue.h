@@ -0,0 +1,79 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2025 Petr Vyazovik <xen@f-m.fm>
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <optional>
+
+// Fixed capacity multi-producer/multi-consumer queue: producers block
+// while it's full, consumers block while it's empty. Once closed,
+// consumers drain the remaining items and then get nullopt.
+template <typename T>
+class BoundedQueue
+{
+    public:
+        explicit BoundedQueue(const size_t capacity)
+            : capacity_(capacity)
+        {}
+
+        // Returns false if the queue has been closed
+        bool Push(T item)
+        {
+            std::unique_lock lock {mtx_};
+            not_full_.wait(lock, [this] { return closed_ || items_.size() < capacity_; });
+            if (closed_)
+                return false;
+
+            items_.push_back(std::move(item));
+            lock.unlock();
+            not_empty_.notify_one();
+            return true;
+        }
+
+        std::optional<T> Pop()
+        {
+            std::unique_lock lock {mtx_};
+            not_empty_.wait(lock, [this] { return closed_ || !items_.empty(); });
+            return TakeLocked(lock);
+        }
+
+        // Doesn't block, nullopt if there is nothing queued right now
+        std::optional<T> TryPop()
+        {
+            std::unique_lock lock {mtx_};
+            return TakeLocked(lock);
+        }
+
+        void Close()
+        {
+            {
+                std::lock_guard lock {mtx_};
+                closed_ = true;
+            }
+            not_full_.notify_all();
+            not_empty_.notify_all();
+        }
+
+    private:
+        std::optional<T> TakeLocked(std::unique_lock<std::mutex> &lock)
+        {
+            if (items_.empty())
+                return std::nullopt;
+
+            std::optional<T> item {std::move(items_.front())};
+            items_.pop_front();
+            lock.unlock();
+            not_full_.notify_one();
+            return item;
+        }
+
+        std::mutex              mtx_;
+        std::condition_variable not_full_;
+        std::condition_variable not_empty_;
+        std::deque<T>           items_;
+        size_t                  capacity_;
+        bool                    closed_ {false};
+};
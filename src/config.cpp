@@ -2,6 +2,7 @@
 // Copyright (C) 2025 Petr Vyazovik <xen@f-m.fm>
 
 #include "config.h"
+#include "sysfs_source.h"
 #include "virtio_bus.h"
 #include "vi_version.h"
 
@@ -21,8 +22,7 @@ class ExistingDeviceValidator : public CLI::Validator {
                 std::filesystem::path path {virtio::virtio_devs_path};
                 path /= device_name;
 
-                auto check_res = CLI::detail::check_path(path.c_str());
-                if(check_res == CLI::detail::path_type::nonexistent) {
+                if (!virtio::ActiveSysfs().Exists(path)) {
                     return "Non-existent VirtIO device: " + device_name;
                 }
                 return std::string{};
@@ -88,6 +88,14 @@ void ParseCmdLineOptions(CmdLOpts &cmdl_opts, int argc, char *argv[])
             "show registered VirtIO devices")
         ->allow_extra_args(false);
 
+    sgrp2->add_flag_callback(
+            "--progressive",
+            [&]() {
+                cmdl_opts.mode_ = OperationMode::ListAvailDevs;
+                cmdl_opts.progressive_list_ = true;
+            },
+            "print devices as they are scanned, in bus order");
+
     auto sgrp3 = app.add_option_group("+diff");
     sgrp3->set_help_flag();
     sgrp3->excludes(sgrp1);
@@ -135,6 +143,353 @@ void ParseCmdLineOptions(CmdLOpts &cmdl_opts, int argc, char *argv[])
         ->check(ExistingVirtIODevTypeValidator().application_index(0))
         ->check(CLI::Range((uint64_t)1, std::numeric_limits<uint64_t>::max()));
 
+    // every further operation mode excludes all of the previously defined ones
+    std::vector<CLI::Option_group *> mode_grps {sgrp1, sgrp2, sgrp3, sgrp4, sgrp5};
+    auto add_mode_group = [&](const std::string &name) {
+        auto grp = app.add_option_group(name);
+        grp->set_help_flag();
+        for (auto *other : mode_grps)
+            grp->excludes(other);
+        mode_grps.push_back(grp);
+        return grp;
+    };
+
+    auto sgrp6 = add_mode_group("+feat_stream");
+    sgrp6->add_option_function<std::string>(
+            "--feat-stream",
+            [&](const std::string &val) {
+                cmdl_opts.mode_ = OperationMode::RawFeaturesStream;
+                cmdl_opts.stream_input_ = val;
+            },
+            "decode \"<device type> <features>\" lines from file or stdin")
+        ->option_text("< file | - >")
+        ->check(CLI::ExistingFile | CLI::IsMember({"-"}));
+
+    sgrp6->add_option(
+            "-j,--jobs",
+            cmdl_opts.jobs_,
+            "number of worker threads used to decode a file")
+        ->option_text("<N>")
+        ->check(CLI::Range(1u, 256u));
+
+    auto sgrp7 = add_mode_group("+record");
+    sgrp7->add_option_function<std::string>(
+            "--record",
+            [&](const std::string &val) {
+                cmdl_opts.mode_ = OperationMode::RecordHistory;
+                cmdl_opts.hist_log_path_ = val;
+            },
+            "record devices state changes to history log until interrupted")
+        ->option_text("<log>");
+
+    sgrp7->add_option(
+            "--interval",
+            cmdl_opts.hist_interval_ms_,
+            "bus polling interval, ms")
+        ->option_text("<ms>")
+        ->check(CLI::Range(10u, 3600000u));
+
+    sgrp7->add_option(
+            "--checkpoint-every",
+            cmdl_opts.hist_checkpoint_every_,
+            "write full state checkpoint after N change records")
+        ->option_text("<N>")
+        ->check(CLI::Range(1u, 1000000u));
+
+    auto sgrp8 = add_mode_group("+history");
+    sgrp8->add_option_function<std::string>(
+            "--history",
+            [&](const std::string &val) {
+                cmdl_opts.mode_ = OperationMode::QueryHistory;
+                cmdl_opts.hist_log_path_ = val;
+            },
+            "query history log: state at --at, or transitions in [--from, --to]")
+        ->option_text("<log>")
+        ->check(CLI::ExistingFile);
+
+    auto hist_at = sgrp8->add_option(
+            "--at",
+            cmdl_opts.hist_at_,
+            "show state of devices at given time")
+        ->option_text("< unix time | YYYY-MM-DDTHH:MM:SS | now >");
+
+    sgrp8->add_option(
+            "--from",
+            cmdl_opts.hist_from_,
+            "start of time range (default: beginning of log)")
+        ->option_text("<time>")
+        ->excludes(hist_at);
+
+    sgrp8->add_option(
+            "--to",
+            cmdl_opts.hist_to_,
+            "end of time range (default: end of log)")
+        ->option_text("<time>")
+        ->excludes(hist_at);
+
+    sgrp8->add_option(
+            "--dev",
+            cmdl_opts.first_dev_name_,
+            "limit history query to a single device")
+        ->option_text("< device name (e.g. virtio0) >");
+
+    auto sgrp9 = add_mode_group("+check");
+    sgrp9->add_option_function<std::string>(
+            "--check",
+            [&](const std::string &val) {
+                cmdl_opts.mode_ = OperationMode::PolicyCheck;
+                cmdl_opts.policy_path_ = val;
+            },
+            "check devices against features/status policy, fail on violations")
+        ->option_text("<policy>")
+        ->check(CLI::ExistingFile);
+
+    auto sgrp10 = add_mode_group("+vdpa");
+    sgrp10->add_flag_callback(
+            "--vdpa",
+            [&]() {
+                cmdl_opts.mode_ = OperationMode::ListVdpaDevs;
+            },
+            "show vDPA devices and hardware/software data path of VirtIO devices")
+        ->allow_extra_args(false);
+
+    sgrp10->add_option_function<std::string>(
+            "--vdpa-info",
+            [&](const std::string &val) {
+                cmdl_opts.mode_ = OperationMode::ShowVdpaDevInfo;
+                cmdl_opts.first_dev_name_ = val;
+            },
+            "show detailed info about specific vDPA device")
+        ->option_text("< vDPA device name (e.g. vdpa0) >");
+
+    auto sgrp11 = add_mode_group("+transport");
+    sgrp11->add_flag_callback(
+            "--transport",
+            [&]() {
+                cmdl_opts.mode_ = OperationMode::ListDevTransports;
+            },
+            "show transport, interrupt vectors and PCIe link of VirtIO devices")
+        ->allow_extra_args(false);
+
+    auto sgrp12 = add_mode_group("+top");
+    sgrp12->add_flag_callback(
+            "--top",
+            [&]() {
+                cmdl_opts.mode_ = OperationMode::InteractiveTop;
+            },
+            "interactive view of VirtIO devices, refreshed every second")
+        ->allow_extra_args(false);
+
+    auto sgrp13 = add_mode_group("+snapshot");
+    sgrp13->add_option_function<std::string>(
+            "--snapshot",
+            [&](const std::string &val) {
+                cmdl_opts.mode_ = OperationMode::WriteSnapshot;
+                cmdl_opts.snapshot_path_ = val;
+            },
+            "save devices state to snapshot file for later --compare")
+        ->option_text("< file | - >");
+
+    auto sgrp14 = add_mode_group("+compare");
+    sgrp14->add_option_function<std::pair<std::string, std::string>>(
+            "--compare",
+            [&](const std::pair<std::string, std::string> &val) {
+                cmdl_opts.mode_ = OperationMode::CompareSnapshots;
+                cmdl_opts.compare_old_path_ = val.first;
+                cmdl_opts.compare_new_path_ = val.second;
+            },
+            "show devices added, removed or changed between two snapshots")
+        ->option_text("<old snapshot> <new snapshot>")
+        ->check(CLI::ExistingFile);
+
+    sgrp14->add_option_function<std::string>(
+            "--match-by",
+            [&](const std::string &val) {
+                cmdl_opts.match_by_identity_ = val == "identity";
+            },
+            "pair devices by name (default) or by parent device / aux info")
+        ->option_text("< name | identity >")
+        ->check(CLI::IsMember({"name", "identity"}));
+
+    auto sgrp15 = add_mode_group("+probe");
+    auto probe_live = sgrp15->add_flag_callback(
+            "--probe-latency",
+            [&]() {
+                cmdl_opts.mode_ = OperationMode::ProbeLatency;
+            },
+            "watch driver probes until interrupted, report their latencies");
+
+    auto probe_replay = sgrp15->add_option_function<std::string>(
+            "--probe-replay",
+            [&](const std::string &val) {
+                cmdl_opts.mode_ = OperationMode::ProbeLatency;
+                cmdl_opts.probe_replay_path_ = val;
+            },
+            "report probe latencies from events saved with --probe-log")
+        ->option_text("<events>")
+        ->check(CLI::ExistingFile)
+        ->excludes(probe_live);
+
+    sgrp15->add_option(
+            "--probe-log",
+            cmdl_opts.probe_log_path_,
+            "save observed probe events for --probe-replay")
+        ->option_text("<events>")
+        ->excludes(probe_replay);
+
+    sgrp15->add_option(
+            "--probe-interval",
+            cmdl_opts.probe_interval_us_,
+            "status polling interval, us")
+        ->option_text("<us>")
+        ->check(CLI::Range(100u, 1000000u))
+        ->excludes(probe_replay);
+
+    sgrp15->add_option(
+            "--slowest",
+            cmdl_opts.probe_slowest_,
+            "number of slowest devices to show")
+        ->option_text("<N>")
+        ->check(CLI::Range(0u, 1000000u));
+
+    auto sgrp16 = add_mode_group("+throughput");
+    auto throughput = sgrp16->add_flag_callback(
+            "--throughput",
+            [&]() {
+                cmdl_opts.mode_ = OperationMode::DevThroughput;
+            },
+            "show rx/tx rates of network and IOPS/latency of block devices");
+
+    sgrp16->add_flag_callback(
+            "--balloon",
+            [&]() {
+                cmdl_opts.mode_ = OperationMode::BalloonReport;
+            },
+            "show memory balloon size and inflate/deflate rates")
+        ->excludes(throughput);
+
+    sgrp16->add_option(
+            "--sample-interval",
+            cmdl_opts.sample_interval_ms_,
+            "throughput/balloon sampling interval, ms")
+        ->option_text("<ms>")
+        ->check(CLI::Range(100u, 3600000u));
+
+    sgrp16->add_option(
+            "--samples",
+            cmdl_opts.samples_num_,
+            "stop after N reports (default: until interrupted)")
+        ->option_text("<N>");
+
+    auto sgrp17 = add_mode_group("+dev_config");
+    sgrp17->add_option_function<std::string>(
+            "--dev-config",
+            [&](const std::string &val) {
+                cmdl_opts.mode_ = OperationMode::DevConfig;
+                cmdl_opts.first_dev_name_ = val;
+            },
+            "dump common and device config space of a virtio-pci device")
+        ->option_text("< existing device name (e.g. virtio0) >")
+        ->check(ExistingDeviceValidator());
+
+    sgrp17->add_option(
+            "--bar-fixture",
+            cmdl_opts.bar_fixture_path_,
+            "read BARs from resourceN files in this directory")
+        ->option_text("<dir>")
+        ->check(CLI::ExistingDirectory);
+
+    auto sgrp18 = add_mode_group("+virtiofs");
+    sgrp18->add_flag_callback(
+            "--virtiofs",
+            [&]() {
+                cmdl_opts.mode_ = OperationMode::VirtioFsReport;
+            },
+            "show mounts, DAX mode and DAX window of virtio-fs devices");
+
+    sgrp18->add_option(
+            "--mountinfo",
+            cmdl_opts.mountinfo_path_,
+            "match against saved mountinfo instead of /proc/self/mountinfo")
+        ->option_text("<file>")
+        ->check(CLI::ExistingFile);
+
+    auto sgrp19 = add_mode_group("+migrate");
+    auto migrate = sgrp19->add_option_function<std::string>(
+            "--migrate-check",
+            [&](const std::string &val) {
+                cmdl_opts.mode_ = OperationMode::MigrationTargets;
+                cmdl_opts.migrate_vm_path_ = val;
+            },
+            "list hosts that offer every feature negotiated by the VM's devices")
+        ->option_text("<VM snapshot>")
+        ->check(CLI::ExistingFile);
+
+    sgrp19->add_option(
+            "--hosts",
+            cmdl_opts.migrate_hosts_path_,
+            "directory with a snapshot per host, named after the host")
+        ->option_text("<dir>")
+        ->check(CLI::ExistingDirectory)
+        ->needs(migrate);
+    migrate->needs(sgrp19->get_option("--hosts"));
+
+    auto sgrp20 = add_mode_group("+vhost");
+    sgrp20->add_flag_callback(
+            "--vhost",
+            [&]() {
+                cmdl_opts.mode_ = OperationMode::VhostWorkers;
+            },
+            "host side: map QEMU virtio devices to vhost workers and I/O threads");
+
+    sgrp20->add_option(
+            "--proc-root",
+            cmdl_opts.proc_root_path_,
+            "read processes from this directory instead of /proc")
+        ->option_text("<dir>")
+        ->check(CLI::ExistingDirectory);
+
+    auto sgrp21 = add_mode_group("+scsi");
+    sgrp21->add_flag_callback(
+            "--scsi",
+            [&]() {
+                cmdl_opts.mode_ = OperationMode::ScsiReport;
+            },
+            "show queue limits and LUNs of virtio-scsi hosts");
+
+    auto sgrp22 = add_mode_group("+virtio_mem");
+    sgrp22->add_flag_callback(
+            "--virtio-mem",
+            [&]() {
+                cmdl_opts.mode_ = OperationMode::VirtioMemReport;
+            },
+            "show added memory of virtio-mem devices by state, zone and node");
+
+    sgrp22->add_option(
+            "--iomem",
+            cmdl_opts.iomem_path_,
+            "find device regions in saved iomem instead of /proc/iomem")
+        ->option_text("<file>")
+        ->check(CLI::ExistingFile);
+
+    // loaded as soon as parsed, so that device name validators
+    // already see the capture
+    auto from_archive = app.add_option_function<std::string>(
+            "--from-archive",
+            [&](const std::string &val) {
+                virtio::SetActiveSysfs(virtio::LoadSysfsArchive(val));
+            },
+            "read devices from sysfs capture instead of the running system")
+        ->option_text("< tar | tar.gz | tar.zst >")
+        ->check(CLI::ExistingFile)
+        ->trigger_on_parse();
+
+    // these need the running system
+    sgrp7->excludes(from_archive);
+    sgrp12->excludes(from_archive);
+    sgrp15->excludes(from_archive);
+    sgrp16->excludes(from_archive);
+
     app.add_flag_callback(
             "--no-desc",
             [&]() {
@@ -149,6 +504,28 @@ void ParseCmdLineOptions(CmdLOpts &cmdl_opts, int argc, char *argv[])
             },
             "display only the feature bits that have been set");
 
+    app.add_flag_callback(
+            "--json",
+            [&]() {
+                cmdl_opts.json_output_ = true;
+            },
+            "produce JSON output (where supported)");
+
+#ifdef VI_INSTRUMENT
+    app.add_flag_callback(
+            "--stats",
+            [&]() {
+                cmdl_opts.stats_ = true;
+            },
+            "print time spent per phase, sysfs calls and allocations to stderr");
+
+    app.add_option(
+            "--trace",
+            cmdl_opts.trace_path_,
+            "write Chrome/Perfetto trace of the run")
+        ->option_text("<file>");
+#endif
+
     app.add_flag("-v, --version",
             [](std::int64_t) {
                 fmt::print("{} {}\n", vi_current_version, vi_current_hash);
@@ -14,7 +14,26 @@ enum class OperationMode
     ShowDevInfo,
     FeaturesDiff,
     ListDevTypes,
-    RawFeaturesDecoding
+    RawFeaturesDecoding,
+    RawFeaturesStream,
+    RecordHistory,
+    QueryHistory,
+    PolicyCheck,
+    ListVdpaDevs,
+    ShowVdpaDevInfo,
+    ListDevTransports,
+    InteractiveTop,
+    WriteSnapshot,
+    CompareSnapshots,
+    ProbeLatency,
+    DevThroughput,
+    BalloonReport,
+    DevConfig,
+    VirtioFsReport,
+    MigrationTargets,
+    VhostWorkers,
+    ScsiReport,
+    VirtioMemReport
 };
 
 struct CmdLOpts
@@ -24,6 +43,54 @@ struct CmdLOpts
     std::string     second_dev_name_ {};
     uint8_t	           dev_type_ {0};
     uint64_t	       raw_features_ {0};
+    // input file (or "-" for stdin) for features stream decoding
+    std::string        stream_input_ {};
+    // number of worker threads for features stream decoding
+    unsigned                   jobs_ {1};
+
+    // device history log
+    std::string       hist_log_path_ {};
+    uint32_t       hist_interval_ms_ {1000};
+    // write full-state checkpoint after this many delta records
+    uint32_t  hist_checkpoint_every_ {256};
+    // time point / time range for history queries
+    std::string             hist_at_ {};
+    std::string           hist_from_ {};
+    std::string             hist_to_ {};
+
+    // features/status policy file
+    std::string         policy_path_ {};
+
+    // device snapshot to write ("-" for stdout) / snapshots to compare
+    std::string       snapshot_path_ {};
+    std::string    compare_old_path_ {};
+    std::string    compare_new_path_ {};
+    // pair devices by parent device / aux info instead of name
+    bool          match_by_identity_ {false};
+    // VM snapshot to find migration targets for, directory of host snapshots
+    std::string     migrate_vm_path_ {};
+    std::string  migrate_hosts_path_ {};
+    // proc tree to look for QEMU and vhost workers in (default: /proc)
+    std::string     proc_root_path_ {};
+
+    // driver probe latency: events log to write / recorded events to analyze
+    std::string      probe_log_path_ {};
+    std::string   probe_replay_path_ {};
+    uint32_t      probe_interval_us_ {1000};
+    // number of slowest devices to report
+    uint32_t          probe_slowest_ {10};
+
+    // throughput/balloon sampling period, number of reports (0: until interrupted)
+    uint32_t     sample_interval_ms_ {1000};
+    uint32_t            samples_num_ {0};
+
+    // directory with resourceN files standing in for the device BARs
+    std::string    bar_fixture_path_ {};
+
+    // mounts to match virtio-fs devices against (default: /proc/self/mountinfo)
+    std::string      mountinfo_path_ {};
+    // virtio-mem regions (default: /proc/iomem)
+    std::string          iomem_path_ {};
 
     // do not show bit description
     bool               no_feat_desc_ {false};
@@ -31,6 +98,14 @@ struct CmdLOpts
     bool         feat_set_bits_only_ {false};
     // do not display device status bits decoding
     bool                  no_status_ {false};
+    // produce JSON instead of human-readable output
+    bool                json_output_ {false};
+    // print list rows while the bus is still being scanned
+    bool           progressive_list_ {false};
+    // print where the time went (VI_INSTRUMENT builds only)
+    bool                     stats_ {false};
+    // Chrome trace event file to write (VI_INSTRUMENT builds only)
+    std::string          trace_path_ {};
 };
 
 void ParseCmdLineOptions(CmdLOpts &cmdl_opts, int argc, char *argv[]);
@@ -0,0 +1,401 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2025 Petr Vyazovik <xen@f-m.fm>
+
+#include "dev_config.h"
+#include "sysfs_source.h"
+#include "transport.h"
+#include "virtio_bus.h"
+#include "virtio_defs.h"
+
+#include <endian.h>
+#include <fcntl.h>
+#include <linux/virtio_blk.h>
+#include <linux/virtio_pci.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+extern cfg::CmdLOpts cmdl_opts;
+
+namespace devcfg {
+
+namespace fs = std::filesystem;
+
+constexpr std::string_view pci_devs_path {"/sys/bus/pci/devices"};
+// device config may change while being read, see config_generation
+constexpr uint32_t generation_retries {8};
+// devices without decoding get a hex dump of the head of their config
+constexpr size_t raw_dump_len {64};
+
+// Field of a config structure. Fields which exist only if a feature was
+// offered carry the feature bit (-1 if the field is always there).
+struct CfgFieldDesc
+{
+    std::string_view name_;
+    uint16_t         offset_;
+    uint8_t          size_;
+    bool             hex_;
+    int8_t           feature_;
+    std::string_view feature_name_;
+};
+
+// struct virtio_net_config from linux/virtio_net.h, which can't be
+// included from C++ (it has a field named "class")
+struct [[gnu::packed]] NetCfgLayout
+{
+    uint8_t  mac[6];
+    uint16_t status;
+    uint16_t max_virtqueue_pairs;
+    uint16_t mtu;
+    uint32_t speed;
+    uint8_t  duplex;
+    uint8_t  rss_max_key_size;
+    uint16_t rss_max_indirection_table_length;
+    uint32_t supported_hash_types;
+};
+
+#define VI_CFG_FIELD(type, field, hex) \
+    CfgFieldDesc {#field, offsetof(type, field), sizeof(type::field), hex, -1, {}}
+#define VI_CFG_FEAT_FIELD(type, field, feat) \
+    CfgFieldDesc {#field, offsetof(type, field), sizeof(type::field), false, feat, #feat}
+#define VI_NET_CFG_FIELD(field, feat) \
+    CfgFieldDesc {#field, offsetof(NetCfgLayout, field), sizeof(NetCfgLayout::field), false, \
+                  static_cast<int8_t>(virtio::VirtIONetFeature::feat), #feat}
+
+constexpr std::array common_cfg_fields {
+    VI_CFG_FIELD(virtio_pci_common_cfg, device_feature_select, false),
+    VI_CFG_FIELD(virtio_pci_common_cfg, device_feature, true),
+    VI_CFG_FIELD(virtio_pci_common_cfg, guest_feature_select, false),
+    VI_CFG_FIELD(virtio_pci_common_cfg, guest_feature, true),
+    VI_CFG_FIELD(virtio_pci_common_cfg, msix_config, false),
+    VI_CFG_FIELD(virtio_pci_common_cfg, num_queues, false),
+    VI_CFG_FIELD(virtio_pci_common_cfg, device_status, true),
+    VI_CFG_FIELD(virtio_pci_common_cfg, config_generation, false),
+    VI_CFG_FIELD(virtio_pci_common_cfg, queue_select, false),
+    VI_CFG_FIELD(virtio_pci_common_cfg, queue_size, false),
+    VI_CFG_FIELD(virtio_pci_common_cfg, queue_msix_vector, false),
+    VI_CFG_FIELD(virtio_pci_common_cfg, queue_enable, false),
+    VI_CFG_FIELD(virtio_pci_common_cfg, queue_notify_off, false),
+};
+
+constexpr std::array net_cfg_fields {
+    VI_NET_CFG_FIELD(mac, VIRTIO_NET_F_MAC),
+    VI_NET_CFG_FIELD(status, VIRTIO_NET_F_STATUS),
+    VI_NET_CFG_FIELD(max_virtqueue_pairs, VIRTIO_NET_F_MQ),
+    VI_NET_CFG_FIELD(mtu, VIRTIO_NET_F_MTU),
+    VI_NET_CFG_FIELD(speed, VIRTIO_NET_F_SPEED_DUPLEX),
+    VI_NET_CFG_FIELD(duplex, VIRTIO_NET_F_SPEED_DUPLEX),
+    VI_NET_CFG_FIELD(rss_max_key_size, VIRTIO_NET_F_RSS),
+    VI_NET_CFG_FIELD(rss_max_indirection_table_length, VIRTIO_NET_F_RSS),
+    VI_NET_CFG_FIELD(supported_hash_types, VIRTIO_NET_F_RSS),
+};
+
+constexpr std::array blk_cfg_fields {
+    VI_CFG_FIELD(virtio_blk_config, capacity, false),
+    VI_CFG_FEAT_FIELD(virtio_blk_config, size_max, VIRTIO_BLK_F_SIZE_MAX),
+    VI_CFG_FEAT_FIELD(virtio_blk_config, seg_max, VIRTIO_BLK_F_SEG_MAX),
+    VI_CFG_FEAT_FIELD(virtio_blk_config, geometry.cylinders, VIRTIO_BLK_F_GEOMETRY),
+    VI_CFG_FEAT_FIELD(virtio_blk_config, geometry.heads, VIRTIO_BLK_F_GEOMETRY),
+    VI_CFG_FEAT_FIELD(virtio_blk_config, geometry.sectors, VIRTIO_BLK_F_GEOMETRY),
+    VI_CFG_FEAT_FIELD(virtio_blk_config, blk_size, VIRTIO_BLK_F_BLK_SIZE),
+    VI_CFG_FEAT_FIELD(virtio_blk_config, physical_block_exp, VIRTIO_BLK_F_TOPOLOGY),
+    VI_CFG_FEAT_FIELD(virtio_blk_config, alignment_offset, VIRTIO_BLK_F_TOPOLOGY),
+    VI_CFG_FEAT_FIELD(virtio_blk_config, min_io_size, VIRTIO_BLK_F_TOPOLOGY),
+    VI_CFG_FEAT_FIELD(virtio_blk_config, opt_io_size, VIRTIO_BLK_F_TOPOLOGY),
+    VI_CFG_FEAT_FIELD(virtio_blk_config, wce, VIRTIO_BLK_F_CONFIG_WCE),
+    VI_CFG_FEAT_FIELD(virtio_blk_config, num_queues, VIRTIO_BLK_F_MQ),
+    VI_CFG_FEAT_FIELD(virtio_blk_config, max_discard_sectors, VIRTIO_BLK_F_DISCARD),
+    VI_CFG_FEAT_FIELD(virtio_blk_config, max_discard_seg, VIRTIO_BLK_F_DISCARD),
+    VI_CFG_FEAT_FIELD(virtio_blk_config, discard_sector_alignment, VIRTIO_BLK_F_DISCARD),
+    VI_CFG_FEAT_FIELD(virtio_blk_config, max_write_zeroes_sectors, VIRTIO_BLK_F_WRITE_ZEROES),
+    VI_CFG_FEAT_FIELD(virtio_blk_config, max_write_zeroes_seg, VIRTIO_BLK_F_WRITE_ZEROES),
+    VI_CFG_FEAT_FIELD(virtio_blk_config, write_zeroes_may_unmap, VIRTIO_BLK_F_WRITE_ZEROES),
+};
+
+#undef VI_CFG_FIELD
+#undef VI_CFG_FEAT_FIELD
+#undef VI_NET_CFG_FIELD
+
+// Read-only mapping of a config region within a BAR
+class BarRegion
+{
+    public:
+        BarRegion(const fs::path &bar_path, const uint64_t offset, const uint64_t length)
+            : len_(length)
+        {
+            int fd = open(bar_path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0) {
+                fmt::print("Failed to open {}: {}{}\n", bar_path.c_str(), std::strerror(errno),
+                           errno == EACCES ? " (run as root)" : "");
+                throw std::runtime_error("Failed to map device config");
+            }
+
+            // resourceN files are as large as the BAR
+            struct stat st;
+            if (fstat(fd, &st) != 0 || static_cast<uint64_t>(st.st_size) < offset + length) {
+                close(fd);
+                fmt::print("{} is too small for config region at {:#x} (+{:#x})\n",
+                           bar_path.c_str(), offset, length);
+                throw std::runtime_error("Failed to map device config");
+            }
+
+            auto page_size = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+            auto map_offset = offset & ~(page_size - 1);
+            map_len_ = offset - map_offset + length;
+
+            map_ = mmap(nullptr, map_len_, PROT_READ, MAP_SHARED, fd, map_offset);
+            auto map_err = errno;
+            close(fd);
+            if (map_ == MAP_FAILED) {
+                fmt::print("Failed to map {}: {}\n", bar_path.c_str(), std::strerror(map_err));
+                throw std::runtime_error("Failed to map device config");
+            }
+
+            base_ = static_cast<const volatile uint8_t *>(map_) + (offset - map_offset);
+        }
+
+        ~BarRegion()
+        {
+            munmap(map_, map_len_);
+        }
+
+        BarRegion(const BarRegion &) = delete;
+        BarRegion &operator=(const BarRegion &) = delete;
+
+        size_t Size() const { return len_; }
+
+        // Registers have to be accessed with their natural width; 64-bit
+        // fields are read as two 32-bit halves (virtio spec 4.1.3.1)
+        uint64_t Read(const size_t offset, const size_t size) const
+        {
+            switch (size) {
+            case 1:
+                return base_[offset];
+            case 2:
+                return le16toh(*reinterpret_cast<const volatile uint16_t *>(base_ + offset));
+            case 4:
+                return le32toh(*reinterpret_cast<const volatile uint32_t *>(base_ + offset));
+            case 8:
+                return Read(offset, 4) | Read(offset + 4, 4) << 32;
+            default:
+                return 0;
+            }
+        }
+
+    private:
+        void                   *map_ {MAP_FAILED};
+        size_t                  map_len_ {0};
+        const volatile uint8_t *base_ {nullptr};
+        size_t                  len_;
+};
+
+struct CfgValue
+{
+    const CfgFieldDesc *desc_;
+    uint64_t            val_ {0};
+    // for fields which are not plain numbers, e.g. MAC address
+    std::string         text_ {};
+};
+
+static std::vector<CfgValue>
+ReadFields(const BarRegion &region, std::span<const CfgFieldDesc> fields)
+{
+    std::vector<CfgValue> values;
+
+    for (const auto &field : fields) {
+        // devices may implement a shorter structure (older spec revision)
+        if (field.offset_ + field.size_ > region.Size())
+            break;
+
+        CfgValue value {&field};
+        if (field.size_ == 6) {
+            std::array<uint8_t, 6> mac;
+            for (size_t i = 0; i < mac.size(); i++)
+                mac[i] = region.Read(field.offset_ + i, 1);
+            value.text_ = fmt::format("{:02x}:{:02x}:{:02x}:{:02x}:{:02x}:{:02x}",
+                                      mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+        } else {
+            value.val_ = region.Read(field.offset_, field.size_);
+        }
+        values.push_back(std::move(value));
+    }
+
+    return values;
+}
+
+static std::span<const CfgFieldDesc>
+DevCfgFields(const virtio::VirtIODevType dev_type)
+{
+    switch (dev_type) {
+    case virtio::VirtIODevType::network_card:
+        return net_cfg_fields;
+    case virtio::VirtIODevType::block:
+        return blk_cfg_fields;
+    default:
+        return {};
+    }
+}
+
+static const virtio::VirtIOPciCap *
+FindCap(const virtio::PciTransportInfo &pci, const virtio::VirtIOPciCapType type)
+{
+    for (const auto &cap : pci.caps_)
+        if (cap.cfg_type_ == type)
+            return &cap;
+    return nullptr;
+}
+
+static fs::path
+BarPath(const virtio::PciTransportInfo &pci, const uint8_t bar)
+{
+    auto dir = cmdl_opts.bar_fixture_path_.empty()
+               ? fs::path {pci_devs_path} / pci.addr_
+               : fs::path {cmdl_opts.bar_fixture_path_};
+    return dir / fmt::format("resource{}", bar);
+}
+
+static std::string
+FormatValue(const CfgValue &value)
+{
+    if (!value.text_.empty())
+        return value.text_;
+    if (value.desc_->hex_)
+        return fmt::format("{:#x}", value.val_);
+    return fmt::format("{}", value.val_);
+}
+
+static bool
+FieldNegotiated(const CfgValue &value, const uint64_t features)
+{
+    return value.desc_->feature_ < 0 || features & (1ULL << value.desc_->feature_);
+}
+
+static void
+PrintFields(std::string_view title, const virtio::VirtIOPciCap &cap,
+            const std::vector<CfgValue> &values, const uint64_t features)
+{
+    fmt::print("{} config (BAR {} + {:#x}, {} bytes):\n", title, cap.bar_, cap.offset_, cap.length_);
+    for (const auto &value : values) {
+        fmt::print("  {:<34}{}", value.desc_->name_, FormatValue(value));
+        if (!FieldNegotiated(value, features))
+            fmt::print("  ({} not negotiated)", value.desc_->feature_name_);
+        fmt::print("\n");
+    }
+}
+
+static std::string
+JsonFields(const std::vector<CfgValue> &values)
+{
+    std::string out {"{"};
+    for (const auto &value : values) {
+        out += fmt::format("{}\"{}\":", out.size() > 1 ? "," : "", value.desc_->name_);
+        out += value.text_.empty() ? fmt::format("{}", value.val_)
+                                   : fmt::format("\"{}\"", value.text_);
+    }
+    return out + "}";
+}
+
+void ShowDevConfig()
+{
+    auto dev_path = fs::path {virtio::virtio_devs_path} / cmdl_opts.first_dev_name_;
+    auto desc = virtio::CreateDevDesc(dev_path);
+    auto info = virtio::DevGetTransportInfo(desc);
+
+    if (!info.pci_.has_value()) {
+        fmt::print("{} is on {}, only virtio-pci devices have BAR config regions\n",
+                   cmdl_opts.first_dev_name_, virtio::VirtIOTransportName(info.transport_));
+        throw std::runtime_error("Device config is not available");
+    }
+
+    const auto &pci = info.pci_.value();
+    if (!pci.caps_readable_) {
+        fmt::print("PCI capabilities of {} are not readable, run as root\n", pci.addr_);
+        throw std::runtime_error("Device config is not available");
+    }
+
+    if (!virtio::ActiveSysfs().IsLive() && cmdl_opts.bar_fixture_path_.empty()) {
+        fmt::print("Captures have no BAR contents, use --bar-fixture\n");
+        throw std::runtime_error("Device config is not available");
+    }
+
+    const auto *common_cap = FindCap(pci, virtio::VirtIOPciCapType::common_cfg);
+    if (common_cap == nullptr) {
+        fmt::print("{} has no virtio common config capability (legacy device?)\n", pci.addr_);
+        throw std::runtime_error("Device config is not available");
+    }
+
+    BarRegion common {BarPath(pci, common_cap->bar_), common_cap->offset_, common_cap->length_};
+    auto generation_offset = offsetof(virtio_pci_common_cfg, config_generation);
+
+    const auto *device_cap = FindCap(pci, virtio::VirtIOPciCapType::device_cfg);
+    std::optional<BarRegion> device;
+    if (device_cap != nullptr)
+        device.emplace(BarPath(pci, device_cap->bar_), device_cap->offset_, device_cap->length_);
+
+    // device config is consistent only if the generation didn't change
+    // while it was being read
+    std::vector<CfgValue> common_values, device_values;
+    std::vector<uint8_t> raw;
+    bool consistent = false;
+    for (uint32_t attempt = 0; attempt < generation_retries && !consistent; attempt++) {
+        auto generation = common.Read(generation_offset, 1);
+
+        common_values = ReadFields(common, common_cfg_fields);
+        if (device.has_value()) {
+            device_values = ReadFields(*device, DevCfgFields(desc.dev_type_));
+            raw.clear();
+            if (DevCfgFields(desc.dev_type_).empty())
+                for (size_t pos = 0; pos < std::min(device->Size(), raw_dump_len); pos++)
+                    raw.push_back(device->Read(pos, 1));
+        }
+
+        consistent = common.Read(generation_offset, 1) == generation;
+    }
+
+    if (!consistent)
+        fmt::print(stderr, "Device config kept changing while being read\n");
+
+    if (cmdl_opts.json_output_) {
+        std::string raw_hex;
+        for (auto byte : raw)
+            raw_hex += fmt::format("{:02x}", byte);
+        fmt::print("{{\"name\":\"{}\",\"pci\":\"{}\",\"common\":{},\"device\":{},\"raw\":\"{}\","
+                   "\"consistent\":{}}}\n",
+                   cmdl_opts.first_dev_name_, pci.addr_, JsonFields(common_values),
+                   JsonFields(device_values), raw_hex, consistent);
+        return;
+    }
+
+    fmt::print("{} ({}) @ {}\n", cmdl_opts.first_dev_name_,
+               virtio::VirtIODevTypeName(desc.dev_type_), pci.addr_);
+    PrintFields("common", *common_cap, common_values, desc.features_);
+    fmt::print("  (feature words and queue registers as selected by the driver)\n");
+
+    if (device_cap == nullptr) {
+        fmt::print("no device config capability\n");
+        return;
+    }
+
+    PrintFields("device", *device_cap, device_values, desc.features_);
+    for (size_t pos = 0; pos < raw.size(); pos += 16) {
+        fmt::print("  {:04x}:", pos);
+        for (size_t i = pos; i < std::min(pos + 16, raw.size()); i++)
+            fmt::print(" {:02x}", raw[i]);
+        fmt::print("\n");
+    }
+}
+
+} // namespace devcfg
@@ -0,0 +1,22 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2025 Petr Vyazovik <xen@f-m.fm>
+
+#pragma once
+
+#include "config.h"
+
+// Configuration structures of virtio-pci devices, read straight from the
+// BARs. sysfs only shows the negotiated features, while the device limits
+// (queue pairs, MTU, seg_max, ...) live in the device config structure.
+// The common and device config regions are located through the virtio
+// PCI capabilities, the corresponding resourceN files are mapped
+// read-only and the structures are decoded in place. Nothing is ever
+// written to the device, so the per-queue and feature word registers
+// show whatever the driver selected last.
+namespace devcfg {
+
+// Show common and device config of a single device, needs root
+// (or --bar-fixture with files standing in for the BARs)
+void ShowDevConfig();
+
+} // namespace devcfg
@@ -0,0 +1,250 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2025 Petr Vyazovik <xen@f-m.fm>
+
+#include "dev_table.h"
+#include "instrument.h"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <bit>
+#include <functional>
+#include <numeric>
+#include <stdexcept>
+
+namespace virtio {
+
+namespace fs = std::filesystem;
+
+// keep open addressing tables at most half full
+constexpr size_t hash_load_factor_inv {2};
+constexpr size_t hash_min_slots {16};
+
+static size_t
+HashSlots(const size_t entries)
+{
+    return std::bit_ceil(std::max(hash_min_slots, entries * hash_load_factor_inv));
+}
+
+static size_t
+HashStr(std::string_view str)
+{
+    return std::hash<std::string_view> {}(str);
+}
+
+PoolStr StringPool::Intern(std::string_view str)
+{
+    if ((strs_.size() + 1) * hash_load_factor_inv > slots_.size())
+        Rehash(HashSlots(strs_.size() + 1));
+
+    auto mask = slots_.size() - 1;
+    for (auto slot = HashStr(str) & mask;; slot = (slot + 1) & mask) {
+        if (slots_[slot] == 0) {
+            if (data_.size() + str.size() > std::numeric_limits<uint32_t>::max())
+                throw std::runtime_error("String pool overflow");
+
+            PoolStr ref {static_cast<uint32_t>(data_.size()), static_cast<uint32_t>(str.size())};
+            data_.insert(data_.end(), str.begin(), str.end());
+            strs_.push_back(ref);
+            slots_[slot] = strs_.size();
+            return ref;
+        }
+
+        auto ref = strs_[slots_[slot] - 1];
+        if (Get(ref) == str)
+            return ref;
+    }
+}
+
+void StringPool::Rehash(const size_t slots_num)
+{
+    slots_.assign(slots_num, 0);
+
+    auto mask = slots_num - 1;
+    for (uint32_t idx = 0; idx < strs_.size(); idx++) {
+        auto slot = HashStr(Get(strs_[idx])) & mask;
+        while (slots_[slot] != 0)
+            slot = (slot + 1) & mask;
+        slots_[slot] = idx + 1;
+    }
+}
+
+void StringPool::Reserve(const size_t bytes, const size_t strings)
+{
+    data_.reserve(bytes);
+    strs_.reserve(strings);
+    if (HashSlots(strings) > slots_.size())
+        Rehash(HashSlots(strings));
+}
+
+size_t StringPool::MemoryUsage() const
+{
+    return data_.capacity() * sizeof(char) +
+           strs_.capacity() * sizeof(PoolStr) +
+           slots_.capacity() * sizeof(uint32_t);
+}
+
+DevTable DevTable::FromMap(const virtio_devs_ct &devs, const fs::path &bus_path)
+{
+    DevTable table {bus_path};
+    table.Reserve(devs.size());
+
+    for (const auto &[name, desc] : devs)
+        table.Add(name, desc.dev_type_, desc.status_, desc.features_, desc.aux_info_);
+
+    table.SortNatural();
+    return table;
+}
+
+DevTable::index_type
+DevTable::Add(std::string_view name, const VirtIODevType dev_type,
+              const uint32_t status, const uint64_t features,
+              std::string_view aux_info)
+{
+    if (Find(name) != npos)
+        return npos;
+
+    if ((Size() + 1) * hash_load_factor_inv > index_.size())
+        RebuildIndex(HashSlots(Size() + 1));
+
+    auto idx = static_cast<index_type>(Size());
+    names_.push_back(pool_.Intern(name));
+    aux_info_.push_back(pool_.Intern(aux_info));
+    types_.push_back(static_cast<uint8_t>(e_to_type(dev_type)));
+    status_.push_back(status);
+    features_.push_back(features);
+
+    auto mask = index_.size() - 1;
+    auto slot = HashStr(name) & mask;
+    while (index_[slot] != 0)
+        slot = (slot + 1) & mask;
+    index_[slot] = idx + 1;
+
+    return idx;
+}
+
+DevTable::index_type
+DevTable::Find(std::string_view name) const
+{
+    if (index_.empty())
+        return npos;
+
+    auto mask = index_.size() - 1;
+    for (auto slot = HashStr(name) & mask; index_[slot] != 0; slot = (slot + 1) & mask) {
+        auto idx = index_[slot] - 1;
+        if (Name(idx) == name)
+            return idx;
+    }
+
+    return npos;
+}
+
+void DevTable::RebuildIndex(const size_t slots_num)
+{
+    index_.assign(slots_num, 0);
+
+    auto mask = slots_num - 1;
+    for (index_type idx = 0; idx < Size(); idx++) {
+        auto slot = HashStr(Name(idx)) & mask;
+        while (index_[slot] != 0)
+            slot = (slot + 1) & mask;
+        index_[slot] = idx + 1;
+    }
+}
+
+template <typename T>
+static void
+ApplyPermutation(std::vector<T> &column, const std::vector<uint32_t> &order)
+{
+    std::vector<T> sorted;
+    sorted.reserve(column.size());
+    for (auto idx : order)
+        sorted.push_back(column[idx]);
+    column.swap(sorted);
+}
+
+void DevTable::SortNatural()
+{
+    std::vector<uint32_t> order(Size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [this](const uint32_t lhs, const uint32_t rhs) {
+        return DevNameNaturalLess(Name(lhs), Name(rhs));
+    });
+
+    ApplyPermutation(names_, order);
+    ApplyPermutation(aux_info_, order);
+    ApplyPermutation(types_, order);
+    ApplyPermutation(status_, order);
+    ApplyPermutation(features_, order);
+
+    RebuildIndex(index_.size());
+}
+
+void DevTable::Reserve(const size_t dev_count)
+{
+    // "virtioNNNN" names, aux info is mostly short or shared
+    pool_.Reserve(dev_count * 16, dev_count * 2);
+    names_.reserve(dev_count);
+    aux_info_.reserve(dev_count);
+    types_.reserve(dev_count);
+    status_.reserve(dev_count);
+    features_.reserve(dev_count);
+    if (HashSlots(dev_count) > index_.size())
+        RebuildIndex(HashSlots(dev_count));
+}
+
+size_t DevTable::MemoryUsage() const
+{
+    return pool_.MemoryUsage() +
+           names_.capacity() * sizeof(PoolStr) +
+           aux_info_.capacity() * sizeof(PoolStr) +
+           types_.capacity() * sizeof(uint8_t) +
+           status_.capacity() * sizeof(uint32_t) +
+           features_.capacity() * sizeof(uint64_t) +
+           index_.capacity() * sizeof(index_type);
+}
+
+DevTable GetVirtioDevTable()
+{
+    return GetVirtioDevTable(fs::path {virtio_devs_path});
+}
+
+DevTable GetVirtioDevTable(const fs::path &vd_path)
+{
+    std::vector<DevScanErrorRecord> errors;
+    return GetVirtioDevTable(vd_path, errors);
+}
+
+DevTable GetVirtioDevTable(const fs::path &vd_path, std::vector<DevScanErrorRecord> &errors)
+{
+    DevTable table {vd_path};
+
+    auto names = GetVirtioDevNames(vd_path);
+    table.Reserve(names.size());
+    auto aux_index = AuxInfoIndex::Build(vd_path);
+
+    for (const auto &name : names) {
+        auto dev = ScanBusEntry(vd_path, name, aux_index);
+        if (!dev) {
+            errors.push_back(std::move(dev.error_));
+            continue;
+        }
+
+        VI_PHASE_SCOPE(table_build);
+        const auto &desc = dev.desc_.value();
+        auto idx = table.Add(name, desc.dev_type_,
+                             desc.status_, desc.features_, desc.aux_info_);
+        if (idx == DevTable::npos) {
+            fmt::print("Failed to insert VirtIO dev entry into table\n");
+            throw std::runtime_error("Failed to populate VirtIO devices table\n");
+        }
+    }
+
+    {
+        VI_PHASE_SCOPE(table_build);
+        table.SortNatural();
+    }
+    return table;
+}
+
+} // namespace virtio
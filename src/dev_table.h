@@ -0,0 +1,117 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2025 Petr Vyazovik <xen@f-m.fm>
+
+#pragma once
+
+#include "virtio_bus.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <limits>
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace virtio {
+
+// Reference to a string stored in a StringPool
+struct PoolStr
+{
+    uint32_t offset_ {0};
+    uint32_t len_ {0};
+};
+
+// Append-only arena of interned strings: equal strings are stored once,
+// references stay valid as the arena grows
+class StringPool
+{
+    public:
+        PoolStr Intern(std::string_view str);
+
+        std::string_view Get(const PoolStr ref) const
+        {
+            return {data_.data() + ref.offset_, ref.len_};
+        }
+
+        void Reserve(const size_t bytes, const size_t strings);
+        size_t MemoryUsage() const;
+
+    private:
+        void Rehash(const size_t slots_num);
+
+        std::vector<char>     data_;
+        std::vector<PoolStr>  strs_;
+        // open addressing set, holds index into strs_ + 1, 0 if empty
+        std::vector<uint32_t> slots_;
+};
+
+// Struct-of-arrays devices table: one contiguous column per field,
+// names and aux info are kept in a StringPool. Rows are addressed by
+// index, name lookup is a hash probe. Device paths are not stored,
+// they are derived from the bus path and the name. Snapshots and the
+// policy check scan into it.
+class DevTable
+{
+    public:
+        using index_type = uint32_t;
+        static constexpr index_type npos {std::numeric_limits<index_type>::max()};
+
+        explicit DevTable(const std::filesystem::path &bus_path = virtio_devs_path)
+            : bus_path_(bus_path)
+        {}
+
+        static DevTable FromMap(const virtio_devs_ct &devs,
+                                const std::filesystem::path &bus_path = virtio_devs_path);
+
+        // Returns npos if a device with this name is already present
+        index_type Add(std::string_view name, const VirtIODevType dev_type,
+                       const uint32_t status, const uint64_t features,
+                       std::string_view aux_info);
+
+        index_type Find(std::string_view name) const;
+
+        size_t Size() const { return types_.size(); }
+        bool Empty() const { return types_.empty(); }
+
+        std::string_view Name(const index_type idx) const { return pool_.Get(names_[idx]); }
+        VirtIODevType Type(const index_type idx) const { return VirtIODevType {types_[idx]}; }
+        uint32_t Status(const index_type idx) const { return status_[idx]; }
+        uint64_t Features(const index_type idx) const { return features_[idx]; }
+        std::string_view AuxInfo(const index_type idx) const { return pool_.Get(aux_info_[idx]); }
+        std::filesystem::path DevPath(const index_type idx) const { return bus_path_ / Name(idx); }
+
+        // whole columns, for scans over all devices
+        std::span<const uint32_t> StatusColumn() const { return status_; }
+        std::span<const uint64_t> FeaturesColumn() const { return features_; }
+
+        // Reorder rows by device name, "virtio2" goes before "virtio10"
+        void SortNatural();
+
+        void Reserve(const size_t dev_count);
+
+        // heap bytes held by the table
+        size_t MemoryUsage() const;
+
+    private:
+        void RebuildIndex(const size_t slots_num);
+
+        std::filesystem::path   bus_path_;
+        StringPool              pool_;
+        std::vector<PoolStr>    names_;
+        std::vector<PoolStr>    aux_info_;
+        // device type ids fit into a byte
+        std::vector<uint8_t>    types_;
+        std::vector<uint32_t>   status_;
+        std::vector<uint64_t>   features_;
+        // open addressing name index, holds row index + 1, 0 if empty
+        std::vector<index_type> index_;
+};
+
+DevTable GetVirtioDevTable();
+// same as above, but for a bus directory other than virtio_devs_path
+DevTable GetVirtioDevTable(const std::filesystem::path &vd_path);
+// devices that failed to be read are skipped and recorded in @errors
+DevTable GetVirtioDevTable(const std::filesystem::path &vd_path,
+                           std::vector<DevScanErrorRecord> &errors);
+
+} // namespace virtio
@@ -0,0 +1,100 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2025 Petr Vyazovik <xen@f-m.fm>
+
+#include "feat_names.h"
+#include "virtio_bus.h"
+
+#include <fmt/core.h>
+
+#include <string>
+
+#include "magic_enum/magic_enum.hpp"
+
+namespace virtio {
+
+// storage for generic "BIT_<n>" names
+static const std::array<std::string, feature_bits_max> &
+GenericBitNames()
+{
+    static const auto names = [] {
+        std::array<std::string, feature_bits_max> arr;
+        for (uint32_t bit = 0; bit < feature_bits_max; bit++)
+            arr[bit] = fmt::format("BIT_{}", bit);
+        return arr;
+    }();
+
+    return names;
+}
+
+template <typename T>
+static FeatureNameTable
+CreateNameTable()
+{
+    FeatureNameTable tbl;
+    const auto &generic = GenericBitNames();
+
+    for (uint32_t bit = 0; bit < feature_bits_max; bit++)
+        tbl[bit] = generic[bit];
+
+    for (const auto &field : magic_enum::enum_values<T>())
+        tbl[e_to_type(field)] = magic_enum::enum_name(field);
+
+    return tbl;
+}
+
+static const FeatureNameTable &
+CommonFeatureNames()
+{
+    static const auto tbl = CreateNameTable<VirtIOCommonFeature>();
+    return tbl;
+}
+
+const FeatureNameTable &
+FeatureNames(const VirtIODevType dev_type)
+{
+    switch (dev_type) {
+    case VirtIODevType::network_card: {
+        static const auto tbl = CreateNameTable<VirtIONetFeature>();
+        return tbl;
+    }
+    case VirtIODevType::mem_balloon_traditional: {
+        static const auto tbl = CreateNameTable<VirtIOBalloonFeature>();
+        return tbl;
+    }
+    case VirtIODevType::scsi_host: {
+        static const auto tbl = CreateNameTable<VirtIOScsiFeature>();
+        return tbl;
+    }
+    default:
+        return CommonFeatureNames();
+    }
+}
+
+const FeatureNameTable &
+FeatureNames(const uint32_t dev_type_id)
+{
+    // per-id lookup, so that hot loops don't go through the switch above
+    static const auto tables = [] {
+        std::array<const FeatureNameTable *, e_to_type(VirtIODevType::dev_type_max) + 1> arr;
+        for (uint32_t id = 0; id < arr.size(); id++)
+            arr[id] = &FeatureNames(VirtIODevType {id});
+        return arr;
+    }();
+
+    if (dev_type_id >= tables.size())
+        return CommonFeatureNames();
+
+    return *tables[dev_type_id];
+}
+
+std::optional<uint32_t>
+FeatureBitByName(const FeatureNameTable &tbl, std::string_view name)
+{
+    for (uint32_t bit = 0; bit < feature_bits_max; bit++)
+        if (tbl[bit] == name)
+            return bit;
+
+    return std::nullopt;
+}
+
+} // namespace virtio
@@ -0,0 +1,33 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2025 Petr Vyazovik <xen@f-m.fm>
+
+#pragma once
+
+#include "virtio_defs.h"
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+namespace virtio {
+
+constexpr uint32_t feature_bits_max {64};
+
+// Name of every feature bit for a given device type, indexed by bit position.
+// Bits which are not defined for the type carry a generic "BIT_<n>" name,
+// so a lookup never has to branch on an empty slot.
+using FeatureNameTable = std::array<std::string_view, feature_bits_max>;
+
+// Tables are built once on first use and live until exit.
+// Types without device-specific decoding share the common-bits table.
+const FeatureNameTable &FeatureNames(const VirtIODevType dev_type);
+
+// Same as above, but for a raw (possibly undefined) device type id
+const FeatureNameTable &FeatureNames(const uint32_t dev_type_id);
+
+// Bit position of a named feature in @tbl
+std::optional<uint32_t> FeatureBitByName(const FeatureNameTable &tbl,
+                                         std::string_view name);
+
+} // namespace virtio
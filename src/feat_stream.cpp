@@ -0,0 +1,401 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2025 Petr Vyazovik <xen@f-m.fm>
+
+#include "feat_stream.h"
+#include "feat_names.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+extern cfg::CmdLOpts cmdl_opts;
+
+namespace stream {
+
+// stdin is consumed in blocks of this size
+constexpr size_t stdin_block_size {1 << 20};
+// amount of input handed to a single worker in multi-threaded mode
+constexpr size_t job_chunk_size {4 << 20};
+
+// Result of decoding a contiguous chunk of lines
+struct ChunkResult
+{
+    std::string           out_;
+    // offsets (relative to the whole input) of the malformed lines
+    std::vector<size_t>   bad_lines_;
+};
+
+static inline bool IsBlank(const char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == ',';
+}
+
+static inline const char *
+SkipBlanks(const char *p, const char *end)
+{
+    while (p < end && IsBlank(*p))
+        p++;
+    return p;
+}
+
+static inline bool
+ParseDec(const char *&p, const char *end, uint64_t &val)
+{
+    const char *start = p;
+    uint64_t v = 0;
+
+    while (p < end && *p >= '0' && *p <= '9') {
+        if (__builtin_mul_overflow(v, 10, &v) ||
+            __builtin_add_overflow(v, static_cast<uint64_t>(*p - '0'), &v))
+            return false;
+        p++;
+    }
+
+    val = v;
+    return p != start;
+}
+
+static inline bool
+ParseHex(const char *&p, const char *end, uint64_t &val)
+{
+    const char *start = p;
+    uint64_t v = 0;
+
+    while (p < end) {
+        uint32_t c = static_cast<unsigned char>(*p);
+        uint32_t digit;
+        if (c - '0' < 10)
+            digit = c - '0';
+        else if ((c | 0x20) - 'a' < 6)
+            digit = (c | 0x20) - 'a' + 10;
+        else
+            break;
+
+        if (p - start == 16)
+            return false;
+
+        v = (v << 4) | digit;
+        p++;
+    }
+
+    val = v;
+    return p != start;
+}
+
+// Parse "<type> <features>" line starting at @p.
+// On return @p points to the beginning of the next line.
+static inline bool
+ParseLine(const char *&p, const char *end, uint32_t &type, uint64_t &features)
+{
+    const char *eol = static_cast<const char *>(std::memchr(p, '\n', end - p));
+    if (!eol)
+        eol = end;
+
+    const char *cur = SkipBlanks(p, eol);
+    p = eol < end ? eol + 1 : end;
+
+    uint64_t type_val;
+    if (!ParseDec(cur, eol, type_val) || type_val > UINT8_MAX)
+        return false;
+
+    cur = SkipBlanks(cur, eol);
+
+    bool parsed;
+    if (eol - cur > 2 && cur[0] == '0' && (cur[1] | 0x20) == 'x') {
+        cur += 2;
+        parsed = ParseHex(cur, eol, features);
+    } else {
+        parsed = ParseDec(cur, eol, features);
+    }
+
+    if (!parsed || SkipBlanks(cur, eol) != eol)
+        return false;
+
+    type = static_cast<uint32_t>(type_val);
+    return true;
+}
+
+// empty lines and '#' comments are silently skipped
+static inline bool
+LineIsEmpty(const char *p, const char *end)
+{
+    p = SkipBlanks(p, end);
+    return p == end || *p == '\n' || *p == '#';
+}
+
+static inline void
+AppendDec(std::string &out, uint32_t val)
+{
+    char buf[10];
+    char *pos = buf + sizeof(buf);
+    do {
+        *--pos = static_cast<char>('0' + val % 10);
+        val /= 10;
+    } while (val);
+
+    out.append(pos, buf + sizeof(buf) - pos);
+}
+
+static inline void
+AppendHex(std::string &out, uint64_t val)
+{
+    static constexpr char digits[] = "0123456789abcdef";
+    char buf[18];
+    char *pos = buf + sizeof(buf);
+    do {
+        *--pos = digits[val & 0xf];
+        val >>= 4;
+    } while (val);
+    *--pos = 'x';
+    *--pos = '0';
+
+    out.append(pos, buf + sizeof(buf) - pos);
+}
+
+static inline void
+AppendDecoded(std::string &out, const uint32_t type, const uint64_t features,
+              const bool json)
+{
+    const auto &names = virtio::FeatureNames(type);
+
+    if (json) {
+        out.append("{\"type\":");
+        AppendDec(out, type);
+        out.append(",\"features\":\"");
+        AppendHex(out, features);
+        out.append("\",\"bits\":[");
+
+        bool first = true;
+        for (uint64_t bits = features; bits; bits &= bits - 1) {
+            if (!first)
+                out.push_back(',');
+            first = false;
+
+            out.push_back('"');
+            out.append(names[std::countr_zero(bits)]);
+            out.push_back('"');
+        }
+
+        out.append("]}\n");
+    } else {
+        AppendDec(out, type);
+        out.push_back(' ');
+        AppendHex(out, features);
+        out.push_back(':');
+
+        for (uint64_t bits = features; bits; bits &= bits - 1) {
+            out.push_back(' ');
+            out.append(names[std::countr_zero(bits)]);
+        }
+
+        out.push_back('\n');
+    }
+}
+
+// Decode all lines in [begin, end). @base_off is the offset of @begin
+// within the whole input and is used for error reporting only.
+static void
+DecodeChunk(const char *begin, const char *end, const size_t base_off,
+            const bool json, ChunkResult &res)
+{
+    // decoded output is usually several times larger than the input
+    res.out_.reserve((end - begin) * 4);
+
+    const char *p = begin;
+    while (p < end) {
+        const char *line = p;
+        uint32_t type;
+        uint64_t features;
+
+        if (ParseLine(p, end, type, features)) {
+            AppendDecoded(res.out_, type, features, json);
+        } else if (!LineIsEmpty(line, end)) {
+            res.bad_lines_.push_back(base_off + (line - begin));
+        }
+    }
+}
+
+static void
+FlushChunk(const ChunkResult &res)
+{
+    if (!res.out_.empty())
+        std::fwrite(res.out_.data(), 1, res.out_.size(), stdout);
+
+    for (auto off : res.bad_lines_)
+        fmt::print(stderr, "Skipping malformed input line at offset {}\n", off);
+}
+
+// Move @pos forward to the beginning of the next line
+static const char *
+AlignToLine(const char *pos, const char *end)
+{
+    if (pos >= end)
+        return end;
+
+    const char *eol = static_cast<const char *>(std::memchr(pos, '\n', end - pos));
+    return eol ? eol + 1 : end;
+}
+
+static void
+DecodeMapped(const char *data, const size_t size, const bool json, unsigned jobs)
+{
+    const char *end = data + size;
+
+    if (jobs <= 1) {
+        // keep the output buffer bounded for huge inputs,
+        // and reuse it to avoid faulting in fresh pages for every chunk
+        ChunkResult res;
+        const char *pos = data;
+        while (pos < end) {
+            const char *chunk_end = AlignToLine(pos + std::min(job_chunk_size,
+                                                               static_cast<size_t>(end - pos)) - 1,
+                                                end);
+            res.out_.clear();
+            res.bad_lines_.clear();
+            DecodeChunk(pos, chunk_end, pos - data, json, res);
+            FlushChunk(res);
+            pos = chunk_end;
+        }
+        return;
+    }
+
+    // Process the input in rounds: each round hands one chunk to every
+    // worker, then the results are written out in input order.
+    std::vector<ChunkResult> results(jobs);
+    std::vector<std::thread> workers;
+    workers.reserve(jobs);
+
+    const char *pos = data;
+    while (pos < end) {
+        workers.clear();
+        unsigned used = 0;
+
+        for (; used < jobs && pos < end; used++) {
+            const char *chunk_end = AlignToLine(pos + std::min(job_chunk_size,
+                                                               static_cast<size_t>(end - pos)) - 1,
+                                                end);
+            results[used] = {};
+            workers.emplace_back(DecodeChunk, pos, chunk_end,
+                                 static_cast<size_t>(pos - data), json,
+                                 std::ref(results[used]));
+            pos = chunk_end;
+        }
+
+        for (auto &worker : workers)
+            worker.join();
+
+        for (unsigned i = 0; i < used; i++)
+            FlushChunk(results[i]);
+    }
+}
+
+static void
+DecodeFile(const std::string &file_path, const bool json, const unsigned jobs)
+{
+    int fd = open(file_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        fmt::print("Failed to open {}: {}\n", file_path, std::strerror(errno));
+        throw std::runtime_error("Failed to decode features stream");
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        fmt::print("Failed to stat {}: {}\n", file_path, std::strerror(errno));
+        close(fd);
+        throw std::runtime_error("Failed to decode features stream");
+    }
+
+    if (st.st_size == 0) {
+        close(fd);
+        return;
+    }
+
+    void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        fmt::print("Failed to map {}: {}\n", file_path, std::strerror(errno));
+        throw std::runtime_error("Failed to decode features stream");
+    }
+
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+    DecodeMapped(static_cast<const char *>(data), st.st_size, json, jobs);
+
+    munmap(data, st.st_size);
+}
+
+static void
+DecodeStdin(const bool json)
+{
+    std::string buf;
+    size_t consumed = 0;
+
+    buf.resize(stdin_block_size);
+    size_t filled = 0;
+
+    for (;;) {
+        if (filled == buf.size())
+            buf.resize(buf.size() * 2);
+
+        auto rd = read(STDIN_FILENO, buf.data() + filled, buf.size() - filled);
+        if (rd < 0) {
+            if (errno == EINTR)
+                continue;
+            fmt::print("Failed to read stdin: {}\n", std::strerror(errno));
+            throw std::runtime_error("Failed to decode features stream");
+        }
+
+        bool eof = rd == 0;
+        filled += rd;
+
+        // decode only complete lines unless the input is over
+        const char *begin = buf.data();
+        const char *end = begin + filled;
+        if (!eof) {
+            const char *last_eol = static_cast<const char *>(memrchr(begin, '\n', filled));
+            if (!last_eol)
+                continue;
+            end = last_eol + 1;
+        }
+
+        ChunkResult res;
+        DecodeChunk(begin, end, consumed, json, res);
+        FlushChunk(res);
+
+        size_t done = end - begin;
+        consumed += done;
+        filled -= done;
+        std::memmove(buf.data(), end, filled);
+
+        if (eof)
+            break;
+    }
+}
+
+void DecodeRawFeaturesStream()
+{
+    const auto &input = cmdl_opts.stream_input_;
+
+    if (input == "-")
+        DecodeStdin(cmdl_opts.json_output_);
+    else
+        DecodeFile(input, cmdl_opts.json_output_, cmdl_opts.jobs_);
+
+    std::fflush(stdout);
+}
+
+} // namespace stream
@@ -0,0 +1,15 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2025 Petr Vyazovik <xen@f-m.fm>
+
+#pragma once
+
+#include "config.h"
+
+namespace stream {
+
+// Decode a stream of "<device type> <features>" pairs (one pair per line)
+// read either from a file or from stdin ("-").
+// Features may be given in decimal or as a 0x-prefixed hex value.
+void DecodeRawFeaturesStream();
+
+} // namespace stream
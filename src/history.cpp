@@ -0,0 +1,914 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2025 Petr Vyazovik <xen@f-m.fm>
+
+#include "history.h"
+#include "feat_names.h"
+#include "util.h"
+#include "virtio_bus.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "magic_enum/magic_enum.hpp"
+
+extern cfg::CmdLOpts cmdl_opts;
+
+namespace history {
+
+constexpr char     log_magic[8] {'V', 'I', 'H', 'I', 'S', 'T', '0', '1'};
+constexpr uint32_t log_version {1};
+// initial size of a new log file, grows by doubling
+constexpr uint64_t log_initial_size {1 << 20};
+constexpr uint32_t record_align {8};
+constexpr uint64_t ns_per_sec {1000000000ULL};
+
+struct LogHeader
+{
+    char     magic_[8];
+    uint32_t version_;
+    uint32_t checkpoint_every_;
+    // bytes in use, including this header
+    uint64_t used_;
+    uint64_t records_;
+    uint64_t checkpoints_;
+    uint64_t last_ts_ns_;
+    uint8_t  reserved_[16];
+};
+static_assert(sizeof(LogHeader) == 64);
+
+enum class RecordKind : uint8_t
+{
+    dev_added   = 1,
+    dev_removed = 2,
+    dev_changed = 3,
+    checkpoint  = 4
+};
+
+// changed fields of dev_added/dev_changed records
+enum RecordField : uint8_t
+{
+    rec_field_status   = 1 << 0,
+    rec_field_features = 1 << 1,
+    rec_field_aux      = 1 << 2,
+    rec_field_all      = rec_field_status | rec_field_features | rec_field_aux
+};
+
+// Record layout:
+//   dev_added/dev_changed: [features u64][status u32][aux len u16, aux]
+//                          (only fields present in fields_)
+//   dev_removed:           no payload
+//   checkpoint:            dev_id_ holds device count, then per device
+//                          [dev_id u32][type u16][aux len u16][status u32]
+//                          [features u64][aux]
+// Records are padded to record_align bytes.
+struct RecordHdr
+{
+    // total length, including this header
+    uint32_t len_;
+    RecordKind kind_;
+    uint8_t  fields_;
+    uint16_t dev_type_;
+    uint32_t dev_id_;
+    uint32_t reserved_;
+    uint64_t ts_ns_;
+};
+static_assert(sizeof(RecordHdr) == 24);
+
+struct IndexEntry
+{
+    uint64_t ts_ns_;
+    uint64_t offset_;
+};
+
+struct DevState
+{
+    uint16_t    dev_type_;
+    uint32_t    status_;
+    uint64_t    features_;
+    std::string aux_info_;
+
+    bool operator==(const DevState &) const = default;
+};
+
+// keyed by N of "virtioN"
+using dev_states_ct = std::map<uint32_t, DevState>;
+
+static uint64_t
+NowNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * ns_per_sec + ts.tv_nsec;
+}
+
+static std::string
+FormatTime(const uint64_t ts_ns)
+{
+    time_t secs = ts_ns / ns_per_sec;
+    struct tm tm;
+    localtime_r(&secs, &tm);
+
+    char buf[32];
+    std::strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tm);
+    return fmt::format("{}.{:03}", buf, (ts_ns % ns_per_sec) / 1000000);
+}
+
+// Accepts unix time in seconds (with optional fraction),
+// "YYYY-MM-DDTHH:MM:SS" / "YYYY-MM-DD HH:MM:SS" local time, or "now"
+static uint64_t
+ParseTime(const std::string &str)
+{
+    if (str == "now")
+        return NowNs();
+
+    struct tm tm {};
+    for (auto fmt_str : {"%Y-%m-%dT%H:%M:%S", "%Y-%m-%d %H:%M:%S"}) {
+        const char *end = strptime(str.c_str(), fmt_str, &tm);
+        if (end && *end == '\0') {
+            tm.tm_isdst = -1;
+            return static_cast<uint64_t>(mktime(&tm)) * ns_per_sec;
+        }
+    }
+
+    double secs;
+    auto [ptr, ec] = std::from_chars(str.data(), str.data() + str.size(), secs);
+    if (ec != std::errc{} || ptr != str.data() + str.size() || secs < 0) {
+        fmt::print("Failed to parse time: {}\n", str);
+        throw std::runtime_error("Failed to query device history");
+    }
+
+    return static_cast<uint64_t>(secs * ns_per_sec);
+}
+
+static bool
+ParseDevId(std::string_view name, uint32_t &dev_id)
+{
+    constexpr std::string_view prefix {"virtio"};
+    if (!name.starts_with(prefix))
+        return false;
+
+    name.remove_prefix(prefix.size());
+    return util::ParseNumber(name, dev_id);
+}
+
+static dev_states_ct
+ScanDevStates()
+{
+    dev_states_ct states;
+
+    for (const auto &[name, desc] : virtio::GetVirtioDevMap()) {
+        uint32_t dev_id;
+        if (!ParseDevId(name, dev_id))
+            continue;
+
+        states[dev_id] = {static_cast<uint16_t>(e_to_type(desc.dev_type_)),
+                          desc.status_, desc.features_, desc.aux_info_};
+    }
+
+    return states;
+}
+
+// Serialized record under construction
+class RecordBuilder
+{
+    public:
+        RecordBuilder(RecordKind kind, uint8_t fields, uint16_t dev_type,
+                      uint32_t dev_id, uint64_t ts_ns)
+            : buf_(sizeof(RecordHdr), 0)
+        {
+            RecordHdr hdr {0, kind, fields, dev_type, dev_id, 0, ts_ns};
+            std::memcpy(buf_.data(), &hdr, sizeof(hdr));
+        }
+
+        template <typename T>
+        void Put(const T val)
+        {
+            auto pos = buf_.size();
+            buf_.resize(pos + sizeof(T));
+            std::memcpy(buf_.data() + pos, &val, sizeof(T));
+        }
+
+        void PutString(const std::string &str)
+        {
+            Put(static_cast<uint16_t>(str.size()));
+            buf_.insert(buf_.end(), str.begin(), str.end());
+        }
+
+        const std::vector<uint8_t> &Finish()
+        {
+            buf_.resize((buf_.size() + record_align - 1) & ~(record_align - 1));
+            uint32_t len = buf_.size();
+            std::memcpy(buf_.data(), &len, sizeof(len));
+            return buf_;
+        }
+
+    private:
+        std::vector<uint8_t> buf_;
+};
+
+// Sequential reader of a record payload
+class RecordCursor
+{
+    public:
+        RecordCursor(const uint8_t *pos, const uint8_t *end) : pos_(pos), end_(end) {}
+
+        template <typename T>
+        T Get()
+        {
+            T val {};
+            if (end_ - pos_ < static_cast<ptrdiff_t>(sizeof(T)))
+                throw std::runtime_error("Truncated history log record");
+            std::memcpy(&val, pos_, sizeof(T));
+            pos_ += sizeof(T);
+            return val;
+        }
+
+        std::string GetString()
+        {
+            auto len = Get<uint16_t>();
+            if (end_ - pos_ < len)
+                throw std::runtime_error("Truncated history log record");
+            std::string str(reinterpret_cast<const char *>(pos_), len);
+            pos_ += len;
+            return str;
+        }
+
+    private:
+        const uint8_t *pos_;
+        const uint8_t *end_;
+};
+
+class LogWriter
+{
+    public:
+        explicit LogWriter(const std::string &path)
+        {
+            fd_ = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+            if (fd_ < 0) {
+                fmt::print("Failed to open {}: {}\n", path, std::strerror(errno));
+                throw std::runtime_error("Failed to record device history");
+            }
+
+            auto idx_path = path + ".idx";
+            idx_fd_ = open(idx_path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+            if (idx_fd_ < 0) {
+                fmt::print("Failed to open {}: {}\n", idx_path, std::strerror(errno));
+                close(fd_);
+                throw std::runtime_error("Failed to record device history");
+            }
+
+            struct stat st;
+            fstat(fd_, &st);
+
+            bool fresh = st.st_size == 0;
+            size_ = fresh ? log_initial_size : st.st_size;
+            if (fresh && ftruncate(fd_, size_) < 0) {
+                fmt::print("Failed to resize {}: {}\n", path, std::strerror(errno));
+                Close();
+                throw std::runtime_error("Failed to record device history");
+            }
+
+            Map();
+
+            if (fresh) {
+                LogHeader hdr {};
+                std::memcpy(hdr.magic_, log_magic, sizeof(log_magic));
+                hdr.version_ = log_version;
+                hdr.checkpoint_every_ = cmdl_opts.hist_checkpoint_every_;
+                hdr.used_ = sizeof(LogHeader);
+                std::memcpy(base_, &hdr, sizeof(hdr));
+            } else if (size_ < sizeof(LogHeader) ||
+                       std::memcmp(Header()->magic_, log_magic, sizeof(log_magic)) ||
+                       Header()->version_ != log_version) {
+                fmt::print("{} is not a device history log\n", path);
+                Close();
+                throw std::runtime_error("Failed to record device history");
+            }
+        }
+
+        ~LogWriter() { Close(); }
+
+        LogWriter(const LogWriter &) = delete;
+        LogWriter &operator=(const LogWriter &) = delete;
+
+        const LogHeader *Header() const { return reinterpret_cast<const LogHeader *>(base_); }
+        const uint8_t *Data() const { return base_; }
+
+        // offset of the last checkpoint according to the index,
+        // or the first record if there is none
+        uint64_t LastCheckpoint() const
+        {
+            struct stat st;
+            IndexEntry entry;
+
+            if (fstat(idx_fd_, &st) < 0 || st.st_size < static_cast<off_t>(sizeof(entry)))
+                return sizeof(LogHeader);
+
+            auto last = (st.st_size / sizeof(entry) - 1) * sizeof(entry);
+            if (pread(idx_fd_, &entry, sizeof(entry), last) != sizeof(entry) ||
+                entry.offset_ >= Header()->used_)
+                return sizeof(LogHeader);
+
+            return entry.offset_;
+        }
+
+        void Append(const std::vector<uint8_t> &rec, const bool checkpoint)
+        {
+            auto *hdr = reinterpret_cast<LogHeader *>(base_);
+            uint64_t off = hdr->used_;
+
+            if (off + rec.size() > size_)
+                Grow(off + rec.size());
+
+            hdr = reinterpret_cast<LogHeader *>(base_);
+            std::memcpy(base_ + off, rec.data(), rec.size());
+
+            RecordHdr rec_hdr;
+            std::memcpy(&rec_hdr, rec.data(), sizeof(rec_hdr));
+
+            // publish the record only once it has been written completely
+            __atomic_thread_fence(__ATOMIC_RELEASE);
+            hdr->used_ = off + rec.size();
+            hdr->records_++;
+            hdr->last_ts_ns_ = rec_hdr.ts_ns_;
+
+            if (checkpoint) {
+                hdr->checkpoints_++;
+                IndexEntry entry {rec_hdr.ts_ns_, off};
+                if (write(idx_fd_, &entry, sizeof(entry)) != sizeof(entry))
+                    fmt::print("Failed to update history index: {}\n", std::strerror(errno));
+            }
+        }
+
+    private:
+        void Map()
+        {
+            void *addr = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+            if (addr == MAP_FAILED) {
+                fmt::print("Failed to map history log: {}\n", std::strerror(errno));
+                throw std::runtime_error("Failed to record device history");
+            }
+            base_ = static_cast<uint8_t *>(addr);
+        }
+
+        void Grow(const uint64_t min_size)
+        {
+            uint64_t new_size = size_;
+            while (new_size < min_size)
+                new_size *= 2;
+
+            if (ftruncate(fd_, new_size) < 0) {
+                fmt::print("Failed to grow history log: {}\n", std::strerror(errno));
+                throw std::runtime_error("Failed to record device history");
+            }
+
+            void *addr = mremap(base_, size_, new_size, MREMAP_MAYMOVE);
+            if (addr == MAP_FAILED) {
+                fmt::print("Failed to remap history log: {}\n", std::strerror(errno));
+                throw std::runtime_error("Failed to record device history");
+            }
+
+            base_ = static_cast<uint8_t *>(addr);
+            size_ = new_size;
+        }
+
+        void Close()
+        {
+            if (base_) {
+                msync(base_, size_, MS_SYNC);
+                munmap(base_, size_);
+                base_ = nullptr;
+            }
+            if (idx_fd_ >= 0)
+                close(idx_fd_);
+            if (fd_ >= 0)
+                close(fd_);
+            idx_fd_ = fd_ = -1;
+        }
+
+        int      fd_ {-1};
+        int      idx_fd_ {-1};
+        uint8_t *base_ {nullptr};
+        uint64_t size_ {0};
+};
+
+// Read-only view of a log and its index
+class LogReader
+{
+    public:
+        explicit LogReader(const std::string &path)
+        {
+            log_ = MapFile(path, log_size_, true);
+
+            if (log_size_ < sizeof(LogHeader) ||
+                std::memcmp(Header()->magic_, log_magic, sizeof(log_magic)) ||
+                Header()->version_ != log_version ||
+                Header()->used_ > log_size_) {
+                fmt::print("{} is not a device history log\n", path);
+                Unmap();
+                throw std::runtime_error("Failed to query device history");
+            }
+
+            // index is optional: w/o it queries replay the log from the start
+            idx_ = MapFile(path + ".idx", idx_size_, false);
+        }
+
+        ~LogReader() { Unmap(); }
+
+        LogReader(const LogReader &) = delete;
+        LogReader &operator=(const LogReader &) = delete;
+
+        const LogHeader *Header() const { return reinterpret_cast<const LogHeader *>(log_); }
+        const uint8_t *Data() const { return log_; }
+        // the log may still be appended to, but only the mapped part is visible
+        uint64_t End() const { return std::min(Header()->used_, log_size_); }
+
+        // offset of the last checkpoint taken at or before @ts_ns,
+        // or the first record if there is none
+        uint64_t CheckpointBefore(const uint64_t ts_ns) const
+        {
+            auto *begin = reinterpret_cast<const IndexEntry *>(idx_);
+            auto *end = begin + idx_size_ / sizeof(IndexEntry);
+
+            auto it = std::upper_bound(begin, end, ts_ns,
+                                       [](uint64_t ts, const IndexEntry &entry) {
+                                           return ts < entry.ts_ns_;
+                                       });
+            if (it == begin)
+                return sizeof(LogHeader);
+
+            auto off = (it - 1)->offset_;
+            return off < End() ? off : sizeof(LogHeader);
+        }
+
+    private:
+        static const uint8_t *MapFile(const std::string &path, uint64_t &size,
+                                      const bool required)
+        {
+            size = 0;
+            int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0) {
+                if (!required)
+                    return nullptr;
+                fmt::print("Failed to open {}: {}\n", path, std::strerror(errno));
+                throw std::runtime_error("Failed to query device history");
+            }
+
+            struct stat st;
+            fstat(fd, &st);
+            if (st.st_size == 0) {
+                close(fd);
+                return nullptr;
+            }
+
+            void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            close(fd);
+            if (addr == MAP_FAILED) {
+                fmt::print("Failed to map {}: {}\n", path, std::strerror(errno));
+                throw std::runtime_error("Failed to query device history");
+            }
+
+            size = st.st_size;
+            return static_cast<const uint8_t *>(addr);
+        }
+
+        void Unmap()
+        {
+            if (log_)
+                munmap(const_cast<uint8_t *>(log_), log_size_);
+            if (idx_)
+                munmap(const_cast<uint8_t *>(idx_), idx_size_);
+            log_ = idx_ = nullptr;
+        }
+
+        const uint8_t *log_ {nullptr};
+        uint64_t       log_size_ {0};
+        const uint8_t *idx_ {nullptr};
+        uint64_t       idx_size_ {0};
+};
+
+static const RecordHdr *
+RecordAt(const uint8_t *data, const uint64_t off, const uint64_t end)
+{
+    if (off + sizeof(RecordHdr) > end)
+        return nullptr;
+
+    auto *hdr = reinterpret_cast<const RecordHdr *>(data + off);
+    if (hdr->len_ < sizeof(RecordHdr) || off + hdr->len_ > end)
+        throw std::runtime_error("Corrupted history log record");
+
+    return hdr;
+}
+
+// Apply a record to @states
+static void
+ApplyRecord(const RecordHdr *hdr, dev_states_ct &states)
+{
+    auto *payload = reinterpret_cast<const uint8_t *>(hdr) + sizeof(RecordHdr);
+    RecordCursor cur {payload, reinterpret_cast<const uint8_t *>(hdr) + hdr->len_};
+
+    switch (hdr->kind_) {
+    case RecordKind::checkpoint: {
+        states.clear();
+        for (uint32_t i = 0; i < hdr->dev_id_; i++) {
+            auto dev_id = cur.Get<uint32_t>();
+            auto &state = states[dev_id];
+            state.dev_type_ = cur.Get<uint16_t>();
+            auto aux_len = cur.Get<uint16_t>();
+            state.status_ = cur.Get<uint32_t>();
+            state.features_ = cur.Get<uint64_t>();
+            state.aux_info_.clear();
+            for (uint16_t c = 0; c < aux_len; c++)
+                state.aux_info_.push_back(cur.Get<char>());
+        }
+        break;
+    }
+    case RecordKind::dev_removed:
+        states.erase(hdr->dev_id_);
+        break;
+    case RecordKind::dev_added:
+    case RecordKind::dev_changed: {
+        auto &state = states[hdr->dev_id_];
+        state.dev_type_ = hdr->dev_type_;
+        if (hdr->fields_ & rec_field_features)
+            state.features_ = cur.Get<uint64_t>();
+        if (hdr->fields_ & rec_field_status)
+            state.status_ = cur.Get<uint32_t>();
+        if (hdr->fields_ & rec_field_aux)
+            state.aux_info_ = cur.GetString();
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+static std::vector<uint8_t>
+CreateCheckpoint(const dev_states_ct &states, const uint64_t ts_ns)
+{
+    RecordBuilder rec {RecordKind::checkpoint, 0, 0,
+                       static_cast<uint32_t>(states.size()), ts_ns};
+
+    for (const auto &[dev_id, state] : states) {
+        rec.Put(dev_id);
+        rec.Put(state.dev_type_);
+        rec.Put(static_cast<uint16_t>(state.aux_info_.size()));
+        rec.Put(state.status_);
+        rec.Put(state.features_);
+        for (char c : state.aux_info_)
+            rec.Put(c);
+    }
+
+    return rec.Finish();
+}
+
+static std::vector<uint8_t>
+CreateDelta(const RecordKind kind, const uint32_t dev_id, const DevState &state,
+            const uint8_t fields, const uint64_t ts_ns)
+{
+    RecordBuilder rec {kind, fields, state.dev_type_, dev_id, ts_ns};
+
+    if (fields & rec_field_features)
+        rec.Put(state.features_);
+    if (fields & rec_field_status)
+        rec.Put(state.status_);
+    if (fields & rec_field_aux)
+        rec.PutString(state.aux_info_);
+
+    return rec.Finish();
+}
+
+// Append delta records for the difference between @prev and @cur.
+// Returns number of appended records.
+static uint32_t
+AppendDeltas(LogWriter &log, const dev_states_ct &prev, const dev_states_ct &cur,
+             const uint64_t ts_ns)
+{
+    uint32_t appended = 0;
+
+    for (const auto &[dev_id, state] : prev) {
+        if (cur.contains(dev_id))
+            continue;
+
+        RecordBuilder rec {RecordKind::dev_removed, 0, state.dev_type_, dev_id, ts_ns};
+        log.Append(rec.Finish(), false);
+        appended++;
+    }
+
+    for (const auto &[dev_id, state] : cur) {
+        auto it = prev.find(dev_id);
+        if (it == prev.end()) {
+            log.Append(CreateDelta(RecordKind::dev_added, dev_id, state,
+                                   rec_field_all, ts_ns), false);
+            appended++;
+            continue;
+        }
+
+        const auto &old = it->second;
+        uint8_t fields = 0;
+        if (old.status_ != state.status_)
+            fields |= rec_field_status;
+        if (old.features_ != state.features_ || old.dev_type_ != state.dev_type_)
+            fields |= rec_field_features;
+        if (old.aux_info_ != state.aux_info_)
+            fields |= rec_field_aux;
+
+        if (fields) {
+            log.Append(CreateDelta(RecordKind::dev_changed, dev_id, state,
+                                   fields, ts_ns), false);
+            appended++;
+        }
+    }
+
+    return appended;
+}
+
+// Reconstruct the last recorded state of an existing log
+static dev_states_ct
+LastRecordedState(const LogWriter &log)
+{
+    dev_states_ct states;
+    const auto *hdr = log.Header();
+
+    uint64_t off = log.LastCheckpoint();
+    while (auto *rec = RecordAt(log.Data(), off, hdr->used_)) {
+        ApplyRecord(rec, states);
+        off += rec->len_;
+    }
+
+    return states;
+}
+
+void RecordDevHistory()
+{
+    LogWriter log {cmdl_opts.hist_log_path_};
+
+    util::CatchStopSignals();
+
+    // changes which happened while nobody was recording are logged
+    // as deltas against the last recorded state
+    auto prev = LastRecordedState(log);
+    bool session_start = true;
+    uint32_t since_checkpoint = 0;
+
+    fmt::print("Recording VirtIO device history to {} (interval {} ms)\n",
+               cmdl_opts.hist_log_path_, cmdl_opts.hist_interval_ms_);
+
+    const struct timespec delay {
+        static_cast<time_t>(cmdl_opts.hist_interval_ms_ / 1000),
+        static_cast<long>(cmdl_opts.hist_interval_ms_ % 1000) * 1000000
+    };
+
+    for (; !util::StopRequested(); nanosleep(&delay, nullptr)) {
+        dev_states_ct cur;
+        try {
+            cur = ScanDevStates();
+        } catch (const std::exception &ex) {
+            // devices may disappear while being scanned; retry on the next tick
+            fmt::print("Scan failed: {}\n", ex.what());
+            continue;
+        }
+
+        auto ts_ns = NowNs();
+
+        since_checkpoint += AppendDeltas(log, prev, cur, ts_ns);
+
+        if (session_start || since_checkpoint >= cmdl_opts.hist_checkpoint_every_) {
+            log.Append(CreateCheckpoint(cur, ts_ns), true);
+            since_checkpoint = 0;
+            session_start = false;
+        }
+
+        prev = std::move(cur);
+    }
+
+    fmt::print("{} records, {} checkpoints, {} bytes\n", log.Header()->records_,
+               log.Header()->checkpoints_, log.Header()->used_);
+}
+
+static std::string
+DevName(const uint32_t dev_id)
+{
+    return fmt::format("virtio{}", dev_id);
+}
+
+static bool
+DevSelected(const uint32_t dev_id)
+{
+    return cmdl_opts.first_dev_name_.empty() ||
+           cmdl_opts.first_dev_name_ == DevName(dev_id);
+}
+
+static std::string
+StatusBitName(const uint32_t bit)
+{
+    auto field = magic_enum::enum_cast<virtio::VirtIOStatusBits>(bit);
+    if (field.has_value())
+        return std::string {magic_enum::enum_name(field.value())};
+    return fmt::format("BIT_{}", bit);
+}
+
+// "+NAME -NAME ..." list of the bits which changed between @old and @cur
+template <typename F>
+static std::string
+BitChanges(const uint64_t old, const uint64_t cur, F name_fun)
+{
+    std::string out;
+
+    for (uint64_t bits = cur & ~old; bits; bits &= bits - 1)
+        out += fmt::format(" +{}", name_fun(std::countr_zero(bits)));
+    for (uint64_t bits = old & ~cur; bits; bits &= bits - 1)
+        out += fmt::format(" -{}", name_fun(std::countr_zero(bits)));
+
+    return out;
+}
+
+// ",\"<field>_added\":[...],\"<field>_removed\":[...]" for the bits which
+// changed between @old and @cur
+template <typename F>
+static std::string
+JsonBitChanges(std::string_view field, const uint64_t old, const uint64_t cur, F name_fun)
+{
+    auto list = [&](uint64_t bits) {
+        std::string out;
+        for (; bits; bits &= bits - 1)
+            out += fmt::format("{}\"{}\"", out.empty() ? "" : ",",
+                               util::JsonEscape(name_fun(std::countr_zero(bits))));
+        return out;
+    };
+
+    return fmt::format(",\"{0}_added\":[{1}],\"{0}_removed\":[{2}]", field,
+                       list(cur & ~old), list(old & ~cur));
+}
+
+static void
+PrintState(const uint32_t dev_id, const DevState &state)
+{
+    auto type = virtio::VirtIODevType {state.dev_type_};
+
+    if (cmdl_opts.json_output_) {
+        fmt::print("{{\"name\":\"{}\",\"type\":{},\"status\":\"{:#x}\","
+                   "\"features\":\"{:#x}\",\"aux\":\"{}\"}}\n",
+                   DevName(dev_id), state.dev_type_, state.status_,
+                   state.features_, util::JsonEscape(state.aux_info_));
+        return;
+    }
+
+    fmt::print("{:<10} [{:>2}] {:<20} status {:#04x} features {:#018x} {}\n",
+               DevName(dev_id), state.dev_type_, virtio::VirtIODevTypeName(type),
+               state.status_, state.features_,
+               state.aux_info_.empty() ? "" : fmt::format("({})", state.aux_info_));
+}
+
+// @old is the state of the device before @hdr has been applied
+static void
+PrintTransition(const RecordHdr *hdr, const DevState &old,
+                const dev_states_ct &after)
+{
+    auto dev_id = hdr->dev_id_;
+    auto ts = FormatTime(hdr->ts_ns_);
+
+    switch (hdr->kind_) {
+    case RecordKind::dev_added: {
+        const auto &state = after.at(dev_id);
+        if (cmdl_opts.json_output_) {
+            fmt::print("{{\"ts\":\"{}\",\"name\":\"{}\",\"event\":\"added\",\"type\":{},"
+                       "\"status\":\"{:#x}\",\"features\":\"{:#x}\",\"aux\":\"{}\"}}\n",
+                       ts, DevName(dev_id), state.dev_type_, state.status_,
+                       state.features_, util::JsonEscape(state.aux_info_));
+        } else {
+            fmt::print("{} ", ts);
+            PrintState(dev_id, state);
+        }
+        break;
+    }
+    case RecordKind::dev_removed:
+        if (cmdl_opts.json_output_)
+            fmt::print("{{\"ts\":\"{}\",\"name\":\"{}\",\"event\":\"removed\"}}\n",
+                       ts, DevName(dev_id));
+        else
+            fmt::print("{} {:<10} removed\n", ts, DevName(dev_id));
+        break;
+    case RecordKind::dev_changed: {
+        const auto &cur = after.at(dev_id);
+        const auto &feat_names = virtio::FeatureNames(static_cast<uint32_t>(cur.dev_type_));
+
+        auto feat_name = [&](uint32_t bit) { return feat_names[bit]; };
+
+        if (cmdl_opts.json_output_) {
+            std::string fields;
+            if (hdr->fields_ & rec_field_status)
+                fields += fmt::format(",\"old_status\":\"{:#x}\",\"status\":\"{:#x}\"{}",
+                                      old.status_, cur.status_,
+                                      JsonBitChanges("status", old.status_, cur.status_, StatusBitName));
+            if (hdr->fields_ & rec_field_features)
+                fields += fmt::format(",\"old_features\":\"{:#x}\",\"features\":\"{:#x}\"{}",
+                                      old.features_, cur.features_,
+                                      JsonBitChanges("features", old.features_, cur.features_, feat_name));
+            if (hdr->fields_ & rec_field_aux)
+                fields += fmt::format(",\"old_aux\":\"{}\",\"aux\":\"{}\"",
+                                      util::JsonEscape(old.aux_info_), util::JsonEscape(cur.aux_info_));
+
+            fmt::print("{{\"ts\":\"{}\",\"name\":\"{}\",\"event\":\"changed\"{}}}\n",
+                       ts, DevName(dev_id), fields);
+            break;
+        }
+
+        std::string changes;
+        if (hdr->fields_ & rec_field_status)
+            changes += fmt::format(" status {:#x} -> {:#x}{}", old.status_, cur.status_,
+                                   BitChanges(old.status_, cur.status_, StatusBitName));
+        if (hdr->fields_ & rec_field_features)
+            changes += fmt::format(" features {:#x} -> {:#x}{}", old.features_, cur.features_,
+                                   BitChanges(old.features_, cur.features_, feat_name));
+        if (hdr->fields_ & rec_field_aux)
+            changes += fmt::format(" aux \"{}\" -> \"{}\"", old.aux_info_, cur.aux_info_);
+
+        fmt::print("{} {:<10}{}\n", ts, DevName(dev_id), changes);
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+static void
+QueryStateAt(const LogReader &log, const uint64_t ts_ns)
+{
+    dev_states_ct states;
+
+    for (uint64_t off = log.CheckpointBefore(ts_ns);;) {
+        auto *rec = RecordAt(log.Data(), off, log.End());
+        if (!rec || rec->ts_ns_ > ts_ns)
+            break;
+        ApplyRecord(rec, states);
+        off += rec->len_;
+    }
+
+    if (!cmdl_opts.json_output_)
+        fmt::print("State at {}:\n", FormatTime(ts_ns));
+
+    for (const auto &[dev_id, state] : states)
+        if (DevSelected(dev_id))
+            PrintState(dev_id, state);
+}
+
+static void
+QueryTransitions(const LogReader &log, const uint64_t from_ns, const uint64_t to_ns)
+{
+    dev_states_ct states;
+
+    for (uint64_t off = log.CheckpointBefore(from_ns);;) {
+        auto *rec = RecordAt(log.Data(), off, log.End());
+        if (!rec || rec->ts_ns_ > to_ns)
+            break;
+        off += rec->len_;
+
+        if (rec->ts_ns_ < from_ns || rec->kind_ == RecordKind::checkpoint ||
+            !DevSelected(rec->dev_id_)) {
+            ApplyRecord(rec, states);
+            continue;
+        }
+
+        auto it = states.find(rec->dev_id_);
+        DevState old = it != states.end() ? it->second : DevState {};
+        ApplyRecord(rec, states);
+        PrintTransition(rec, old, states);
+    }
+}
+
+void QueryDevHistory()
+{
+    LogReader log {cmdl_opts.hist_log_path_};
+
+    if (!cmdl_opts.hist_at_.empty()) {
+        QueryStateAt(log, ParseTime(cmdl_opts.hist_at_));
+        return;
+    }
+
+    uint64_t from_ns = cmdl_opts.hist_from_.empty() ? 0 : ParseTime(cmdl_opts.hist_from_);
+    uint64_t to_ns = cmdl_opts.hist_to_.empty() ? UINT64_MAX : ParseTime(cmdl_opts.hist_to_);
+    if (from_ns > to_ns) {
+        fmt::print("Empty time range\n");
+        return;
+    }
+
+    QueryTransitions(log, from_ns, to_ns);
+}
+
+} // namespace history
@@ -0,0 +1,26 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2025 Petr Vyazovik <xen@f-m.fm>
+
+#pragma once
+
+#include "config.h"
+
+// Device history log.
+//
+// The log is an append-only, memory-mapped file of delta records: a record
+// is written only when a device appears, disappears or changes its status,
+// features or aux info. A full-state checkpoint is written at the start of
+// every recording session and after every N delta records. Checkpoint
+// offsets are kept in a sidecar "<log>.idx" file of fixed-size entries,
+// so queries binary search for the closest checkpoint and replay only the
+// records after it.
+namespace history {
+
+// Poll the bus periodically and append changes to the log until interrupted
+void RecordDevHistory();
+
+// Show the state of devices at a given time, or all transitions
+// within a time range
+void QueryDevHistory();
+
+} // namespace history
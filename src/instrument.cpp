@@ -0,0 +1,331 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2025 Petr Vyazovik <xen@f-m.fm>
+
+#include "instrument.h"
+
+#ifdef VI_INSTRUMENT
+
+#include "config.h"
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "magic_enum/magic_enum.hpp"
+
+extern cfg::CmdLOpts cmdl_opts;
+
+namespace instr {
+
+// device scan latency histogram: bucket N holds [2^(N-1), 2^N) us
+constexpr size_t dev_hist_buckets {24};
+constexpr size_t trace_name_max_len {32};
+
+struct TraceEvent
+{
+    uint64_t start_ns_;
+    uint64_t dur_ns_;
+    Phase    phase_;
+    // device name for per-device events, empty for phases
+    std::array<char, trace_name_max_len> name_;
+};
+
+// Each thread appends to its own buffer, all of them are read once
+// the threads are done
+struct ThreadBuf
+{
+    uint32_t                tid_ {0};
+    bool                    main_ {false};
+    std::vector<TraceEvent> events_;
+};
+
+struct PhaseStats
+{
+    std::atomic<uint64_t> ns_ {0};
+    std::atomic<uint64_t> count_ {0};
+    std::atomic<uint64_t> max_ns_ {0};
+};
+
+// Counters the kernel keeps for the process
+struct ProcCounters
+{
+    uint64_t read_calls_ {0};
+    uint64_t write_calls_ {0};
+    uint64_t min_faults_ {0};
+    uint64_t ctx_switches_ {0};
+};
+
+static std::array<PhaseStats, magic_enum::enum_count<Phase>()> phase_stats;
+static std::array<std::atomic<uint64_t>, magic_enum::enum_count<Call>()> call_counts;
+static std::array<std::atomic<uint64_t>, dev_hist_buckets> dev_hist;
+static std::atomic<uint64_t> dev_count {0};
+static std::atomic<uint64_t> dev_total_ns {0};
+static std::atomic<uint64_t> dev_max_ns {0};
+static std::atomic<uint64_t> alloc_count {0};
+static std::atomic<uint64_t> alloc_bytes {0};
+static std::atomic<uint64_t> free_count {0};
+
+static std::mutex slowest_dev_mtx;
+static std::string slowest_dev;
+
+static std::mutex thread_bufs_mtx;
+static std::vector<std::unique_ptr<ThreadBuf>> thread_bufs;
+static thread_local ThreadBuf *thread_buf {nullptr};
+// set while instrumentation itself allocates
+static thread_local bool in_instr {false};
+
+static uint64_t start_ns {0};
+static std::thread::id main_thread;
+static ProcCounters start_counters;
+static std::FILE *trace_file {nullptr};
+
+void CountAlloc(const std::size_t size)
+{
+    if (enabled && !in_instr) {
+        alloc_count.fetch_add(1, std::memory_order_relaxed);
+        alloc_bytes.fetch_add(size, std::memory_order_relaxed);
+    }
+}
+
+void CountFree()
+{
+    if (enabled && !in_instr)
+        free_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+static void
+AtomicMax(std::atomic<uint64_t> &max, const uint64_t val)
+{
+    auto cur = max.load(std::memory_order_relaxed);
+    while (val > cur && !max.compare_exchange_weak(cur, val, std::memory_order_relaxed))
+        ;
+}
+
+static void
+AddTraceEvent(const Phase phase, std::string_view name, const uint64_t start, const uint64_t end)
+{
+    if (trace_file == nullptr)
+        return;
+
+    in_instr = true;
+    if (thread_buf == nullptr) {
+        std::lock_guard lock {thread_bufs_mtx};
+        thread_bufs.push_back(std::make_unique<ThreadBuf>());
+        thread_bufs.back()->tid_ = thread_bufs.size();
+        thread_bufs.back()->main_ = std::this_thread::get_id() == main_thread;
+        thread_buf = thread_bufs.back().get();
+    }
+
+    TraceEvent ev {start, end - start, phase, {}};
+    name.copy(ev.name_.data(), ev.name_.size() - 1);
+    thread_buf->events_.push_back(ev);
+    in_instr = false;
+}
+
+void RecordPhase(const Phase phase, const uint64_t start, const uint64_t end)
+{
+    auto &stats = phase_stats[static_cast<size_t>(phase)];
+    stats.ns_.fetch_add(end - start, std::memory_order_relaxed);
+    stats.count_.fetch_add(1, std::memory_order_relaxed);
+    AtomicMax(stats.max_ns_, end - start);
+
+    AddTraceEvent(phase, {}, start, end);
+}
+
+void RecordDev(std::string_view name, const uint64_t start, const uint64_t end)
+{
+    auto dur_ns = end - start;
+    auto bucket = std::min<size_t>(std::bit_width(dur_ns / 1000), dev_hist_buckets - 1);
+    dev_hist[bucket].fetch_add(1, std::memory_order_relaxed);
+    dev_count.fetch_add(1, std::memory_order_relaxed);
+    dev_total_ns.fetch_add(dur_ns, std::memory_order_relaxed);
+
+    if (dur_ns > dev_max_ns.load(std::memory_order_relaxed)) {
+        in_instr = true;
+        std::lock_guard lock {slowest_dev_mtx};
+        if (dur_ns > dev_max_ns.load(std::memory_order_relaxed)) {
+            dev_max_ns.store(dur_ns, std::memory_order_relaxed);
+            slowest_dev = name;
+        }
+        in_instr = false;
+    }
+
+    AddTraceEvent(Phase::dir_iter, name, start, end);
+}
+
+void CountCall(const Call call)
+{
+    call_counts[static_cast<size_t>(call)].fetch_add(1, std::memory_order_relaxed);
+}
+
+static ProcCounters
+ReadProcCounters()
+{
+    ProcCounters counters;
+
+    // syscr/syscw: number of read-like/write-like syscalls
+    std::ifstream io {"/proc/self/io"};
+    std::string key;
+    uint64_t val;
+    while (io >> key >> val) {
+        if (key == "syscr:")
+            counters.read_calls_ = val;
+        else if (key == "syscw:")
+            counters.write_calls_ = val;
+    }
+
+    struct rusage usage {};
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        counters.min_faults_ = usage.ru_minflt;
+        counters.ctx_switches_ = usage.ru_nvcsw + usage.ru_nivcsw;
+    }
+
+    return counters;
+}
+
+void Start()
+{
+    if (!cmdl_opts.stats_ && cmdl_opts.trace_path_.empty())
+        return;
+
+    if (!cmdl_opts.trace_path_.empty()) {
+        trace_file = std::fopen(cmdl_opts.trace_path_.c_str(), "w");
+        if (trace_file == nullptr) {
+            fmt::print("Failed to open {} for writing\n", cmdl_opts.trace_path_);
+            throw std::runtime_error("Failed to write trace");
+        }
+    }
+
+    start_counters = ReadProcCounters();
+    main_thread = std::this_thread::get_id();
+    start_ns = util::NowNs();
+    enabled = true;
+}
+
+static std::string
+Ms(const uint64_t ns)
+{
+    return fmt::format("{:.3f}", static_cast<double>(ns) / 1e6);
+}
+
+static void
+PrintStats(const uint64_t wall_ns, const ProcCounters &counters)
+{
+    // keep the mode's own output above the stats
+    std::fflush(stdout);
+    fmt::print(stderr, "\n{} ms wall\n\n", Ms(wall_ns));
+    fmt::print(stderr, "{:<14}{:>10}{:>12}{:>12}{:>8}\n",
+               "phase", "count", "total ms", "max ms", "% wall");
+    for (auto phase : magic_enum::enum_values<Phase>()) {
+        const auto &stats = phase_stats[static_cast<size_t>(phase)];
+        auto ns = stats.ns_.load();
+        fmt::print(stderr, "{:<14}{:>10}{:>12}{:>12}{:>8.1f}\n",
+                   magic_enum::enum_name(phase), stats.count_.load(), Ms(ns),
+                   Ms(stats.max_ns_.load()), wall_ns ? 100.0 * ns / wall_ns : 0.0);
+    }
+
+    std::string calls;
+    for (auto call : magic_enum::enum_values<Call>())
+        calls += fmt::format("{}{} {}", calls.empty() ? "" : ", ",
+                             magic_enum::enum_name(call), call_counts[static_cast<size_t>(call)].load());
+    fmt::print(stderr, "\nsysfs calls: {}\n", calls);
+    fmt::print(stderr, "kernel: {} read syscalls, {} write syscalls, {} minor faults, "
+               "{} context switches\n",
+               counters.read_calls_ - start_counters.read_calls_,
+               counters.write_calls_ - start_counters.write_calls_,
+               counters.min_faults_ - start_counters.min_faults_,
+               counters.ctx_switches_ - start_counters.ctx_switches_);
+    // zero unless the executable was built with VI_COUNT_ALLOCS
+    if (alloc_count.load())
+        fmt::print(stderr, "allocations: {} ({} bytes), {} frees\n",
+                   alloc_count.load(), alloc_bytes.load(), free_count.load());
+
+    auto devs = dev_count.load();
+    if (devs == 0)
+        return;
+
+    fmt::print(stderr, "\ndevices: {} scanned, mean {:.1f} us, max {:.1f} us ({})\n",
+               devs, dev_total_ns.load() / 1e3 / devs, dev_max_ns.load() / 1e3, slowest_dev);
+
+    uint64_t peak = 0;
+    for (const auto &bucket : dev_hist)
+        peak = std::max(peak, bucket.load());
+
+    constexpr uint64_t bar_max_len {40};
+    for (size_t i = 0; i < dev_hist_buckets; i++) {
+        auto num = dev_hist[i].load();
+        if (num == 0)
+            continue;
+        uint64_t lo = i ? 1ULL << (i - 1) : 0;
+        fmt::print(stderr, "  [{:>7}, {:>7}) us {:>8} {}\n", lo, 1ULL << i, num,
+                   std::string(std::max<uint64_t>(num * bar_max_len / peak, 1), '#'));
+    }
+}
+
+// Chrome trace event format, loads into chrome://tracing and Perfetto
+static void
+WriteTrace()
+{
+    auto pid = getpid();
+    fmt::print(trace_file, "{{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fmt::print(trace_file, "{{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":{},\"tid\":0,"
+               "\"args\":{{\"name\":\"virtio-info\"}}}}", pid);
+
+    for (const auto &buf : thread_bufs) {
+        fmt::print(trace_file, ",\n{{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":{},\"tid\":{},"
+                   "\"args\":{{\"name\":\"{}\"}}}}",
+                   pid, buf->tid_, buf->main_ ? "main" : fmt::format("scanner {}", buf->tid_));
+
+        for (const auto &ev : buf->events_) {
+            bool dev = ev.name_[0] != '\0';
+            fmt::print(trace_file, ",\n{{\"name\":\"{}\",\"cat\":\"{}\",\"ph\":\"X\","
+                       "\"ts\":{:.3f},\"dur\":{:.3f},\"pid\":{},\"tid\":{}}}",
+                       dev ? std::string_view {ev.name_.data()} : magic_enum::enum_name(ev.phase_),
+                       dev ? "device" : "phase",
+                       (ev.start_ns_ - start_ns) / 1e3, ev.dur_ns_ / 1e3, pid, buf->tid_);
+        }
+    }
+
+    fmt::print(trace_file, "\n]}}\n");
+}
+
+void Finish()
+{
+    if (!enabled)
+        return;
+
+    auto wall_ns = util::NowNs() - start_ns;
+    auto counters = ReadProcCounters();
+    enabled = false;
+
+    if (cmdl_opts.stats_)
+        PrintStats(wall_ns, counters);
+
+    if (trace_file != nullptr) {
+        WriteTrace();
+        bool failed = std::fclose(trace_file) != 0;
+        trace_file = nullptr;
+        if (failed) {
+            fmt::print("Failed to write {}\n", cmdl_opts.trace_path_);
+            throw std::runtime_error("Failed to write trace");
+        }
+    }
+}
+
+} // namespace instr
+
+#endif // VI_INSTRUMENT
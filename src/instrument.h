@@ -0,0 +1,125 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2025 Petr Vyazovik <xen@f-m.fm>
+
+#pragma once
+
+#include "util.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// Self-instrumentation for --stats and --trace: per-phase wall time,
+// sysfs call and allocation counts, per-device scan latency. The probe
+// points below are macros which expand to nothing unless the build has
+// VI_INSTRUMENT defined; with it, a probe that is not enabled at run time
+// costs a single branch.
+namespace instr {
+
+enum class Phase
+{
+    dir_iter,
+    attr_open,
+    attr_read,
+    parse,
+    aux_info,
+    table_build,
+    render
+};
+
+enum class Call
+{
+    open,
+    read,
+    close,
+    readdir,
+    stat,
+    readlink,
+    canonical
+};
+
+#ifdef VI_INSTRUMENT
+
+// set before the selected mode starts, never changes afterwards
+inline bool enabled {false};
+
+void RecordPhase(Phase phase, uint64_t start_ns, uint64_t end_ns);
+void RecordDev(std::string_view name, uint64_t start_ns, uint64_t end_ns);
+void CountCall(Call call);
+// Allocation hooks, called from the operator new/delete replacement of
+// the virtio-info executable (VI_COUNT_ALLOCS); the library itself does
+// not replace them so that other binaries can link it
+void CountAlloc(std::size_t size);
+void CountFree();
+
+class PhaseScope
+{
+    public:
+        explicit PhaseScope(const Phase phase)
+            : phase_(phase), start_ns_(enabled ? util::NowNs() : 0)
+        {}
+
+        ~PhaseScope()
+        {
+            if (start_ns_)
+                RecordPhase(phase_, start_ns_, util::NowNs());
+        }
+
+        PhaseScope(const PhaseScope &) = delete;
+        PhaseScope &operator=(const PhaseScope &) = delete;
+
+    private:
+        Phase    phase_;
+        uint64_t start_ns_;
+};
+
+// @name has to outlive the scope
+class DevScope
+{
+    public:
+        explicit DevScope(std::string_view name)
+            : name_(name), start_ns_(enabled ? util::NowNs() : 0)
+        {}
+
+        ~DevScope()
+        {
+            if (start_ns_)
+                RecordDev(name_, start_ns_, util::NowNs());
+        }
+
+        DevScope(const DevScope &) = delete;
+        DevScope &operator=(const DevScope &) = delete;
+
+    private:
+        std::string_view name_;
+        uint64_t         start_ns_;
+};
+
+#define VI_INSTR_CONCAT_(a, b) a##b
+#define VI_INSTR_CONCAT(a, b) VI_INSTR_CONCAT_(a, b)
+// time the rest of the enclosing block as @phase
+#define VI_PHASE_SCOPE(phase) \
+    instr::PhaseScope VI_INSTR_CONCAT(vi_phase_scope_, __LINE__) {instr::Phase::phase}
+// time the rest of the enclosing block as scan of device @name
+#define VI_DEV_SCOPE(name) \
+    instr::DevScope VI_INSTR_CONCAT(vi_dev_scope_, __LINE__) {name}
+#define VI_COUNT_CALL(call) \
+    do { if (instr::enabled) instr::CountCall(instr::Call::call); } while (0)
+
+// Start collecting if --stats or --trace was given
+void Start();
+// Print --stats summary to stderr and write --trace file
+void Finish();
+
+#else
+
+#define VI_PHASE_SCOPE(phase) static_cast<void>(0)
+#define VI_DEV_SCOPE(name) static_cast<void>(0)
+#define VI_COUNT_CALL(call) static_cast<void>(0)
+
+inline void Start() {}
+inline void Finish() {}
+
+#endif
+
+} // namespace instr
@@ -5,14 +5,67 @@
 #include <fmt/core.h>
 
 #include "config.h"
+#include "dev_config.h"
+#include "feat_stream.h"
+#include "history.h"
+#include "instrument.h"
+#include "policy.h"
+#include "probe.h"
+#include "scsi.h"
+#include "snapshot.h"
+#include "throughput.h"
 #include "ui.h"
+#include "vhost.h"
+#include "virtio_mem.h"
+#include "virtiofs.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
 
 cfg::CmdLOpts cmdl_opts;
 
+#ifdef VI_COUNT_ALLOCS
+
+// Allocation counting for --stats. Array and nothrow forms end up here as well.
+void *
+operator new(std::size_t size)
+{
+    instr::CountAlloc(size);
+
+    for (size = std::max<std::size_t>(size, 1);;) {
+        if (void *ptr = std::malloc(size))
+            return ptr;
+        auto handler = std::get_new_handler();
+        if (handler == nullptr)
+            throw std::bad_alloc {};
+        handler();
+    }
+}
+
+void
+operator delete(void *ptr) noexcept
+{
+    if (ptr != nullptr)
+        instr::CountFree();
+    std::free(ptr);
+}
+
+void
+operator delete(void *ptr, [[maybe_unused]] std::size_t size) noexcept
+{
+    operator delete(ptr);
+}
+
+#endif // VI_COUNT_ALLOCS
+
 int main(int argc, char *argv[])
 {
+    int ret = EXIT_SUCCESS;
+
     try {
         cfg::ParseCmdLineOptions(cmdl_opts, argc, argv);
+        instr::Start();
 
         switch (cmdl_opts.mode_) {
         case cfg::OperationMode::ListAvailDevs:
@@ -30,13 +83,75 @@ int main(int argc, char *argv[])
         case cfg::OperationMode::RawFeaturesDecoding:
             ui::VirtIODevRawFeaturesInfo();
             break;
+        case cfg::OperationMode::RawFeaturesStream:
+            stream::DecodeRawFeaturesStream();
+            break;
+        case cfg::OperationMode::RecordHistory:
+            history::RecordDevHistory();
+            break;
+        case cfg::OperationMode::QueryHistory:
+            history::QueryDevHistory();
+            break;
+        case cfg::OperationMode::PolicyCheck:
+            if (!policy::CheckDevPolicy())
+                ret = EXIT_FAILURE;
+            break;
+        case cfg::OperationMode::ListVdpaDevs:
+            ui::ListVdpaDevices();
+            break;
+        case cfg::OperationMode::ShowVdpaDevInfo:
+            ui::VdpaDevDetailedInfo();
+            break;
+        case cfg::OperationMode::ListDevTransports:
+            ui::ListVirtIODevTransports();
+            break;
+        case cfg::OperationMode::InteractiveTop:
+            ui::VirtIODevTop();
+            break;
+        case cfg::OperationMode::WriteSnapshot:
+            snapshot::WriteDevSnapshot();
+            break;
+        case cfg::OperationMode::CompareSnapshots:
+            if (!snapshot::CompareDevSnapshots())
+                ret = EXIT_FAILURE;
+            break;
+        case cfg::OperationMode::ProbeLatency:
+            probe::ProfileProbeLatency();
+            break;
+        case cfg::OperationMode::DevThroughput:
+            throughput::SampleDevThroughput();
+            break;
+        case cfg::OperationMode::BalloonReport:
+            throughput::SampleBalloon();
+            break;
+        case cfg::OperationMode::DevConfig:
+            devcfg::ShowDevConfig();
+            break;
+        case cfg::OperationMode::VirtioFsReport:
+            virtiofs::ShowVirtioFsMounts();
+            break;
+        case cfg::OperationMode::MigrationTargets:
+            if (!snapshot::FindMigrationTargets())
+                ret = EXIT_FAILURE;
+            break;
+        case cfg::OperationMode::VhostWorkers:
+            vhost::ShowVhostWorkers();
+            break;
+        case cfg::OperationMode::ScsiReport:
+            scsi::ShowScsiHosts();
+            break;
+        case cfg::OperationMode::VirtioMemReport:
+            virtiomem::ShowVirtioMemBlocks();
+            break;
         default:
             break;
         }
+
+        instr::Finish();
     } catch (std::exception &ex) {
         fmt::print("{}\n", ex.what());
         return EXIT_FAILURE;
     }
 
-    return EXIT_SUCCESS;
+    return ret;
 }
@@ -0,0 +1,397 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2025 Petr Vyazovik <xen@f-m.fm>
+
+#include "policy.h"
+#include "dev_table.h"
+#include "feat_names.h"
+#include "util.h"
+#include "virtio_bus.h"
+
+#include <fnmatch.h>
+
+#include <fmt/core.h>
+
+#include <array>
+#include <bit>
+#include <fstream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "magic_enum/magic_enum.hpp"
+
+extern cfg::CmdLOpts cmdl_opts;
+
+namespace policy {
+
+constexpr uint32_t dev_types_num {e_to_type(virtio::VirtIODevType::dev_type_max) + 1};
+
+// A policy section compiled into bit masks
+struct CompiledRule
+{
+    std::optional<virtio::VirtIODevType> dev_type_ {};
+    // empty pattern matches any device
+    std::string                          aux_pattern_ {};
+    uint64_t                             feat_required_ {0};
+    uint64_t                             feat_forbidden_ {0};
+    uint32_t                             status_required_ {0};
+    uint32_t                             status_forbidden_ {0};
+    // line of the section header, for reporting
+    uint32_t                             line_ {0};
+};
+
+struct CompiledPolicy
+{
+    std::vector<CompiledRule>                           rules_;
+    // indices of the rules applicable to each device type,
+    // type-agnostic rules are included in every list
+    std::array<std::vector<uint32_t>, dev_types_num>    by_type_;
+    std::vector<uint32_t>                               any_type_;
+};
+
+enum class ViolationKind
+{
+    missing_feature,
+    forbidden_feature,
+    missing_status,
+    forbidden_status
+};
+
+constexpr std::string_view ViolationKindName(const ViolationKind kind)
+{
+    switch (kind) {
+    case ViolationKind::missing_feature:
+	return "missing feature";
+    case ViolationKind::forbidden_feature:
+	return "forbidden feature";
+    case ViolationKind::missing_status:
+	return "missing status";
+    case ViolationKind::forbidden_status:
+	return "forbidden status";
+    default:
+	return "< unknown >";
+    }
+}
+
+[[noreturn]] static void
+PolicyError(const uint32_t line, const std::string &msg)
+{
+    fmt::print("{}:{}: {}\n", cmdl_opts.policy_path_, line, msg);
+    throw std::runtime_error("Failed to compile policy");
+}
+
+static std::string_view
+Trim(std::string_view str)
+{
+    auto begin = str.find_first_not_of(" \t\r");
+    if (begin == std::string_view::npos)
+        return {};
+    auto end = str.find_last_not_of(" \t\r");
+    return str.substr(begin, end - begin + 1);
+}
+
+static std::vector<std::string_view>
+SplitWords(std::string_view str)
+{
+    std::vector<std::string_view> words;
+
+    while (!(str = Trim(str)).empty()) {
+        auto end = str.find_first_of(" \t,");
+        if (end != 0)
+            words.push_back(str.substr(0, end));
+        if (end == std::string_view::npos)
+            break;
+        str.remove_prefix(end + 1);
+    }
+
+    return words;
+}
+
+static virtio::VirtIODevType
+ParseDevType(std::string_view str, const uint32_t line)
+{
+    auto named = magic_enum::enum_cast<virtio::VirtIODevType>(str);
+    if (named.has_value())
+        return named.value();
+
+    uint32_t id;
+    if (!util::ParseNumber(str, id) || !magic_enum::enum_contains<virtio::VirtIODevType>(id))
+        PolicyError(line, fmt::format("unknown device type '{}'", str));
+
+    return virtio::VirtIODevType {id};
+}
+
+// Names usable in a section without type= selector: only transport
+// bits mean the same on every device, a device specific name (e.g.
+// VIRTIO_NET_F_MQ, bit 22) would be checked against unrelated bits of
+// the other types
+constexpr std::optional<uint32_t> TransportFeatureBit(std::string_view str)
+{
+    auto named = magic_enum::enum_cast<virtio::VirtIOCommonFeature>(str);
+    if (named.has_value())
+        return e_to_type(named.value());
+    return std::nullopt;
+}
+
+static_assert(TransportFeatureBit("VIRTIO_F_VERSION_1") == 32,
+              "transport bits are accepted in untyped sections");
+static_assert(!TransportFeatureBit("VIRTIO_NET_F_MQ").has_value(),
+              "device specific bits are rejected in untyped sections");
+
+static uint32_t
+ParseFeatureBit(std::string_view str, const CompiledRule &rule, const uint32_t line)
+{
+    uint32_t pos;
+    if (util::ParseNumber(str, pos)) {
+        if (pos >= virtio::feature_bits_max)
+            PolicyError(line, fmt::format("feature bit {} out of range", pos));
+        return pos;
+    }
+
+    if (rule.dev_type_.has_value()) {
+        auto bit = virtio::FeatureBitByName(virtio::FeatureNames(rule.dev_type_.value()), str);
+        if (bit.has_value())
+            return bit.value();
+        PolicyError(line, fmt::format("unknown feature '{}'", str));
+    }
+
+    auto bit = TransportFeatureBit(str);
+    if (bit.has_value())
+        return bit.value();
+
+    for (uint32_t id = 0; id < dev_types_num; id++)
+        if (virtio::FeatureBitByName(virtio::FeatureNames(id), str).has_value())
+            PolicyError(line, fmt::format("'{}' is device type specific, needs a type= selector", str));
+
+    PolicyError(line, fmt::format("unknown feature '{}'", str));
+}
+
+static uint32_t
+ParseStatusBit(std::string_view str, const uint32_t line)
+{
+    auto named = magic_enum::enum_cast<virtio::VirtIOStatusBits>(str);
+    if (named.has_value())
+        return e_to_type(named.value());
+
+    uint32_t pos;
+    if (!util::ParseNumber(str, pos) || pos >= 32)
+        PolicyError(line, fmt::format("unknown status bit '{}'", str));
+
+    return pos;
+}
+
+// "[type=<type> aux=<pattern>]" or "[*]"
+static CompiledRule
+ParseSection(std::string_view hdr, const uint32_t line)
+{
+    CompiledRule rule;
+    rule.line_ = line;
+
+    for (auto word : SplitWords(hdr)) {
+        if (word == "*")
+            continue;
+
+        auto eq = word.find('=');
+        if (eq == std::string_view::npos)
+            PolicyError(line, fmt::format("bad selector '{}'", word));
+
+        auto key = word.substr(0, eq);
+        auto val = word.substr(eq + 1);
+        if (key == "type")
+            rule.dev_type_ = ParseDevType(val, line);
+        else if (key == "aux")
+            rule.aux_pattern_ = val;
+        else
+            PolicyError(line, fmt::format("unknown selector '{}'", key));
+    }
+
+    return rule;
+}
+
+static CompiledPolicy
+CompilePolicy(const std::string &path)
+{
+    std::ifstream policy_file {path, std::ios::in};
+    if (!policy_file.is_open()) {
+        fmt::print("Failed to open policy {}\n", path);
+        throw std::runtime_error("Failed to compile policy");
+    }
+
+    CompiledPolicy policy;
+    std::string line_buf;
+    uint32_t line = 0;
+
+    while (std::getline(policy_file, line_buf)) {
+        line++;
+
+        auto str = std::string_view {line_buf};
+        str = Trim(str.substr(0, str.find('#')));
+        if (str.empty())
+            continue;
+
+        if (str.front() == '[') {
+            if (str.back() != ']')
+                PolicyError(line, "unterminated section header");
+            policy.rules_.push_back(ParseSection(str.substr(1, str.size() - 2), line));
+            continue;
+        }
+
+        if (policy.rules_.empty())
+            PolicyError(line, "rule outside of a section");
+
+        auto eq = str.find('=');
+        if (eq == std::string_view::npos)
+            PolicyError(line, "expected <key> = <bits>");
+
+        auto key = Trim(str.substr(0, eq));
+        auto bits = SplitWords(str.substr(eq + 1));
+        auto &rule = policy.rules_.back();
+
+        for (auto bit : bits) {
+            if (key == "require")
+                rule.feat_required_ |= 1ULL << ParseFeatureBit(bit, rule, line);
+            else if (key == "forbid")
+                rule.feat_forbidden_ |= 1ULL << ParseFeatureBit(bit, rule, line);
+            else if (key == "status_require")
+                rule.status_required_ |= 1U << ParseStatusBit(bit, line);
+            else if (key == "status_forbid")
+                rule.status_forbidden_ |= 1U << ParseStatusBit(bit, line);
+            else
+                PolicyError(line, fmt::format("unknown key '{}'", key));
+        }
+
+        if ((rule.feat_required_ & rule.feat_forbidden_) ||
+            (rule.status_required_ & rule.status_forbidden_))
+            PolicyError(line, "bit is both required and forbidden");
+    }
+
+    for (uint32_t idx = 0; idx < policy.rules_.size(); idx++) {
+        const auto &rule = policy.rules_[idx];
+        if (rule.dev_type_.has_value()) {
+            policy.by_type_[e_to_type(rule.dev_type_.value())].push_back(idx);
+        } else {
+            policy.any_type_.push_back(idx);
+            for (auto &rules : policy.by_type_)
+                rules.push_back(idx);
+        }
+    }
+
+    return policy;
+}
+
+static std::string
+StatusBitName(const uint32_t bit)
+{
+    auto field = magic_enum::enum_cast<virtio::VirtIOStatusBits>(bit);
+    if (field.has_value())
+        return std::string {magic_enum::enum_name(field.value())};
+    return fmt::format("BIT_{}", bit);
+}
+
+static void
+ReportViolations(const virtio::DevTable &devs, const virtio::DevTable::index_type row,
+                 const CompiledRule &rule, const ViolationKind kind, uint64_t bits)
+{
+    auto dev_name = devs.Name(row);
+    auto aux_info = devs.AuxInfo(row);
+    const auto &feat_names = virtio::FeatureNames(devs.Type(row));
+    bool is_status = kind == ViolationKind::missing_status ||
+                     kind == ViolationKind::forbidden_status;
+
+    for (; bits; bits &= bits - 1) {
+        uint32_t bit = std::countr_zero(bits);
+        std::string bit_name = is_status ? StatusBitName(bit)
+                                         : std::string {feat_names[bit]};
+
+        if (cmdl_opts.json_output_) {
+            fmt::print("{{\"name\":\"{}\",\"type\":{},\"aux\":\"{}\",\"violation\":\"{}\","
+                       "\"bit\":{},\"bit_name\":\"{}\",\"policy_line\":{}}}\n",
+                       dev_name, e_to_type(devs.Type(row)), aux_info,
+                       ViolationKindName(kind), bit, bit_name, rule.line_);
+        } else {
+            fmt::print("{:<10} {:<20} {}: {} [{}] (policy line {})\n",
+                       dev_name,
+                       aux_info.empty() ? "" : fmt::format("({})", aux_info),
+                       ViolationKindName(kind), bit_name, bit, rule.line_);
+        }
+    }
+}
+
+// Returns number of violations
+static uint32_t
+EvaluateDevice(const CompiledPolicy &policy, const virtio::DevTable &devs,
+               const virtio::DevTable::index_type row)
+{
+    auto type_id = e_to_type(devs.Type(row));
+    // fnmatch() wants it NUL terminated
+    std::string aux_info {devs.AuxInfo(row)};
+    auto features = devs.Features(row);
+    auto status = devs.Status(row);
+    const auto &rule_ids = type_id < dev_types_num ? policy.by_type_[type_id]
+                                                   : policy.any_type_;
+    uint32_t violations = 0;
+
+    for (auto idx : rule_ids) {
+        const auto &rule = policy.rules_[idx];
+        if (!rule.aux_pattern_.empty() &&
+            fnmatch(rule.aux_pattern_.c_str(), aux_info.c_str(), 0) != 0)
+            continue;
+
+        uint64_t missing_feat = rule.feat_required_ & ~features;
+        uint64_t forbidden_feat = rule.feat_forbidden_ & features;
+        uint32_t missing_status = rule.status_required_ & ~status;
+        uint32_t forbidden_status = rule.status_forbidden_ & status;
+
+        if (!(missing_feat | forbidden_feat | missing_status | forbidden_status))
+            continue;
+
+        violations += std::popcount(missing_feat) + std::popcount(forbidden_feat) +
+                      std::popcount(missing_status) + std::popcount(forbidden_status);
+
+        ReportViolations(devs, row, rule, ViolationKind::missing_feature, missing_feat);
+        ReportViolations(devs, row, rule, ViolationKind::forbidden_feature, forbidden_feat);
+        ReportViolations(devs, row, rule, ViolationKind::missing_status, missing_status);
+        ReportViolations(devs, row, rule, ViolationKind::forbidden_status, forbidden_status);
+    }
+
+    return violations;
+}
+
+bool CheckDevPolicy()
+{
+    auto policy = CompilePolicy(cmdl_opts.policy_path_);
+    std::vector<virtio::DevScanErrorRecord> errors;
+    auto devs = virtio::GetVirtioDevTable(std::filesystem::path {virtio::virtio_devs_path}, errors);
+
+    uint32_t violations = 0;
+    uint32_t failed_devs = 0;
+    uint32_t unreadable_devs = 0;
+
+    for (virtio::DevTable::index_type idx = 0; idx < devs.Size(); idx++) {
+        auto dev_violations = EvaluateDevice(policy, devs, idx);
+        violations += dev_violations;
+        failed_devs += dev_violations != 0;
+    }
+
+    // a device that can't be checked doesn't comply, unless it's gone
+    for (const auto &err : errors) {
+        if (err.err_ == virtio::DevScanError::removed)
+            continue;
+
+        unreadable_devs++;
+        if (cmdl_opts.json_output_)
+            fmt::print("{{\"name\":\"{}\",\"violation\":\"unreadable\",\"error\":\"{}\"}}\n",
+                       err.name_, virtio::DevScanErrorMsg(err));
+        else
+            fmt::print("{:<10} unreadable: {}\n", err.name_, virtio::DevScanErrorMsg(err));
+    }
+
+    if (!cmdl_opts.json_output_)
+        fmt::print("{} devices checked against {} rules: {} violations in {} devices\n",
+                   devs.Size(), policy.rules_.size(), violations, failed_devs);
+
+    return violations == 0 && unreadable_devs == 0;
+}
+
+} // namespace policy
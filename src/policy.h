@@ -0,0 +1,32 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2025 Petr Vyazovik <xen@f-m.fm>
+
+#pragma once
+
+#include "config.h"
+
+// Feature/status policy compliance check.
+//
+// Policy file consists of sections, each selecting devices by type and/or
+// aux info glob pattern, followed by the bits the selected devices must
+// (require) or must not (forbid) have:
+//
+//   # every network card must do multiqueue, but never UFO
+//   [type=network_card aux=eth*]
+//   require        = VIRTIO_F_VERSION_1 VIRTIO_NET_F_MQ
+//   forbid         = VIRTIO_NET_F_GUEST_UFO
+//
+//   [*]
+//   status_require = VIRTIO_CONFIG_S_DRIVER_OK
+//   status_forbid  = VIRTIO_CONFIG_S_NEEDS_RESET VIRTIO_CONFIG_S_FAILED
+//
+// Bits are given by name or by position. Type is either a VirtIODevType
+// enumerator name or a numeric device id. Sections without a type
+// selector only take transport feature names (VIRTIO_F_*), device
+// specific bits there need to be given by position.
+namespace policy {
+
+// Returns false if any device violates the policy
+bool CheckDevPolicy();
+
+} // namespace policy
@@ -0,0 +1,668 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2025 Petr Vyazovik <xen@f-m.fm>
+
+#include "probe.h"
+#include "util.h"
+#include "virtio_bus.h"
+
+#include <fcntl.h>
+#include <linux/netlink.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "magic_enum/magic_enum.hpp"
+
+extern cfg::CmdLOpts cmdl_opts;
+
+namespace probe {
+
+namespace fs = std::filesystem;
+
+constexpr std::string_view events_magic {"# virtio-info probe events v1"};
+
+constexpr uint32_t status_bit(const virtio::VirtIOStatusBits bit)
+{
+    return 1U << e_to_type(bit);
+}
+
+constexpr uint32_t status_driver {status_bit(virtio::VirtIOStatusBits::VIRTIO_CONFIG_S_DRIVER)};
+constexpr uint32_t status_features_ok {status_bit(virtio::VirtIOStatusBits::VIRTIO_CONFIG_S_FEATURES_OK)};
+constexpr uint32_t status_driver_ok {status_bit(virtio::VirtIOStatusBits::VIRTIO_CONFIG_S_DRIVER_OK)};
+constexpr uint32_t status_failed {status_bit(virtio::VirtIOStatusBits::VIRTIO_CONFIG_S_FAILED)};
+
+enum class ProbeEventKind
+{
+    // device state when watching started
+    present,
+    add,
+    status,
+    remove
+};
+
+struct ProbeEvent
+{
+    uint64_t       ts_ns_ {0};
+    std::string    name_;
+    ProbeEventKind kind_ {ProbeEventKind::status};
+    uint32_t       status_ {0};
+};
+
+enum class ProbePhase
+{
+    add_to_driver,
+    driver_to_features_ok,
+    features_ok_to_driver_ok,
+    total
+};
+
+constexpr std::string_view ProbePhaseName(const ProbePhase phase)
+{
+    switch (phase) {
+    case ProbePhase::add_to_driver:
+	return "add -> DRIVER";
+    case ProbePhase::driver_to_features_ok:
+	return "DRIVER -> FEATURES_OK";
+    case ProbePhase::features_ok_to_driver_ok:
+	return "FEATURES_OK -> DRIVER_OK";
+    case ProbePhase::total:
+	return "total";
+    default:
+	return "< unknown >";
+    }
+}
+
+// One pass of the driver through the status bits, from the device
+// appearing on the bus (or from the DRIVER bit if it's a re-probe) up to
+// DRIVER_OK. Zero timestamp means the bit hasn't been seen yet. Note that
+// ACKNOWLEDGE is set by the core before the device is even announced.
+struct ProbeSession
+{
+    uint64_t start_ns_ {0};
+    bool     from_add_ {false};
+    uint64_t driver_ns_ {0};
+    uint64_t features_ok_ns_ {0};
+    uint64_t driver_ok_ns_ {0};
+};
+
+struct DevProbeState
+{
+    uint32_t                    status_ {0};
+    std::optional<ProbeSession> session_;
+    // add/re-probe to DRIVER_OK of every completed session
+    std::vector<uint64_t>       totals_;
+    uint32_t                    failed_ {0};
+    uint32_t                    aborted_ {0};
+};
+
+// Nearest-rank percentile of sorted samples
+static uint64_t
+Percentile(const std::vector<uint64_t> &sorted, const uint32_t pct)
+{
+    if (sorted.empty())
+        return 0;
+    size_t rank = (sorted.size() * pct + 99) / 100;
+    return sorted[std::max<size_t>(rank, 1) - 1];
+}
+
+class ProbeAnalyzer
+{
+    public:
+        void Feed(const ProbeEvent &ev)
+        {
+            auto &dev = devs_[ev.name_];
+
+            switch (ev.kind_) {
+            case ProbeEventKind::present:
+                // a probe already in flight has no known start
+                dev.status_ = ev.status_;
+                dev.session_.reset();
+                break;
+            case ProbeEventKind::add:
+                if (dev.session_)
+                    dev.aborted_++;
+                dev.status_ = 0;
+                dev.session_ = ProbeSession {.start_ns_ = ev.ts_ns_, .from_add_ = true};
+                ApplyStatus(dev, ev.ts_ns_, ev.status_);
+                break;
+            case ProbeEventKind::status:
+                ApplyStatus(dev, ev.ts_ns_, ev.status_);
+                break;
+            case ProbeEventKind::remove:
+                if (dev.session_)
+                    dev.aborted_++;
+                dev.session_.reset();
+                dev.status_ = 0;
+                break;
+            }
+        }
+
+        void Report() const
+        {
+            uint32_t failed = 0, aborted = 0, pending = 0;
+            for (const auto &[name, dev] : devs_) {
+                failed += dev.failed_;
+                aborted += dev.aborted_;
+                pending += dev.session_.has_value();
+            }
+
+            std::array<std::vector<uint64_t>, magic_enum::enum_count<ProbePhase>()> phases = phases_;
+            for (auto &samples : phases)
+                std::sort(samples.begin(), samples.end());
+
+            auto completed = phases[e_to_type(ProbePhase::total)].size();
+
+            if (cmdl_opts.json_output_) {
+                fmt::print("{{\"completed\":{},\"failed\":{},\"aborted\":{},\"in_progress\":{}}}\n",
+                           completed, failed, aborted, pending);
+            } else {
+                fmt::print("Probe sessions: {} completed, {} failed, {} aborted, {} in progress\n",
+                           completed, failed, aborted, pending);
+                if (interval_us_)
+                    fmt::print("Status polled every {} us, latencies are accurate to that\n",
+                               interval_us_);
+                fmt::print("\n{:<26}{:>7}{:>12}{:>12}{:>12}{:>12}\n",
+                           "phase", "count", "p50 ms", "p90 ms", "p99 ms", "max ms");
+            }
+
+            for (auto phase : magic_enum::enum_values<ProbePhase>()) {
+                const auto &samples = phases[e_to_type(phase)];
+                if (cmdl_opts.json_output_) {
+                    fmt::print("{{\"phase\":\"{}\",\"count\":{},\"p50_ns\":{},\"p90_ns\":{},"
+                               "\"p99_ns\":{},\"max_ns\":{}}}\n",
+                               magic_enum::enum_name(phase), samples.size(),
+                               Percentile(samples, 50), Percentile(samples, 90),
+                               Percentile(samples, 99), samples.empty() ? 0 : samples.back());
+                    continue;
+                }
+                fmt::print("{:<26}{:>7}{:>12}{:>12}{:>12}{:>12}\n",
+                           ProbePhaseName(phase), samples.size(),
+                           Ms(Percentile(samples, 50)), Ms(Percentile(samples, 90)),
+                           Ms(Percentile(samples, 99)), Ms(samples.empty() ? 0 : samples.back()));
+            }
+
+            ReportSlowestDevs();
+        }
+
+        void SetInterval(const uint32_t interval_us) { interval_us_ = interval_us; }
+
+    private:
+        static std::string Ms(const uint64_t ns)
+        {
+            return fmt::format("{:.3f}", static_cast<double>(ns) / 1e6);
+        }
+
+        void ApplyStatus(DevProbeState &dev, const uint64_t ts_ns, const uint32_t status)
+        {
+            auto prev = dev.status_;
+            dev.status_ = status;
+
+            // a failed probe may go by faster than the polling
+            if ((status & status_failed) && !(prev & status_failed)) {
+                dev.failed_++;
+                dev.session_.reset();
+                return;
+            }
+
+            // driver attach starts over: either the DRIVER bit shows up
+            // or polling missed the reset and sees a half-done probe
+            if (!dev.session_ && (status & status_driver) && !(status & status_driver_ok) &&
+                (!(prev & status_driver) || (prev & status_driver_ok)))
+                dev.session_ = ProbeSession {.start_ns_ = ts_ns};
+
+            if (!dev.session_)
+                return;
+
+            auto &session = *dev.session_;
+            // device reset in the middle of the probe
+            if (session.driver_ns_ && !(status & status_driver)) {
+                dev.aborted_++;
+                dev.session_.reset();
+                return;
+            }
+
+            // bits set between two polls share the timestamp
+            if ((status & status_driver) && !session.driver_ns_)
+                session.driver_ns_ = ts_ns;
+            if ((status & status_features_ok) && !session.features_ok_ns_)
+                session.features_ok_ns_ = ts_ns;
+            if ((status & status_driver_ok) && !session.driver_ok_ns_)
+                session.driver_ok_ns_ = ts_ns;
+
+            if (!session.driver_ok_ns_)
+                return;
+
+            auto total = session.driver_ok_ns_ - session.start_ns_;
+            AddSample(ProbePhase::total, total);
+            if (session.from_add_ && session.driver_ns_)
+                AddSample(ProbePhase::add_to_driver, session.driver_ns_ - session.start_ns_);
+            // legacy devices don't negotiate FEATURES_OK
+            if (session.features_ok_ns_ && session.driver_ns_) {
+                AddSample(ProbePhase::driver_to_features_ok,
+                          session.features_ok_ns_ - session.driver_ns_);
+                AddSample(ProbePhase::features_ok_to_driver_ok,
+                          session.driver_ok_ns_ - session.features_ok_ns_);
+            }
+            dev.totals_.push_back(total);
+            dev.session_.reset();
+        }
+
+        void AddSample(const ProbePhase phase, const uint64_t ns)
+        {
+            phases_[e_to_type(phase)].push_back(ns);
+        }
+
+        void ReportSlowestDevs() const
+        {
+            struct DevLatency
+            {
+                const std::string    *name_;
+                std::vector<uint64_t> totals_;
+            };
+
+            std::vector<DevLatency> slowest;
+            for (const auto &[name, dev] : devs_) {
+                if (dev.totals_.empty())
+                    continue;
+                DevLatency lat {&name, dev.totals_};
+                std::sort(lat.totals_.begin(), lat.totals_.end());
+                slowest.push_back(std::move(lat));
+            }
+
+            auto num = std::min<size_t>(slowest.size(), cmdl_opts.probe_slowest_);
+            std::partial_sort(slowest.begin(), slowest.begin() + num, slowest.end(),
+                              [](const DevLatency &lhs, const DevLatency &rhs) {
+                                  if (lhs.totals_.back() != rhs.totals_.back())
+                                      return lhs.totals_.back() > rhs.totals_.back();
+                                  return virtio::DevNameNaturalLess(*lhs.name_, *rhs.name_);
+                              });
+            slowest.resize(num);
+
+            if (!cmdl_opts.json_output_) {
+                if (slowest.empty())
+                    return;
+                fmt::print("\nSlowest devices (total probe time):\n");
+                fmt::print("{:<16}{:>9}{:>12}{:>12}{:>12}\n",
+                           "device", "probes", "p50 ms", "p90 ms", "max ms");
+            }
+
+            for (const auto &lat : slowest) {
+                const auto &totals = lat.totals_;
+                if (cmdl_opts.json_output_) {
+                    fmt::print("{{\"name\":\"{}\",\"probes\":{},\"p50_ns\":{},\"p90_ns\":{},"
+                               "\"max_ns\":{}}}\n",
+                               *lat.name_, totals.size(), Percentile(totals, 50),
+                               Percentile(totals, 90), totals.back());
+                    continue;
+                }
+                fmt::print("{:<16}{:>9}{:>12}{:>12}{:>12}\n",
+                           *lat.name_, totals.size(), Ms(Percentile(totals, 50)),
+                           Ms(Percentile(totals, 90)), Ms(totals.back()));
+            }
+        }
+
+        std::map<std::string, DevProbeState> devs_;
+        std::array<std::vector<uint64_t>, magic_enum::enum_count<ProbePhase>()> phases_;
+        uint32_t interval_us_ {0};
+};
+
+static std::optional<ProbeEvent>
+ParseEventLine(std::string_view line)
+{
+    std::array<std::string_view, 4> fields;
+    size_t num = 0;
+    while (num < fields.size()) {
+        auto tab = line.find('\t');
+        fields[num++] = line.substr(0, tab);
+        if (tab == std::string_view::npos)
+            break;
+        line.remove_prefix(tab + 1);
+    }
+    if (num != fields.size())
+        return std::nullopt;
+
+    ProbeEvent ev;
+    ev.name_ = fields[1];
+
+    auto kind = magic_enum::enum_cast<ProbeEventKind>(fields[2]);
+    if (!kind.has_value() || ev.name_.empty())
+        return std::nullopt;
+    ev.kind_ = *kind;
+
+    auto parse_num = [](std::string_view str, auto &val, const int base) {
+        if (base == 16) {
+            if (!str.starts_with("0x"))
+                return false;
+            str.remove_prefix(2);
+        }
+        auto [ptr, ec] = std::from_chars(str.data(), str.data() + str.size(), val, base);
+        return ec == std::errc {} && ptr == str.data() + str.size();
+    };
+
+    if (!parse_num(fields[0], ev.ts_ns_, 10) || !parse_num(fields[3], ev.status_, 16))
+        return std::nullopt;
+
+    return ev;
+}
+
+static void
+ReplayProbeEvents(ProbeAnalyzer &analyzer)
+{
+    std::ifstream in {cmdl_opts.probe_replay_path_};
+    if (!in) {
+        fmt::print("Failed to open {}\n", cmdl_opts.probe_replay_path_);
+        throw std::runtime_error("Failed to read probe events");
+    }
+
+    std::string line;
+    if (!std::getline(in, line) || line != events_magic) {
+        fmt::print("{} is not a probe events file\n", cmdl_opts.probe_replay_path_);
+        throw std::runtime_error("Failed to read probe events");
+    }
+
+    for (uint64_t line_no = 2; std::getline(in, line); line_no++) {
+        // polling interval of the recording, if the recorder wrote one
+        constexpr std::string_view interval_key {"# interval_us "};
+        if (line.starts_with(interval_key)) {
+            uint32_t interval_us;
+            auto val = std::string_view {line}.substr(interval_key.size());
+            auto [ptr, ec] = std::from_chars(val.data(), val.data() + val.size(), interval_us);
+            if (ec == std::errc {})
+                analyzer.SetInterval(interval_us);
+            continue;
+        }
+        if (line.empty() || line.starts_with('#'))
+            continue;
+
+        auto ev = ParseEventLine(line);
+        if (!ev.has_value()) {
+            fmt::print("{}:{}: malformed event \"{}\"\n",
+                       cmdl_opts.probe_replay_path_, line_no, line);
+            throw std::runtime_error("Failed to read probe events");
+        }
+        analyzer.Feed(*ev);
+    }
+}
+
+// Kernel uevents (the same ones udev gets) for the virtio bus. Events
+// are timestamped on receipt, so they are late by the scheduling delay.
+class UeventSocket
+{
+    public:
+        UeventSocket()
+        {
+            fd_ = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK,
+                         NETLINK_KOBJECT_UEVENT);
+            if (fd_ < 0)
+                return;
+
+            // don't lose events while a burst of devices is probed
+            int rcvbuf = 1 << 20;
+            setsockopt(fd_, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+            struct sockaddr_nl addr {};
+            addr.nl_family = AF_NETLINK;
+            addr.nl_groups = 1;
+            if (bind(fd_, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) < 0) {
+                close(fd_);
+                fd_ = -1;
+            }
+        }
+
+        ~UeventSocket()
+        {
+            if (fd_ >= 0)
+                close(fd_);
+        }
+
+        UeventSocket(const UeventSocket &) = delete;
+        UeventSocket &operator=(const UeventSocket &) = delete;
+
+        int Fd() const { return fd_; }
+
+        // Next virtio device add/remove: action and device name,
+        // nullopt once there is nothing more queued
+        std::optional<std::pair<std::string, std::string>> Receive()
+        {
+            while (true) {
+                struct sockaddr_nl sender {};
+                socklen_t sender_len = sizeof(sender);
+                auto len = recvfrom(fd_, buf_.data(), buf_.size() - 1, 0,
+                                    reinterpret_cast<struct sockaddr *>(&sender), &sender_len);
+                if (len <= 0)
+                    return std::nullopt;
+                // only the kernel itself is trusted
+                if (sender.nl_pid != 0)
+                    continue;
+                buf_[len] = '\0';
+
+                std::string_view action, devpath, subsystem;
+                // "<action>@<devpath>\0KEY=VALUE\0..."
+                for (size_t pos = strlen(buf_.data()) + 1; pos < static_cast<size_t>(len);) {
+                    std::string_view var {buf_.data() + pos};
+                    pos += var.size() + 1;
+                    if (var.starts_with("ACTION="))
+                        action = var.substr(7);
+                    else if (var.starts_with("DEVPATH="))
+                        devpath = var.substr(8);
+                    else if (var.starts_with("SUBSYSTEM="))
+                        subsystem = var.substr(10);
+                }
+
+                if (subsystem != "virtio" || (action != "add" && action != "remove"))
+                    continue;
+                auto slash = devpath.rfind('/');
+                if (slash == std::string_view::npos)
+                    continue;
+                return std::pair {std::string {action}, std::string {devpath.substr(slash + 1)}};
+            }
+        }
+
+    private:
+        int                    fd_ {-1};
+        std::array<char, 8192> buf_;
+};
+
+struct WatchedDev
+{
+    int      status_fd_ {-1};
+    uint32_t status_ {0};
+
+    ~WatchedDev()
+    {
+        if (status_fd_ >= 0)
+            close(status_fd_);
+    }
+};
+
+// Watches the bus and turns everything it sees into probe events
+class ProbeWatcher
+{
+    public:
+        ProbeWatcher(ProbeAnalyzer &analyzer, std::FILE *log)
+            : analyzer_(analyzer), log_(log)
+        {}
+
+        void Run()
+        {
+            UeventSocket uevents;
+            if (uevents.Fd() < 0)
+                fmt::print(stderr, "Kernel uevents are not available, "
+                           "new devices are detected by bus rescans\n");
+
+            // subscribe first, so a device added during the initial scan
+            // is not missed
+            for (const auto &name : virtio::GetVirtioDevNames())
+                Track(name, ProbeEventKind::present);
+
+            struct pollfd pfd {uevents.Fd(), POLLIN, 0};
+            const struct timespec interval {
+                static_cast<time_t>(cmdl_opts.probe_interval_us_ / 1000000),
+                static_cast<long>(cmdl_opts.probe_interval_us_ % 1000000) * 1000
+            };
+
+            while (!util::StopRequested()) {
+                if (uevents.Fd() >= 0) {
+                    ppoll(&pfd, 1, &interval, nullptr);
+                    while (auto uevent = uevents.Receive()) {
+                        if (uevent->first == "add")
+                            Track(uevent->second, ProbeEventKind::add);
+                        else
+                            Untrack(uevent->second);
+                    }
+                } else {
+                    nanosleep(&interval, nullptr);
+                    Rescan();
+                }
+
+                PollStatus();
+                if (log_ != nullptr && events_logged_)
+                    std::fflush(log_);
+                events_logged_ = false;
+            }
+        }
+
+    private:
+        void Emit(ProbeEvent ev)
+        {
+            if (log_ != nullptr) {
+                fmt::print(log_, "{}\t{}\t{}\t{:#x}\n", ev.ts_ns_, ev.name_,
+                           magic_enum::enum_name(ev.kind_), ev.status_);
+                events_logged_ = true;
+            }
+            analyzer_.Feed(ev);
+        }
+
+        // status of devices which are gone reads as nullopt
+        static std::optional<uint32_t> ReadStatus(const int fd)
+        {
+            std::array<char, 32> buf;
+            auto len = pread(fd, buf.data(), buf.size(), 0);
+            if (len <= 0)
+                return std::nullopt;
+
+            std::string_view raw {buf.data(), static_cast<size_t>(len)};
+            if (raw.ends_with('\n'))
+                raw.remove_suffix(1);
+            uint32_t status;
+            if (!virtio::ParseDevStatusAttr(raw, status))
+                return std::nullopt;
+            return status;
+        }
+
+        void Track(const std::string &name, const ProbeEventKind kind)
+        {
+            auto ts_ns = util::NowNs();
+            auto path = fs::path {virtio::virtio_devs_path} / name / "status";
+
+            auto dev = std::make_unique<WatchedDev>();
+            dev->status_fd_ = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (dev->status_fd_ < 0)
+                return;
+            auto status = ReadStatus(dev->status_fd_);
+            if (!status.has_value())
+                return;
+
+            dev->status_ = *status;
+            devs_.insert_or_assign(name, std::move(dev));
+            Emit({ts_ns, name, kind, *status});
+        }
+
+        void Untrack(const std::string &name)
+        {
+            if (devs_.erase(name))
+                Emit({util::NowNs(), name, ProbeEventKind::remove, 0});
+        }
+
+        void Rescan()
+        {
+            auto names = virtio::GetVirtioDevNames();
+            std::sort(names.begin(), names.end());
+
+            std::vector<std::string> gone;
+            for (const auto &[name, dev] : devs_)
+                if (!std::binary_search(names.begin(), names.end(), name))
+                    gone.push_back(name);
+            for (const auto &name : gone)
+                Untrack(name);
+
+            for (const auto &name : names)
+                if (!devs_.contains(name))
+                    Track(name, ProbeEventKind::add);
+        }
+
+        // All devices are polled on every tick: a driver can be unbound
+        // and re-probed at any time, not just when the device appears
+        void PollStatus()
+        {
+            for (auto &[name, dev] : devs_) {
+                auto status = ReadStatus(dev->status_fd_);
+                // removal is reported by the uevent or the next rescan
+                if (!status.has_value() || *status == dev->status_)
+                    continue;
+                dev->status_ = *status;
+                Emit({util::NowNs(), name, ProbeEventKind::status, *status});
+            }
+        }
+
+        ProbeAnalyzer &analyzer_;
+        std::FILE     *log_;
+        bool           events_logged_ {false};
+        std::map<std::string, std::unique_ptr<WatchedDev>> devs_;
+};
+
+static void
+WatchProbeEvents(ProbeAnalyzer &analyzer)
+{
+    std::FILE *log = nullptr;
+    if (!cmdl_opts.probe_log_path_.empty()) {
+        log = std::fopen(cmdl_opts.probe_log_path_.c_str(), "w");
+        if (log == nullptr) {
+            fmt::print("Failed to open {} for writing\n", cmdl_opts.probe_log_path_);
+            throw std::runtime_error("Failed to write probe events");
+        }
+        fmt::print(log, "{}\n# interval_us {}\n", events_magic, cmdl_opts.probe_interval_us_);
+    }
+
+    util::CatchStopSignals();
+
+    fmt::print(stderr, "Watching VirtIO driver probes (status polled every {} us), "
+               "interrupt to get the report\n", cmdl_opts.probe_interval_us_);
+
+    ProbeWatcher {analyzer, log}.Run();
+
+    if (log != nullptr)
+        std::fclose(log);
+}
+
+void ProfileProbeLatency()
+{
+    ProbeAnalyzer analyzer;
+
+    if (!cmdl_opts.probe_replay_path_.empty()) {
+        ReplayProbeEvents(analyzer);
+    } else {
+        analyzer.SetInterval(cmdl_opts.probe_interval_us_);
+        WatchProbeEvents(analyzer);
+    }
+
+    analyzer.Report();
+}
+
+} // namespace probe
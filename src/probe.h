@@ -0,0 +1,20 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2025 Petr Vyazovik <xen@f-m.fm>
+
+#pragma once
+
+#include "config.h"
+
+// Driver probe latency profiling. Devices are watched through kernel
+// uevents and polling of their "status" attribute; every observed change
+// is an event, optionally saved one per line
+// ("<monotonic ns>\t<name>\t<present|add|status|remove>\t<status>")
+// after a "# virtio-info probe events v1" line, so the same report can
+// be produced offline from a recorded stream.
+namespace probe {
+
+// Watch devices until interrupted, then print probe latencies
+// (or analyze recorded events if --probe-replay was given)
+void ProfileProbeLatency();
+
+} // namespace probe
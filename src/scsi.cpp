@@ -0,0 +1,267 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2025 Petr Vyazovik <xen@f-m.fm>
+
+#include "scsi.h"
+#include "feat_names.h"
+#include "sysfs_source.h"
+#include "util.h"
+#include "virtio_bus.h"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <charconv>
+#include <optional>
+#include <string>
+#include <vector>
+
+extern cfg::CmdLOpts cmdl_opts;
+
+namespace scsi {
+
+namespace fs = std::filesystem;
+
+constexpr std::string_view cpus_online_path {"/sys/devices/system/cpu/online"};
+// device specific feature bits, the rest are transport ones
+constexpr uint32_t dev_feature_bits {24};
+
+struct ScsiLun
+{
+    // "H:C:T:L"
+    std::string              hctl_;
+    std::vector<std::string> block_devs_;
+    std::optional<uint32_t>  queue_depth_;
+    // blk-mq hardware contexts of the (first) block device
+    std::optional<uint32_t>  mq_queues_;
+};
+
+struct ScsiHost
+{
+    std::string             name_;
+    std::optional<uint32_t> can_queue_;
+    std::optional<uint32_t> cmd_per_lun_;
+    std::optional<uint32_t> nr_hw_queues_;
+    std::vector<ScsiLun>    luns_;
+};
+
+static std::optional<uint32_t>
+ReadUintAttr(const fs::path &path)
+{
+    auto buf = virtio::ActiveSysfs().ReadAttr(path);
+    if (!buf.has_value())
+        return std::nullopt;
+
+    uint32_t val;
+    if (!util::ParseNumber(*buf, val))
+        return std::nullopt;
+    return val;
+}
+
+// "0-3,8-11" -> 8
+static std::optional<uint32_t>
+OnlineCpus()
+{
+    auto list = virtio::ActiveSysfs().ReadAttr(cpus_online_path);
+    if (!list.has_value())
+        return std::nullopt;
+
+    uint32_t cpus = 0;
+    std::string_view rest {*list};
+    while (!rest.empty()) {
+        auto range = rest.substr(0, rest.find(','));
+        rest.remove_prefix(std::min(rest.size(), range.size() + 1));
+
+        uint32_t first, last;
+        auto res = std::from_chars(range.data(), range.data() + range.size(), first);
+        if (res.ec != std::errc {})
+            return std::nullopt;
+        last = first;
+        if (res.ptr != range.data() + range.size() && *res.ptr == '-')
+            res = std::from_chars(res.ptr + 1, range.data() + range.size(), last);
+        if (res.ec != std::errc {} || last < first)
+            return std::nullopt;
+        cpus += last - first + 1;
+    }
+    return cpus;
+}
+
+static std::vector<std::string>
+SortedEntries(const fs::path &path)
+{
+    auto entries = virtio::ActiveSysfs().ListDir(path).value_or(std::vector<std::string> {});
+    std::sort(entries.begin(), entries.end(), virtio::DevNameNaturalLess);
+    return entries;
+}
+
+static ScsiLun
+ReadLun(const fs::path &lun_path)
+{
+    ScsiLun lun;
+    lun.hctl_ = lun_path.filename().string();
+    lun.queue_depth_ = ReadUintAttr(lun_path / "queue_depth");
+    lun.block_devs_ = SortedEntries(lun_path / "block");
+
+    if (!lun.block_devs_.empty()) {
+        auto mq = virtio::ActiveSysfs().ListDir(lun_path / "block" / lun.block_devs_.front() / "mq");
+        if (mq.has_value())
+            lun.mq_queues_ = static_cast<uint32_t>(mq->size());
+    }
+
+    return lun;
+}
+
+static std::vector<ScsiHost>
+ReadScsiHosts(const fs::path &dev_path)
+{
+    std::vector<ScsiHost> hosts;
+    auto dev = virtio::ActiveSysfs().Canonical(dev_path).value_or(dev_path);
+
+    for (const auto &entry : SortedEntries(dev)) {
+        if (!entry.starts_with("host"))
+            continue;
+
+        ScsiHost host;
+        host.name_ = entry;
+        auto attrs = dev / entry / "scsi_host" / entry;
+        host.can_queue_ = ReadUintAttr(attrs / "can_queue");
+        host.cmd_per_lun_ = ReadUintAttr(attrs / "cmd_per_lun");
+        host.nr_hw_queues_ = ReadUintAttr(attrs / "nr_hw_queues");
+
+        for (const auto &target : SortedEntries(dev / entry)) {
+            if (!target.starts_with("target"))
+                continue;
+            for (const auto &lun : SortedEntries(dev / entry / target))
+                if (std::count(lun.begin(), lun.end(), ':') == 3)
+                    host.luns_.push_back(ReadLun(dev / entry / target / lun));
+        }
+
+        hosts.push_back(std::move(host));
+    }
+
+    return hosts;
+}
+
+// Limits that keep the LUNs from using the parallelism they could:
+// commands the LUNs may queue above the host limit, and fewer
+// submission queues than CPUs. virtio-scsi doesn't set host_tagset,
+// so can_queue is the tag space of every hardware queue.
+static std::vector<std::string>
+HostWarnings(const ScsiHost &host, const std::optional<uint32_t> cpus)
+{
+    std::vector<std::string> warnings;
+
+    uint64_t luns_depth = 0;
+    for (const auto &lun : host.luns_)
+        luns_depth += lun.queue_depth_.value_or(0);
+    if (host.can_queue_.has_value()) {
+        auto hw_queues = host.nr_hw_queues_.value_or(1);
+        if (luns_depth > static_cast<uint64_t>(*host.can_queue_) * hw_queues)
+            warnings.push_back(fmt::format("can_queue {}{} below total LUN queue depth {}", *host.can_queue_,
+                                           hw_queues > 1 ? fmt::format(" x {} hw queues", hw_queues) : "",
+                                           luns_depth));
+    }
+
+    if (host.nr_hw_queues_.has_value() && cpus.has_value() &&
+        !host.luns_.empty() && *host.nr_hw_queues_ < *cpus)
+        warnings.push_back(fmt::format("{} hw queues for {} online CPUs",
+                                       *host.nr_hw_queues_, *cpus));
+
+    return warnings;
+}
+
+static std::string
+OptNum(const std::optional<uint32_t> &val, std::string_view none = "-")
+{
+    return val.has_value() ? fmt::format("{}", *val) : std::string {none};
+}
+
+static std::string
+DevFeatureNames(const uint64_t features)
+{
+    const auto &names = virtio::FeatureNames(virtio::VirtIODevType::scsi_host);
+    std::string out;
+    for (uint32_t bit = 0; bit < dev_feature_bits; bit++) {
+        if (!(features >> bit & 1))
+            continue;
+        if (!out.empty())
+            out += ',';
+        out += names[bit];
+    }
+    return out;
+}
+
+static void
+PrintHostJson(std::string_view name, const uint64_t features, const ScsiHost &host,
+              const std::vector<std::string> &warnings)
+{
+    std::string luns;
+    for (const auto &lun : host.luns_) {
+        std::string block_devs;
+        for (const auto &blk : lun.block_devs_)
+            block_devs += fmt::format("{}\"{}\"", block_devs.empty() ? "" : ",", blk);
+        luns += fmt::format("{}{{\"hctl\":\"{}\",\"block\":[{}],\"queue_depth\":{},\"mq_queues\":{}}}",
+                            luns.empty() ? "" : ",", lun.hctl_, block_devs,
+                            OptNum(lun.queue_depth_, "null"), OptNum(lun.mq_queues_, "null"));
+    }
+
+    std::string warns;
+    for (const auto &warn : warnings)
+        warns += fmt::format("{}\"{}\"", warns.empty() ? "" : ",", warn);
+
+    fmt::print("{{\"name\":\"{}\",\"host\":\"{}\",\"features\":\"{}\",\"can_queue\":{},"
+               "\"cmd_per_lun\":{},\"nr_hw_queues\":{},\"luns\":[{}],\"warnings\":[{}]}}\n",
+               name, host.name_, DevFeatureNames(features), OptNum(host.can_queue_, "null"),
+               OptNum(host.cmd_per_lun_, "null"), OptNum(host.nr_hw_queues_, "null"),
+               luns, warns);
+}
+
+void ShowScsiHosts()
+{
+    auto cpus = OnlineCpus();
+    bool found = false;
+
+    for (const auto &[name, desc] : virtio::GetVirtioDevMap()) {
+        if (desc.dev_type_ != virtio::VirtIODevType::scsi_host)
+            continue;
+        found = true;
+
+        auto hosts = ReadScsiHosts(desc.dev_path_);
+        if (hosts.empty()) {
+            if (cmdl_opts.json_output_)
+                fmt::print("{{\"name\":\"{}\",\"host\":null,\"features\":\"{}\"}}\n",
+                           name, DevFeatureNames(desc.features_));
+            else
+                fmt::print("{}  no SCSI host (driver not bound?)\n", name);
+            continue;
+        }
+
+        for (const auto &host : hosts) {
+            auto warnings = HostWarnings(host, cpus);
+            if (cmdl_opts.json_output_) {
+                PrintHostJson(name, desc.features_, host, warnings);
+                continue;
+            }
+
+            fmt::print("{}  {}  can_queue {}  cmd_per_lun {}  nr_hw_queues {}  features {}\n",
+                       name, host.name_, OptNum(host.can_queue_), OptNum(host.cmd_per_lun_),
+                       OptNum(host.nr_hw_queues_), DevFeatureNames(desc.features_));
+            for (const auto &lun : host.luns_) {
+                std::string block_devs;
+                for (const auto &blk : lun.block_devs_)
+                    block_devs += fmt::format("{}{}", block_devs.empty() ? "" : ",", blk);
+                fmt::print("  {:<12} {:<8} queue_depth {:<5} mq queues {}\n",
+                           lun.hctl_, block_devs.empty() ? "-" : block_devs,
+                           OptNum(lun.queue_depth_), OptNum(lun.mq_queues_));
+            }
+            if (host.luns_.empty())
+                fmt::print("  no LUNs\n");
+            for (const auto &warn : warnings)
+                fmt::print("  ! {}\n", warn);
+        }
+    }
+
+    if (!found)
+        fmt::print("No virtio-scsi devices found\n");
+}
+
+} // namespace scsi
@@ -0,0 +1,18 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2025 Petr Vyazovik <xen@f-m.fm>
+
+#pragma once
+
+#include "config.h"
+
+// virtio-scsi hosts and their LUNs: virtioN/hostH/scsi_host/hostH holds
+// the host limits, virtioN/hostH/targetH:C:T/H:C:T:L the LUNs with their
+// block devices. The number of commands in flight is bounded by the
+// host (can_queue per hardware queue, shared by all LUNs) and by every
+// LUN (queue_depth), the number of submission queues by nr_hw_queues.
+namespace scsi {
+
+// Show queue limits and LUN layout of every virtio-scsi device
+void ShowScsiHosts();
+
+} // namespace scsi
@@ -0,0 +1,469 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2025 Petr Vyazovik <xen@f-m.fm>
+
+#include "snapshot.h"
+#include "dev_table.h"
+#include "feat_names.h"
+#include "sysfs_source.h"
+#include "util.h"
+#include "virtio_bus.h"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "magic_enum/magic_enum.hpp"
+
+extern cfg::CmdLOpts cmdl_opts;
+
+namespace snapshot {
+
+namespace fs = std::filesystem;
+
+constexpr std::string_view snapshot_magic {"# virtio-info snapshot v1"};
+constexpr size_t snapshot_fields_num {6};
+
+struct SnapDev
+{
+    std::string name_;
+    uint32_t    dev_type_ {0};
+    uint32_t    status_ {0};
+    uint64_t    features_ {0};
+    std::string aux_info_;
+    // device the virtio one sits on, e.g. PCI address
+    std::string parent_;
+};
+
+static std::string
+DevParent(const fs::path &dev_path)
+{
+    auto canonical = virtio::ActiveSysfs().Canonical(dev_path);
+    if (!canonical.has_value())
+        return {};
+
+    // only a real device (PCI function, platform device, ...) identifies
+    // the virtio one, not a plain directory like /sys/devices
+    auto parent = canonical->parent_path();
+    if (!virtio::ActiveSysfs().Exists(parent / "subsystem"))
+        return {};
+    return parent.filename().string();
+}
+
+void WriteDevSnapshot()
+{
+    std::FILE *out = stdout;
+    bool to_file = cmdl_opts.snapshot_path_ != "-";
+
+    if (to_file) {
+        out = std::fopen(cmdl_opts.snapshot_path_.c_str(), "w");
+        if (out == nullptr) {
+            fmt::print("Failed to open {} for writing\n", cmdl_opts.snapshot_path_);
+            throw std::runtime_error("Failed to write snapshot");
+        }
+    }
+
+    // rows come naturally ordered, so virtio10 follows virtio9
+    std::vector<virtio::DevScanErrorRecord> errors;
+    auto table = virtio::GetVirtioDevTable(fs::path {virtio::virtio_devs_path}, errors);
+    for (const auto &err : errors)
+        fmt::print(stderr, "Skipping {}: {}\n", err.name_, virtio::DevScanErrorMsg(err));
+
+    fmt::print(out, "{}\n# name\ttype\tstatus\tfeatures\taux\tparent\n", snapshot_magic);
+    for (virtio::DevTable::index_type idx = 0; idx < table.Size(); idx++) {
+        fmt::print(out, "{}\t{}\t{:#x}\t{:#x}\t{}\t{}\n",
+                   table.Name(idx), e_to_type(table.Type(idx)), table.Status(idx),
+                   table.Features(idx), table.AuxInfo(idx), DevParent(table.DevPath(idx)));
+    }
+
+    if (to_file && std::fclose(out) != 0) {
+        fmt::print("Failed to write {}\n", cmdl_opts.snapshot_path_);
+        throw std::runtime_error("Failed to write snapshot");
+    }
+}
+
+// Reads snapshot records one at a time
+class SnapshotReader
+{
+    public:
+        explicit SnapshotReader(const std::string &path)
+            : path_(path), file_(path, std::ios::in)
+        {
+            std::string line;
+            if (!file_.is_open() || !std::getline(file_, line) || line != snapshot_magic) {
+                fmt::print("{} is not a virtio-info snapshot\n", path_);
+                throw std::runtime_error("Failed to read snapshot");
+            }
+            line_num_++;
+        }
+
+        bool Next(SnapDev &dev)
+        {
+            std::string line;
+
+            while (std::getline(file_, line)) {
+                line_num_++;
+                if (line.empty() || line.starts_with('#'))
+                    continue;
+
+                std::array<std::string_view, snapshot_fields_num> fields;
+                std::string_view rest {line};
+                size_t num = 0;
+                for (; num < fields.size(); num++) {
+                    auto tab = rest.find('\t');
+                    fields[num] = rest.substr(0, tab);
+                    if (tab == std::string_view::npos) {
+                        num++;
+                        break;
+                    }
+                    rest.remove_prefix(tab + 1);
+                }
+
+                if (num != fields.size() || fields[0].empty() ||
+                    !util::ParseNumber(fields[1], dev.dev_type_) ||
+                    !util::ParseNumber(fields[2], dev.status_) ||
+                    !util::ParseNumber(fields[3], dev.features_)) {
+                    fmt::print("{}:{}: malformed snapshot record\n", path_, line_num_);
+                    throw std::runtime_error("Failed to read snapshot");
+                }
+
+                dev.name_ = fields[0];
+                dev.aux_info_ = fields[4];
+                dev.parent_ = fields[5];
+                return true;
+            }
+
+            return false;
+        }
+
+        uint64_t LineNum() const { return line_num_; }
+
+    private:
+        const std::string &path_;
+        std::ifstream      file_;
+        uint64_t           line_num_ {0};
+};
+
+// Key used to pair up devices of the two snapshots. Names are not
+// stable across reboots, the parent device (PCI address) or aux info
+// (iface / block device name) usually are.
+static std::string
+MatchKey(const SnapDev &dev)
+{
+    if (!cmdl_opts.match_by_identity_)
+        return dev.name_;
+    if (!dev.parent_.empty())
+        return "parent:" + dev.parent_;
+    if (!dev.aux_info_.empty())
+        return "aux:" + dev.aux_info_;
+    return "name:" + dev.name_;
+}
+
+static std::string
+StatusBitName(const uint32_t bit)
+{
+    auto field = magic_enum::enum_cast<virtio::VirtIOStatusBits>(bit);
+    if (field.has_value())
+        return std::string {magic_enum::enum_name(field.value())};
+    return fmt::format("BIT_{}", bit);
+}
+
+// names of the bits set in @bits
+template <typename F>
+static std::vector<std::string>
+BitNames(uint64_t bits, F name_fun)
+{
+    std::vector<std::string> names;
+    for (; bits; bits &= bits - 1)
+        names.push_back(name_fun(std::countr_zero(bits)));
+    return names;
+}
+
+static std::string
+JsonList(const std::vector<std::string> &names)
+{
+    std::string out {"["};
+    for (size_t i = 0; i < names.size(); i++)
+        out += fmt::format("{}\"{}\"", i ? "," : "", util::JsonEscape(names[i]));
+    return out + "]";
+}
+
+static std::string
+TextList(const std::vector<std::string> &added, const std::vector<std::string> &removed)
+{
+    std::string out;
+    for (const auto &name : added)
+        out += fmt::format(" +{}", name);
+    for (const auto &name : removed)
+        out += fmt::format(" -{}", name);
+    return out;
+}
+
+static void
+PrintPresenceChange(const SnapDev &dev, const bool added)
+{
+    auto type = virtio::VirtIODevType {dev.dev_type_};
+
+    if (cmdl_opts.json_output_) {
+        fmt::print("{{\"name\":\"{}\",\"change\":\"{}\",\"type\":{},\"status\":\"{:#x}\","
+                   "\"features\":\"{:#x}\",\"aux\":\"{}\",\"parent\":\"{}\"}}\n",
+                   util::JsonEscape(dev.name_), added ? "added" : "removed", dev.dev_type_,
+                   dev.status_, dev.features_, util::JsonEscape(dev.aux_info_),
+                   util::JsonEscape(dev.parent_));
+        return;
+    }
+
+    std::string extra;
+    if (!dev.aux_info_.empty())
+        extra += fmt::format(" ({})", dev.aux_info_);
+    if (!dev.parent_.empty())
+        extra += fmt::format(" @{}", dev.parent_);
+
+    fmt::print("{} {:<10} [{:>2}] {:<20}{}\n",
+               added ? '+' : '-', dev.name_, dev.dev_type_,
+               virtio::VirtIODevTypeName(type), extra);
+}
+
+// Returns true if the device has changed
+static bool
+PrintDevChange(const SnapDev &old, const SnapDev &cur)
+{
+    if (old.name_ == cur.name_ && old.dev_type_ == cur.dev_type_ &&
+        old.status_ == cur.status_ && old.features_ == cur.features_ &&
+        old.aux_info_ == cur.aux_info_ && old.parent_ == cur.parent_)
+        return false;
+
+    const auto &feat_names = virtio::FeatureNames(cur.dev_type_);
+    auto feat_name = [&](uint32_t bit) { return std::string {feat_names[bit]}; };
+
+    auto feat_added = BitNames(cur.features_ & ~old.features_, feat_name);
+    auto feat_removed = BitNames(old.features_ & ~cur.features_, feat_name);
+    auto status_added = BitNames(cur.status_ & ~old.status_, StatusBitName);
+    auto status_removed = BitNames(old.status_ & ~cur.status_, StatusBitName);
+
+    if (cmdl_opts.json_output_) {
+        std::string fields;
+        if (old.name_ != cur.name_)
+            fields += fmt::format(",\"old_name\":\"{}\"", util::JsonEscape(old.name_));
+        if (old.dev_type_ != cur.dev_type_)
+            fields += fmt::format(",\"old_type\":{},\"type\":{}", old.dev_type_, cur.dev_type_);
+        if (old.features_ != cur.features_)
+            fields += fmt::format(",\"features_added\":{},\"features_removed\":{}",
+                                  JsonList(feat_added), JsonList(feat_removed));
+        if (old.status_ != cur.status_)
+            fields += fmt::format(",\"status_added\":{},\"status_removed\":{}",
+                                  JsonList(status_added), JsonList(status_removed));
+        if (old.aux_info_ != cur.aux_info_)
+            fields += fmt::format(",\"old_aux\":\"{}\",\"aux\":\"{}\"",
+                                  util::JsonEscape(old.aux_info_), util::JsonEscape(cur.aux_info_));
+        if (old.parent_ != cur.parent_)
+            fields += fmt::format(",\"old_parent\":\"{}\",\"parent\":\"{}\"",
+                                  util::JsonEscape(old.parent_), util::JsonEscape(cur.parent_));
+
+        fmt::print("{{\"name\":\"{}\",\"change\":\"changed\"{}}}\n", util::JsonEscape(cur.name_), fields);
+        return true;
+    }
+
+    std::string changes;
+    if (old.name_ != cur.name_)
+        changes += fmt::format(" name: {} -> {};", old.name_, cur.name_);
+    if (old.dev_type_ != cur.dev_type_)
+        changes += fmt::format(" type: {} -> {};", old.dev_type_, cur.dev_type_);
+    if (old.features_ != cur.features_)
+        changes += fmt::format(" features:{};", TextList(feat_added, feat_removed));
+    if (old.status_ != cur.status_)
+        changes += fmt::format(" status:{};", TextList(status_added, status_removed));
+    if (old.aux_info_ != cur.aux_info_)
+        changes += fmt::format(" aux: {} -> {};", old.aux_info_, cur.aux_info_);
+    if (old.parent_ != cur.parent_)
+        changes += fmt::format(" parent: {} -> {};", old.parent_, cur.parent_);
+    changes.pop_back();
+
+    fmt::print("~ {:<10}{}\n", cur.name_, changes);
+    return true;
+}
+
+bool CompareDevSnapshots()
+{
+    // build side: the old snapshot
+    std::unordered_map<std::string, SnapDev> old_devs;
+    {
+        SnapshotReader old_reader {cmdl_opts.compare_old_path_};
+        SnapDev dev;
+        while (old_reader.Next(dev)) {
+            auto key = MatchKey(dev);
+            if (!old_devs.emplace(std::move(key), dev).second) {
+                fmt::print("{}:{}: duplicate device {}\n", cmdl_opts.compare_old_path_,
+                           old_reader.LineNum(), dev.name_);
+                throw std::runtime_error("Failed to read snapshot");
+            }
+        }
+    }
+
+    uint64_t added = 0, removed = 0, changed = 0, unchanged = 0;
+
+    // probe side: the new one is streamed, matched entries are dropped
+    // from the map, so whatever is left there has disappeared
+    SnapshotReader new_reader {cmdl_opts.compare_new_path_};
+    SnapDev dev;
+    while (new_reader.Next(dev)) {
+        auto it = old_devs.find(MatchKey(dev));
+        if (it == old_devs.end()) {
+            PrintPresenceChange(dev, true);
+            added++;
+            continue;
+        }
+
+        if (PrintDevChange(it->second, dev))
+            changed++;
+        else
+            unchanged++;
+        old_devs.erase(it);
+    }
+
+    std::vector<const SnapDev *> gone;
+    gone.reserve(old_devs.size());
+    for (const auto &[key, old] : old_devs)
+        gone.push_back(&old);
+    std::sort(gone.begin(), gone.end(), [](const SnapDev *lhs, const SnapDev *rhs) {
+        return virtio::DevNameNaturalLess(lhs->name_, rhs->name_);
+    });
+
+    for (const auto *old : gone)
+        PrintPresenceChange(*old, false);
+    removed = gone.size();
+
+    if (!cmdl_opts.json_output_)
+        fmt::print("{} added, {} removed, {} changed, {} unchanged\n",
+                   added, removed, changed, unchanged);
+
+    return added + removed + changed == 0;
+}
+
+// Bit-sliced subset index over host feature profiles. A host offers,
+// per device type, the union of the features of its devices of that
+// type. For every type and feature bit there is a bitmap of the hosts
+// offering it, so finding the hosts whose masks are supersets of a VM's
+// is an AND of the slices of the bits the VM uses: O(bits * hosts / 64)
+// instead of comparing every host.
+class HostProfileIndex
+{
+    public:
+        using bitmap_type = std::vector<uint64_t>;
+
+        void AddHost(std::string name, const std::vector<SnapDev> &devs)
+        {
+            auto host = names_.size();
+            names_.push_back(std::move(name));
+
+            for (const auto &dev : devs) {
+                auto &slices = types_[dev.dev_type_];
+                SetBit(slices.present_, host);
+                for (auto bits = dev.features_; bits; bits &= bits - 1)
+                    SetBit(slices.bits_[std::countr_zero(bits)], host);
+            }
+        }
+
+        // hosts offering every feature of @vm_masks (device type -> features)
+        bitmap_type Supersets(const std::unordered_map<uint32_t, uint64_t> &vm_masks) const
+        {
+            bitmap_type res((names_.size() + 63) / 64, ~0ULL);
+            if (names_.size() % 64 && !res.empty())
+                res.back() = (1ULL << (names_.size() % 64)) - 1;
+
+            for (const auto &[dev_type, features] : vm_masks) {
+                auto it = types_.find(dev_type);
+                if (it == types_.end())
+                    return bitmap_type(res.size(), 0);
+
+                And(res, it->second.present_);
+                for (auto bits = features; bits; bits &= bits - 1)
+                    And(res, it->second.bits_[std::countr_zero(bits)]);
+            }
+
+            return res;
+        }
+
+        const std::string &Name(const size_t host) const { return names_[host]; }
+        size_t Size() const { return names_.size(); }
+
+    private:
+        struct TypeSlices
+        {
+            bitmap_type                                   present_;
+            std::array<bitmap_type, virtio::feature_bits_max> bits_;
+        };
+
+        static void SetBit(bitmap_type &bitmap, const size_t pos)
+        {
+            if (bitmap.size() <= pos / 64)
+                bitmap.resize(pos / 64 + 1, 0);
+            bitmap[pos / 64] |= 1ULL << (pos % 64);
+        }
+
+        // slices only grow up to the last host having the bit
+        static void And(bitmap_type &res, const bitmap_type &slice)
+        {
+            for (size_t word = 0; word < res.size(); word++)
+                res[word] &= word < slice.size() ? slice[word] : 0;
+        }
+
+        std::vector<std::string>                     names_;
+        std::unordered_map<uint32_t, TypeSlices>     types_;
+};
+
+static std::vector<SnapDev>
+ReadSnapshot(const std::string &path)
+{
+    std::vector<SnapDev> devs;
+    SnapshotReader reader {path};
+    SnapDev dev;
+    while (reader.Next(dev))
+        devs.push_back(dev);
+    return devs;
+}
+
+bool FindMigrationTargets()
+{
+    // host dumps, named after the host
+    std::vector<fs::path> host_paths;
+    for (const auto &entry : fs::directory_iterator {cmdl_opts.migrate_hosts_path_})
+        if (entry.is_regular_file())
+            host_paths.push_back(entry.path());
+    std::sort(host_paths.begin(), host_paths.end());
+
+    HostProfileIndex index;
+    for (const auto &path : host_paths)
+        index.AddHost(path.stem().string(), ReadSnapshot(path.string()));
+
+    std::unordered_map<uint32_t, uint64_t> vm_masks;
+    for (const auto &dev : ReadSnapshot(cmdl_opts.migrate_vm_path_))
+        vm_masks[dev.dev_type_] |= dev.features_;
+
+    auto hosts = index.Supersets(vm_masks);
+    uint64_t found = 0;
+    for (size_t word = 0; word < hosts.size(); word++) {
+        for (auto bits = hosts[word]; bits; bits &= bits - 1) {
+            const auto &name = index.Name(word * 64 + std::countr_zero(bits));
+            if (cmdl_opts.json_output_)
+                fmt::print("{{\"host\":\"{}\"}}\n", util::JsonEscape(name));
+            else
+                fmt::print("{}\n", name);
+            found++;
+        }
+    }
+
+    if (!cmdl_opts.json_output_)
+        fmt::print("{} of {} hosts offer all features negotiated by the VM\n", found, index.Size());
+
+    return found != 0;
+}
+
+} // namespace snapshot
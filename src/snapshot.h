@@ -0,0 +1,28 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2025 Petr Vyazovik <xen@f-m.fm>
+
+#pragma once
+
+#include "config.h"
+
+// Device snapshots: one tab-separated line per device
+// (name, type, status, features, aux info, parent device), preceded by
+// a "# virtio-info snapshot v1" line. Snapshots are compared with a
+// single hash join: the old one is loaded into memory, the new one is
+// streamed and only the differences are printed. Snapshots of a fleet
+// of hosts are indexed by feature bit to find live migration targets.
+namespace snapshot {
+
+// Dump current devices to a snapshot file (or stdout)
+void WriteDevSnapshot();
+
+// Print devices which appeared, disappeared or changed between two
+// snapshots. Returns false if there are any differences.
+bool CompareDevSnapshots();
+
+// Print hosts (one snapshot per host in a directory) whose features
+// per device type are a superset of the VM's ones, i.e. which can take
+// the VM without losing features. Returns false if there are none.
+bool FindMigrationTargets();
+
+} // namespace snapshot
@@ -0,0 +1,746 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2025 Petr Vyazovik <xen@f-m.fm>
+
+#include "sysfs_source.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+
+#ifdef VI_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef VI_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace virtio {
+
+constexpr size_t tar_block_size {512};
+// anything larger is not a sysfs attribute
+constexpr uint64_t archive_file_max_size {64 * 1024};
+constexpr size_t archive_io_buf_size {128 * 1024};
+// same limit as the kernel's MAXSYMLINKS
+constexpr uint32_t symlinks_max_depth {40};
+
+[[noreturn]] static void
+ArchiveError(const std::string &archive_path, const std::string &msg)
+{
+    fmt::print("{}: {}\n", archive_path, msg);
+    throw std::runtime_error("Failed to load sysfs archive");
+}
+
+// Sequential byte source, Read() returns 0 at the end of stream
+class ArchiveStream
+{
+    public:
+        virtual ~ArchiveStream() = default;
+        virtual size_t Read(char *buf, size_t len) = 0;
+};
+
+class FileStream : public ArchiveStream
+{
+    public:
+        FileStream(const std::string &path)
+            : path_(path)
+        {
+            fd_ = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd_ < 0)
+                ArchiveError(path_, fmt::format("failed to open: {}", std::strerror(errno)));
+        }
+
+        ~FileStream() override
+        {
+            close(fd_);
+        }
+
+        size_t Read(char *buf, size_t len) override
+        {
+            auto res = read(fd_, buf, len);
+            if (res < 0)
+                ArchiveError(path_, fmt::format("read failed: {}", std::strerror(errno)));
+            return res;
+        }
+
+    private:
+        std::string path_;
+        int         fd_ {-1};
+};
+
+#ifdef VI_HAVE_ZLIB
+class GzipStream : public ArchiveStream
+{
+    public:
+        GzipStream(ArchiveStream &src, const std::string &path)
+            : src_(src), path_(path), in_buf_(archive_io_buf_size)
+        {
+            // gzip header only
+            if (inflateInit2(&zs_, 16 + MAX_WBITS) != Z_OK)
+                ArchiveError(path_, "failed to initialize zlib");
+        }
+
+        ~GzipStream() override
+        {
+            inflateEnd(&zs_);
+        }
+
+        size_t Read(char *buf, size_t len) override
+        {
+            zs_.next_out = reinterpret_cast<Bytef *>(buf);
+            zs_.avail_out = len;
+
+            while (zs_.avail_out == len && !finished_) {
+                if (zs_.avail_in == 0) {
+                    zs_.next_in = reinterpret_cast<Bytef *>(in_buf_.data());
+                    zs_.avail_in = src_.Read(in_buf_.data(), in_buf_.size());
+                    if (zs_.avail_in == 0) {
+                        if (!member_done_)
+                            ArchiveError(path_, "truncated gzip stream");
+                        finished_ = true;
+                        break;
+                    }
+                }
+
+                member_done_ = false;
+                auto ret = inflate(&zs_, Z_NO_FLUSH);
+                if (ret == Z_STREAM_END) {
+                    // there may be another gzip member after this one
+                    member_done_ = true;
+                    inflateReset(&zs_);
+                } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+                    ArchiveError(path_, fmt::format("gzip: {}", zs_.msg ? zs_.msg : "corrupted data"));
+                }
+            }
+
+            return len - zs_.avail_out;
+        }
+
+    private:
+        ArchiveStream     &src_;
+        std::string        path_;
+        std::vector<char>  in_buf_;
+        z_stream           zs_ {};
+        bool               member_done_ {false};
+        bool               finished_ {false};
+};
+#endif
+
+#ifdef VI_HAVE_ZSTD
+class ZstdStream : public ArchiveStream
+{
+    public:
+        ZstdStream(ArchiveStream &src, const std::string &path)
+            : src_(src), path_(path), in_buf_(ZSTD_DStreamInSize())
+        {
+            dctx_ = ZSTD_createDCtx();
+            if (dctx_ == nullptr)
+                ArchiveError(path_, "failed to initialize zstd");
+        }
+
+        ~ZstdStream() override
+        {
+            ZSTD_freeDCtx(dctx_);
+        }
+
+        size_t Read(char *buf, size_t len) override
+        {
+            ZSTD_outBuffer out {buf, len, 0};
+
+            while (out.pos == 0) {
+                if (in_.pos == in_.size) {
+                    auto read = src_.Read(in_buf_.data(), in_buf_.size());
+                    if (read == 0) {
+                        if (frame_pending_)
+                            ArchiveError(path_, "truncated zstd stream");
+                        break;
+                    }
+                    in_ = {in_buf_.data(), read, 0};
+                }
+
+                auto ret = ZSTD_decompressStream(dctx_, &out, &in_);
+                if (ZSTD_isError(ret))
+                    ArchiveError(path_, fmt::format("zstd: {}", ZSTD_getErrorName(ret)));
+                frame_pending_ = ret != 0;
+            }
+
+            return out.pos;
+        }
+
+    private:
+        ArchiveStream     &src_;
+        std::string        path_;
+        std::vector<char>  in_buf_;
+        ZSTD_inBuffer      in_ {nullptr, 0, 0};
+        ZSTD_DCtx         *dctx_ {nullptr};
+        bool               frame_pending_ {false};
+};
+#endif
+
+enum class ArchiveNodeType
+{
+    file,
+    dir,
+    symlink,
+    // resolved into a file once the whole archive is loaded
+    hardlink
+};
+
+struct ArchiveNode
+{
+    ArchiveNodeType type_;
+    // file contents or link target
+    std::string     data_;
+};
+
+// Normalize archive member name into an absolute sysfs path:
+// "sys/...", "./sys/..." and "<top dir>/sys/..." are accepted,
+// empty string is returned for anything else
+static std::string
+SysfsPathFromMember(std::string_view name)
+{
+    std::vector<std::string_view> comps;
+    while (!name.empty()) {
+        auto end = name.find('/');
+        auto comp = name.substr(0, end);
+        if (!comp.empty() && comp != ".")
+            comps.push_back(comp);
+        if (end == std::string_view::npos)
+            break;
+        name.remove_prefix(end + 1);
+    }
+
+    for (size_t idx = 0; idx < comps.size() && idx < 2; idx++) {
+        if (comps[idx] != "sys")
+            continue;
+
+        std::string path;
+        for (; idx < comps.size(); idx++) {
+            path += '/';
+            path += comps[idx];
+        }
+        return path;
+    }
+
+    return {};
+}
+
+// Directory of a capture, which can't go away
+class ArchiveSysfsDir : public SysfsDir
+{
+    public:
+        ArchiveSysfsDir(const SysfsSource &sysfs, const fs::path &path)
+            : sysfs_(sysfs), path_(path)
+        {}
+
+        std::optional<std::string> ReadAttr(std::string_view name) const override
+        {
+            return sysfs_.ReadAttr(path_ / name);
+        }
+
+        std::optional<std::vector<std::string>> ListDir(std::string_view name) const override
+        {
+            return sysfs_.ListDir(path_ / name);
+        }
+
+        bool Removed() const override { return false; }
+
+    private:
+        const SysfsSource &sysfs_;
+        fs::path           path_;
+};
+
+// In-memory sysfs capture
+class ArchiveSysfs : public SysfsSource
+{
+    public:
+        bool IsLive() const override { return false; }
+
+        std::optional<std::string> ReadAttr(const fs::path &path) const override
+        {
+            auto contents = ReadFile(path);
+            if (contents.has_value())
+                contents->resize(std::min(contents->find('\n'), contents->size()));
+            return contents;
+        }
+
+        std::optional<std::string> ReadFile(const fs::path &path) const override
+        {
+            auto node = FindNode(path, true);
+            if (node == nullptr || node->type_ != ArchiveNodeType::file)
+                return std::nullopt;
+            return node->data_;
+        }
+
+        std::optional<std::vector<std::string>> ListDir(const fs::path &path) const override
+        {
+            auto resolved = Resolve(path.string(), true);
+            if (!resolved.has_value())
+                return std::nullopt;
+
+            auto it = children_.find(resolved.value());
+            if (it != children_.end())
+                return it->second;
+
+            auto node = nodes_.find(resolved.value());
+            if (node != nodes_.end() && node->second.type_ == ArchiveNodeType::dir)
+                return std::vector<std::string> {};
+
+            return std::nullopt;
+        }
+
+        bool Exists(const fs::path &path) const override
+        {
+            return Resolve(path.string(), true).has_value();
+        }
+
+        bool IsSymlink(const fs::path &path) const override
+        {
+            auto node = FindNode(path, false);
+            return node != nullptr && node->type_ == ArchiveNodeType::symlink;
+        }
+
+        std::optional<fs::path> ReadLink(const fs::path &path) const override
+        {
+            auto node = FindNode(path, false);
+            if (node == nullptr || node->type_ != ArchiveNodeType::symlink)
+                return std::nullopt;
+            return fs::path {node->data_};
+        }
+
+        std::optional<fs::path> Canonical(const fs::path &path) const override
+        {
+            auto resolved = Resolve(path.string(), true);
+            if (!resolved.has_value())
+                return std::nullopt;
+            return fs::path {resolved.value()};
+        }
+
+        std::unique_ptr<SysfsDir> OpenDir(const fs::path &path) const override
+        {
+            auto resolved = Resolve(path.string(), true);
+            if (!resolved.has_value() || !IsDir(resolved.value()))
+                return nullptr;
+            return std::make_unique<ArchiveSysfsDir>(*this, resolved.value());
+        }
+
+        void AddNode(std::string path, ArchiveNodeType type, std::string data)
+        {
+            nodes_.insert_or_assign(std::move(path), ArchiveNode {type, std::move(data)});
+        }
+
+        // Resolve hard links and build directory listings
+        void Finalize()
+        {
+            for (auto &[path, node] : nodes_) {
+                if (node.type_ != ArchiveNodeType::hardlink)
+                    continue;
+                auto target = nodes_.find(node.data_);
+                if (target != nodes_.end() && target->second.type_ == ArchiveNodeType::file)
+                    node = target->second;
+                else
+                    node = {ArchiveNodeType::file, {}};
+            }
+
+            std::unordered_set<std::string_view> linked;
+            for (const auto &[path, node] : nodes_) {
+                std::string_view cur {path};
+                while (cur.size() > 1 && linked.insert(cur).second) {
+                    auto sep = cur.rfind('/');
+                    auto parent = sep == 0 ? std::string_view {"/"} : cur.substr(0, sep);
+                    children_[std::string {parent}].emplace_back(cur.substr(sep + 1));
+                    cur = parent;
+                }
+            }
+        }
+
+        size_t NodesNum() const { return nodes_.size(); }
+
+    private:
+        bool IsDir(const std::string &path) const
+        {
+            if (path.empty() || children_.contains(path))
+                return true;
+            auto it = nodes_.find(path);
+            return it != nodes_.end() && it->second.type_ == ArchiveNodeType::dir;
+        }
+
+        // Walk @path component by component, expanding symlinks
+        // (the last one only if @follow_last is set)
+        std::optional<std::string> Resolve(const std::string &path, bool follow_last) const
+        {
+            // components to visit, in reverse order
+            std::vector<std::string> todo;
+            auto push_path = [&todo](std::string_view str) {
+                std::vector<std::string> comps;
+                while (!str.empty()) {
+                    auto end = str.find('/');
+                    auto comp = str.substr(0, end);
+                    if (!comp.empty() && comp != ".")
+                        comps.emplace_back(comp);
+                    if (end == std::string_view::npos)
+                        break;
+                    str.remove_prefix(end + 1);
+                }
+                todo.insert(todo.end(), comps.rbegin(), comps.rend());
+            };
+
+            push_path(path);
+            std::string cur;
+            uint32_t links = 0;
+
+            while (!todo.empty()) {
+                auto comp = std::move(todo.back());
+                todo.pop_back();
+
+                if (comp == "..") {
+                    cur.resize(cur.empty() ? 0 : cur.rfind('/'));
+                    continue;
+                }
+
+                auto next = cur + "/" + comp;
+                auto it = nodes_.find(next);
+                if (it == nodes_.end()) {
+                    // directories are not always stored as separate members
+                    if (!children_.contains(next))
+                        return std::nullopt;
+                    cur = std::move(next);
+                    continue;
+                }
+
+                if (it->second.type_ == ArchiveNodeType::symlink && (!todo.empty() || follow_last)) {
+                    if (++links > symlinks_max_depth)
+                        return std::nullopt;
+                    const auto &target = it->second.data_;
+                    if (target.starts_with('/'))
+                        cur.clear();
+                    push_path(target);
+                    continue;
+                }
+
+                if (!todo.empty() && !IsDir(next))
+                    return std::nullopt;
+                cur = std::move(next);
+            }
+
+            return cur.empty() ? "/" : cur;
+        }
+
+        const ArchiveNode *FindNode(const fs::path &path, bool follow_last) const
+        {
+            std::optional<std::string> resolved;
+            if (follow_last) {
+                resolved = Resolve(path.string(), true);
+            } else {
+                // resolve the parent only, the entry itself is looked up as is
+                auto parent = Resolve(path.parent_path().string(), true);
+                if (parent.has_value())
+                    resolved = (parent.value() == "/" ? "" : parent.value()) +
+                               "/" + path.filename().string();
+            }
+
+            if (!resolved.has_value())
+                return nullptr;
+
+            auto it = nodes_.find(resolved.value());
+            return it == nodes_.end() ? nullptr : &it->second;
+        }
+
+        std::unordered_map<std::string, ArchiveNode>              nodes_;
+        std::unordered_map<std::string, std::vector<std::string>> children_;
+};
+
+// ustar header, see POSIX pax(1)
+struct TarHeader
+{
+    char name[100];
+    char mode[8];
+    char uid[8];
+    char gid[8];
+    char size[12];
+    char mtime[12];
+    char chksum[8];
+    char typeflag;
+    char linkname[100];
+    char magic[6];
+    char version[2];
+    char uname[32];
+    char gname[32];
+    char devmajor[8];
+    char devminor[8];
+    char prefix[155];
+    char pad[12];
+};
+
+static_assert(sizeof(TarHeader) == tar_block_size);
+
+class TarReader
+{
+    public:
+        TarReader(ArchiveStream &stream, const std::string &path)
+            : stream_(stream), path_(path)
+        {}
+
+        // Load every sysfs member of the archive into @sysfs
+        void Load(ArchiveSysfs &sysfs)
+        {
+            // GNU long names and pax extended headers apply to the next member
+            std::string long_name, long_link;
+            std::array<char, tar_block_size> block;
+            uint32_t zero_blocks = 0;
+
+            for (;;) {
+                if (!ReadExact(block.data(), block.size())) {
+                    if (zero_blocks == 0 && members_ == 0)
+                        ArchiveError(path_, "empty archive");
+                    // missing end-of-archive marker is tolerated
+                    return;
+                }
+
+                if (IsZeroBlock(block)) {
+                    if (++zero_blocks == 2)
+                        return;
+                    continue;
+                }
+                zero_blocks = 0;
+
+                TarHeader hdr;
+                std::memcpy(&hdr, block.data(), sizeof(hdr));
+                if (!ChecksumValid(hdr, block))
+                    ArchiveError(path_, fmt::format("bad tar header checksum after {} members", members_));
+
+                members_++;
+                auto size = ParseNumber(hdr.size, sizeof(hdr.size));
+
+                switch (hdr.typeflag) {
+                case 'L':
+                    long_name = ReadData(size);
+                    long_name.resize(std::strlen(long_name.c_str()));
+                    continue;
+                case 'K':
+                    long_link = ReadData(size);
+                    long_link.resize(std::strlen(long_link.c_str()));
+                    continue;
+                case 'x':
+                    ParsePaxHeader(ReadData(size), long_name, long_link);
+                    continue;
+                default:
+                    break;
+                }
+
+                auto name = long_name.empty() ? MemberName(hdr) : long_name;
+                auto link = long_link.empty() ? FieldString(hdr.linkname, sizeof(hdr.linkname))
+                                              : long_link;
+                long_name.clear();
+                long_link.clear();
+
+                auto sysfs_path = SysfsPathFromMember(name);
+                if (sysfs_path.empty()) {
+                    SkipData(size);
+                    continue;
+                }
+
+                switch (hdr.typeflag) {
+                case '0':
+                case '\0':
+                case '7':
+                    if (size > archive_file_max_size) {
+                        SkipData(size);
+                        break;
+                    }
+                    sysfs.AddNode(std::move(sysfs_path), ArchiveNodeType::file, ReadData(size));
+                    break;
+                case '1':
+                    sysfs.AddNode(std::move(sysfs_path), ArchiveNodeType::hardlink,
+                                  SysfsPathFromMember(link));
+                    SkipData(size);
+                    break;
+                case '2':
+                    sysfs.AddNode(std::move(sysfs_path), ArchiveNodeType::symlink, link);
+                    SkipData(size);
+                    break;
+                case '5':
+                    sysfs.AddNode(std::move(sysfs_path), ArchiveNodeType::dir, {});
+                    SkipData(size);
+                    break;
+                default:
+                    // devices, fifos, global pax headers, ...
+                    SkipData(size);
+                    break;
+                }
+            }
+        }
+
+    private:
+        bool ReadExact(char *buf, size_t len)
+        {
+            size_t done = 0;
+            while (done < len) {
+                auto read = stream_.Read(buf + done, len - done);
+                if (read == 0) {
+                    if (done != 0)
+                        ArchiveError(path_, "truncated archive");
+                    return false;
+                }
+                done += read;
+            }
+            return true;
+        }
+
+        static size_t Padded(const uint64_t size)
+        {
+            return (size + tar_block_size - 1) / tar_block_size * tar_block_size;
+        }
+
+        std::string ReadData(const uint64_t size)
+        {
+            std::string data(Padded(size), '\0');
+            if (!data.empty() && !ReadExact(data.data(), data.size()))
+                ArchiveError(path_, "truncated archive");
+            data.resize(size);
+            return data;
+        }
+
+        void SkipData(const uint64_t size)
+        {
+            std::array<char, tar_block_size * 16> buf;
+            for (auto left = Padded(size); left; ) {
+                auto chunk = std::min(left, buf.size());
+                if (!ReadExact(buf.data(), chunk))
+                    ArchiveError(path_, "truncated archive");
+                left -= chunk;
+            }
+        }
+
+        static bool IsZeroBlock(const std::array<char, tar_block_size> &block)
+        {
+            return std::all_of(block.begin(), block.end(), [](char c) { return c == 0; });
+        }
+
+        static bool ChecksumValid(const TarHeader &hdr, const std::array<char, tar_block_size> &block)
+        {
+            uint64_t sum = 0;
+            for (size_t i = 0; i < block.size(); i++) {
+                bool in_chksum = i >= offsetof(TarHeader, chksum) &&
+                                 i < offsetof(TarHeader, chksum) + sizeof(hdr.chksum);
+                sum += in_chksum ? ' ' : static_cast<unsigned char>(block[i]);
+            }
+            return sum == ParseNumber(hdr.chksum, sizeof(hdr.chksum));
+        }
+
+        // octal, or base-256 (GNU) if the high bit of the first byte is set
+        static uint64_t ParseNumber(const char *field, const size_t len)
+        {
+            uint64_t val = 0;
+
+            if (static_cast<unsigned char>(field[0]) & 0x80) {
+                for (size_t i = 1; i < len; i++)
+                    val = (val << 8) | static_cast<unsigned char>(field[i]);
+                return val;
+            }
+
+            for (size_t i = 0; i < len && field[i]; i++) {
+                if (field[i] == ' ')
+                    continue;
+                if (field[i] < '0' || field[i] > '7')
+                    break;
+                val = (val << 3) | static_cast<uint64_t>(field[i] - '0');
+            }
+            return val;
+        }
+
+        static std::string FieldString(const char *field, const size_t len)
+        {
+            return std::string {field, strnlen(field, len)};
+        }
+
+        static std::string MemberName(const TarHeader &hdr)
+        {
+            auto name = FieldString(hdr.name, sizeof(hdr.name));
+            if (std::memcmp(hdr.magic, "ustar", 5) == 0 && hdr.prefix[0])
+                name = FieldString(hdr.prefix, sizeof(hdr.prefix)) + "/" + name;
+            return name;
+        }
+
+        // "<len> <key>=<value>\n" records
+        static void ParsePaxHeader(std::string_view data, std::string &name, std::string &link)
+        {
+            while (!data.empty()) {
+                auto space = data.find(' ');
+                if (space == std::string_view::npos)
+                    return;
+
+                size_t rec_len = 0;
+                for (auto c : data.substr(0, space))
+                    rec_len = rec_len * 10 + static_cast<size_t>(c - '0');
+                if (rec_len <= space + 1 || rec_len > data.size())
+                    return;
+
+                auto record = data.substr(space + 1, rec_len - space - 2);
+                auto eq = record.find('=');
+                if (eq != std::string_view::npos) {
+                    auto key = record.substr(0, eq);
+                    if (key == "path")
+                        name = record.substr(eq + 1);
+                    else if (key == "linkpath")
+                        link = record.substr(eq + 1);
+                }
+
+                data.remove_prefix(rec_len);
+            }
+        }
+
+        ArchiveStream     &stream_;
+        const std::string &path_;
+        uint64_t           members_ {0};
+};
+
+std::unique_ptr<SysfsSource> LoadSysfsArchive(const std::string &archive_path)
+{
+    // detect compression by magic rather than by extension
+    std::array<unsigned char, 4> magic {};
+    {
+        FileStream probe {archive_path};
+        probe.Read(reinterpret_cast<char *>(magic.data()), magic.size());
+    }
+
+    FileStream file {archive_path};
+    std::unique_ptr<ArchiveStream> decoder;
+
+    if (magic[0] == 0x1f && magic[1] == 0x8b) {
+#ifdef VI_HAVE_ZLIB
+        decoder = std::make_unique<GzipStream>(file, archive_path);
+#else
+        ArchiveError(archive_path, "gzip compressed archives are not supported by this build");
+#endif
+    } else if (magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd) {
+#ifdef VI_HAVE_ZSTD
+        decoder = std::make_unique<ZstdStream>(file, archive_path);
+#else
+        ArchiveError(archive_path, "zstd compressed archives are not supported by this build");
+#endif
+    }
+
+    auto sysfs = std::make_unique<ArchiveSysfs>();
+    TarReader reader {decoder ? *decoder : static_cast<ArchiveStream &>(file), archive_path};
+    reader.Load(*sysfs);
+    sysfs->Finalize();
+
+    if (!sysfs->Exists("/sys"))
+        ArchiveError(archive_path, "no sysfs capture found in the archive");
+
+    return sysfs;
+}
+
+} // namespace virtio
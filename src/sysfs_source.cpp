@@ -0,0 +1,233 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2025 Petr Vyazovik <xen@f-m.fm>
+
+#include "sysfs_source.h"
+#include "instrument.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <system_error>
+
+namespace fs = std::filesystem;
+
+namespace virtio {
+
+// sysfs attributes are at most a page long
+constexpr size_t sysfs_attr_max_len {4096};
+
+static std::optional<std::string>
+ReadFd(int fd)
+{
+    VI_PHASE_SCOPE(attr_read);
+
+    std::string contents;
+    std::array<char, sysfs_attr_max_len> buf;
+    ssize_t len;
+    do {
+        VI_COUNT_CALL(read);
+        len = read(fd, buf.data(), buf.size());
+        if (len > 0)
+            contents.append(buf.data(), len);
+    } while (len > 0);
+
+    if (len < 0)
+        return std::nullopt;
+    return contents;
+}
+
+static int
+OpenAttr(int dir_fd, const char *path)
+{
+    VI_PHASE_SCOPE(attr_open);
+    VI_COUNT_CALL(open);
+    return openat(dir_fd, path, O_RDONLY | O_CLOEXEC);
+}
+
+static void
+CloseFd(int fd)
+{
+    VI_COUNT_CALL(close);
+    close(fd);
+}
+
+// Plain readdir: a directory removed while it's being read (hotplug)
+// just ends the listing early, nothing throws
+static std::optional<std::vector<std::string>>
+ReadDirEntries(int dir_fd, const char *path)
+{
+    VI_COUNT_CALL(open);
+    int fd = openat(dir_fd, path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0)
+        return std::nullopt;
+
+    DIR *dir = fdopendir(fd);
+    if (dir == nullptr) {
+        CloseFd(fd);
+        return std::nullopt;
+    }
+
+    std::vector<std::string> entries;
+    while (true) {
+        VI_COUNT_CALL(readdir);
+        auto *entry = readdir(dir);
+        if (entry == nullptr)
+            break;
+        std::string_view entry_name {entry->d_name};
+        if (entry_name != "." && entry_name != "..")
+            entries.emplace_back(entry_name);
+    }
+    VI_COUNT_CALL(close);
+    closedir(dir);
+
+    return entries;
+}
+
+class LiveSysfsDir : public SysfsDir
+{
+    public:
+        LiveSysfsDir(const fs::path &path, int fd, const struct stat &st)
+            : path_(path), fd_(fd), dev_(st.st_dev), ino_(st.st_ino)
+        {}
+
+        ~LiveSysfsDir() override
+        {
+            CloseFd(fd_);
+        }
+
+        std::optional<std::string> ReadAttr(std::string_view name) const override
+        {
+            int fd = OpenAttr(fd_, std::string {name}.c_str());
+            if (fd < 0)
+                return std::nullopt;
+
+            auto contents = ReadFd(fd);
+            CloseFd(fd);
+            if (contents.has_value())
+                contents->resize(std::min(contents->find('\n'), contents->size()));
+            return contents;
+        }
+
+        std::optional<std::vector<std::string>> ListDir(std::string_view name) const override
+        {
+            return ReadDirEntries(fd_, std::string {name}.c_str());
+        }
+
+        bool Removed() const override
+        {
+            // kernfs keeps inode numbers unique while the node exists
+            VI_COUNT_CALL(stat);
+            struct stat st;
+            return stat(path_.c_str(), &st) != 0 || st.st_dev != dev_ || st.st_ino != ino_;
+        }
+
+    private:
+        fs::path path_;
+        int      fd_;
+        dev_t    dev_;
+        ino_t    ino_;
+};
+
+class LiveSysfs : public SysfsSource
+{
+    public:
+        bool IsLive() const override { return true; }
+
+        std::optional<std::string> ReadAttr(const fs::path &path) const override
+        {
+            auto contents = ReadFile(path);
+            if (contents.has_value())
+                contents->resize(std::min(contents->find('\n'), contents->size()));
+            return contents;
+        }
+
+        std::optional<std::string> ReadFile(const fs::path &path) const override
+        {
+            int fd = OpenAttr(AT_FDCWD, path.c_str());
+            if (fd < 0)
+                return std::nullopt;
+
+            auto contents = ReadFd(fd);
+            CloseFd(fd);
+            return contents;
+        }
+
+        std::optional<std::vector<std::string>> ListDir(const fs::path &path) const override
+        {
+            return ReadDirEntries(AT_FDCWD, path.c_str());
+        }
+
+        bool Exists(const fs::path &path) const override
+        {
+            VI_COUNT_CALL(stat);
+            std::error_code ec;
+            return fs::exists(path, ec);
+        }
+
+        bool IsSymlink(const fs::path &path) const override
+        {
+            VI_COUNT_CALL(stat);
+            std::error_code ec;
+            return fs::is_symlink(path, ec);
+        }
+
+        std::optional<fs::path> ReadLink(const fs::path &path) const override
+        {
+            VI_COUNT_CALL(readlink);
+            std::error_code ec;
+            auto target = fs::read_symlink(path, ec);
+            if (ec)
+                return std::nullopt;
+            return target;
+        }
+
+        std::optional<fs::path> Canonical(const fs::path &path) const override
+        {
+            VI_COUNT_CALL(canonical);
+            std::error_code ec;
+            auto resolved = fs::canonical(path, ec);
+            if (ec)
+                return std::nullopt;
+            return resolved;
+        }
+
+        std::unique_ptr<SysfsDir> OpenDir(const fs::path &path) const override
+        {
+            VI_COUNT_CALL(open);
+            int fd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            if (fd < 0)
+                return nullptr;
+
+            VI_COUNT_CALL(stat);
+            struct stat st;
+            if (fstat(fd, &st) != 0) {
+                CloseFd(fd);
+                return nullptr;
+            }
+
+            return std::make_unique<LiveSysfsDir>(path, fd, st);
+        }
+};
+
+static std::unique_ptr<SysfsSource> &
+ActiveSysfsPtr()
+{
+    static std::unique_ptr<SysfsSource> source {std::make_unique<LiveSysfs>()};
+    return source;
+}
+
+const SysfsSource &ActiveSysfs()
+{
+    return *ActiveSysfsPtr();
+}
+
+void SetActiveSysfs(std::unique_ptr<SysfsSource> source)
+{
+    ActiveSysfsPtr() = std::move(source);
+}
+
+} // namespace virtio
@@ -0,0 +1,73 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2025 Petr Vyazovik <xen@f-m.fm>
+
+#pragma once
+
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace virtio {
+
+// Pinned sysfs directory: attributes are read relative to the directory
+// that was opened, even if its path is removed or reused meanwhile
+class SysfsDir
+{
+    public:
+        virtual ~SysfsDir() = default;
+
+        // first line of the attribute (w/o newline), nullopt if missing
+        virtual std::optional<std::string> ReadAttr(std::string_view name) const = 0;
+        // entries of a subdirectory, nullopt if missing
+        virtual std::optional<std::vector<std::string>> ListDir(std::string_view name) const = 0;
+        // true if the path no longer leads to the pinned directory
+        virtual bool Removed() const = 0;
+};
+
+// Read-only view of the sysfs tree the bus layer works on: either the
+// running system or a capture loaded from an archive. Paths are always
+// absolute sysfs paths, e.g. /sys/bus/virtio/devices/virtio0/features.
+class SysfsSource
+{
+    public:
+        virtual ~SysfsSource() = default;
+
+        // false for captures, i.e. there is no kernel to query
+        virtual bool IsLive() const = 0;
+
+        // first line of the attribute (w/o newline), nullopt if missing
+        virtual std::optional<std::string> ReadAttr(const std::filesystem::path &path) const = 0;
+        // whole contents of a (binary) attribute, e.g. PCI config space
+        virtual std::optional<std::string> ReadFile(const std::filesystem::path &path) const = 0;
+
+        // entry names, nullopt if @path is not a directory
+        virtual std::optional<std::vector<std::string>>
+        ListDir(const std::filesystem::path &path) const = 0;
+
+        virtual bool Exists(const std::filesystem::path &path) const = 0;
+        virtual bool IsSymlink(const std::filesystem::path &path) const = 0;
+        // target of the symlink as stored, nullopt if not a symlink
+        virtual std::optional<std::filesystem::path>
+        ReadLink(const std::filesystem::path &path) const = 0;
+        // @path with all symlinks resolved, nullopt if it doesn't exist
+        virtual std::optional<std::filesystem::path>
+        Canonical(const std::filesystem::path &path) const = 0;
+
+        // nullptr if @path is not a directory (anymore)
+        virtual std::unique_ptr<SysfsDir> OpenDir(const std::filesystem::path &path) const = 0;
+};
+
+// Source used by the bus layer, the running system by default
+const SysfsSource &ActiveSysfs();
+void SetActiveSysfs(std::unique_ptr<SysfsSource> source);
+
+// Load sysfs capture from a tar archive (plain, gzip or zstd compressed).
+// The archive is read in a single pass; only sysfs attributes, directories
+// and symlinks are kept in memory. The capture may be rooted either at
+// "sys/" or at a single top-level directory, as sosreport does.
+std::unique_ptr<SysfsSource> LoadSysfsArchive(const std::string &archive_path);
+
+} // namespace virtio
@@ -0,0 +1,572 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2025 Petr Vyazovik <xen@f-m.fm>
+
+#include "throughput.h"
+#include "util.h"
+#include "virtio_bus.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <ctime>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "magic_enum/magic_enum.hpp"
+
+extern cfg::CmdLOpts cmdl_opts;
+
+namespace throughput {
+
+namespace fs = std::filesystem;
+
+constexpr std::string_view net_class_path {"/sys/class/net"};
+constexpr std::string_view block_path {"/sys/block"};
+constexpr std::string_view vmstat_path {"/proc/vmstat"};
+constexpr std::string_view meminfo_path {"/proc/meminfo"};
+constexpr uint64_t ns_per_sec {1000000000};
+// disk stats count 512-byte sectors regardless of the logical block size
+constexpr uint64_t sector_size {512};
+
+// files in /sys/class/net/<iface>/statistics/
+enum class NetStat
+{
+    rx_bytes,
+    tx_bytes,
+    rx_packets,
+    tx_packets,
+    rx_dropped,
+    tx_dropped
+};
+
+// fields of /sys/block/<disk>/stat, see Documentation/block/stat.rst
+enum class BlkStat
+{
+    read_ios,
+    read_merges,
+    read_sectors,
+    read_ticks,
+    write_ios,
+    write_merges,
+    write_sectors,
+    write_ticks,
+    in_flight,
+    io_ticks,
+    time_in_queue
+};
+
+// balloon counters in /proc/vmstat (pages)
+enum class VmStat
+{
+    balloon_inflate,
+    balloon_deflate,
+    balloon_migrate,
+    nr_balloon_pages
+};
+
+// fields of /proc/meminfo (kB)
+enum class MemInfo
+{
+    MemTotal,
+    MemAvailable,
+    Balloon
+};
+
+enum class DevKind
+{
+    net,
+    blk
+};
+
+// Device being sampled: counter files stay open, each tick is a pread()
+// per file from offset 0
+struct SampledDev
+{
+    std::string           name_;
+    std::string           aux_info_;
+    DevKind               kind_ {DevKind::net};
+    std::vector<int>      fds_;
+    std::vector<uint64_t> prev_;
+    std::vector<uint64_t> cur_;
+    // counters couldn't be read on the last tick
+    bool                  gone_ {false};
+
+    SampledDev() = default;
+    SampledDev(SampledDev &&other) noexcept = default;
+    SampledDev &operator=(SampledDev &&other) noexcept = default;
+
+    ~SampledDev()
+    {
+        for (auto fd : fds_)
+            if (fd >= 0)
+                close(fd);
+    }
+};
+
+static std::string_view
+ReadCounterFile(const int fd, std::array<char, 512> &buf)
+{
+    auto len = pread(fd, buf.data(), buf.size(), 0);
+    return len > 0 ? std::string_view {buf.data(), static_cast<size_t>(len)} : std::string_view {};
+}
+
+// Whitespace separated decimal counters, false if fewer than @vals
+static bool
+ParseCounters(std::string_view buf, uint64_t *vals, const size_t num)
+{
+    auto *ptr = buf.data();
+    auto *end = buf.data() + buf.size();
+
+    for (size_t i = 0; i < num; i++) {
+        while (ptr < end && (*ptr == ' ' || *ptr == '\t' || *ptr == '\n'))
+            ptr++;
+        auto res = std::from_chars(ptr, end, vals[i]);
+        if (res.ec != std::errc {})
+            return false;
+        ptr = res.ptr;
+    }
+
+    return true;
+}
+
+static bool
+OpenCounters(SampledDev &dev)
+{
+    std::vector<fs::path> paths;
+    size_t counters_num;
+
+    if (dev.kind_ == DevKind::net) {
+        auto stats_dir = fs::path {net_class_path} / dev.aux_info_ / "statistics";
+        for (auto stat : magic_enum::enum_values<NetStat>())
+            paths.push_back(stats_dir / magic_enum::enum_name(stat));
+        counters_num = paths.size();
+    } else {
+        // aux info is the device node, e.g. /dev/vda
+        auto disk = fs::path {dev.aux_info_}.filename();
+        paths.push_back(fs::path {block_path} / disk / "stat");
+        counters_num = magic_enum::enum_count<BlkStat>();
+    }
+
+    for (const auto &path : paths) {
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            fmt::print(stderr, "Skipping {}: failed to open {}\n", dev.name_, path.c_str());
+            return false;
+        }
+        dev.fds_.push_back(fd);
+    }
+
+    dev.prev_.assign(counters_num, 0);
+    dev.cur_.assign(counters_num, 0);
+    return true;
+}
+
+// One batched pass over every open counter file
+static void
+ReadAllCounters(std::vector<SampledDev> &devs)
+{
+    std::array<char, 512> buf;
+
+    for (auto &dev : devs) {
+        dev.prev_.swap(dev.cur_);
+        dev.gone_ = false;
+
+        if (dev.kind_ == DevKind::blk) {
+            dev.gone_ = !ParseCounters(ReadCounterFile(dev.fds_[0], buf),
+                                       dev.cur_.data(), dev.cur_.size());
+            continue;
+        }
+
+        for (size_t i = 0; i < dev.fds_.size() && !dev.gone_; i++)
+            dev.gone_ = !ParseCounters(ReadCounterFile(dev.fds_[i], buf), &dev.cur_[i], 1);
+    }
+}
+
+// counters may be reset (e.g. interface re-created), don't report
+// a wrapped around delta
+static uint64_t
+Delta(const SampledDev &dev, const size_t idx)
+{
+    return dev.cur_[idx] >= dev.prev_[idx] ? dev.cur_[idx] - dev.prev_[idx] : 0;
+}
+
+// 1234567 -> "1.23M"
+static std::string
+Scaled(double val)
+{
+    constexpr std::array<std::string_view, 5> prefixes {"", "k", "M", "G", "T"};
+    size_t prefix = 0;
+    while (val >= 1000.0 && prefix + 1 < prefixes.size()) {
+        val /= 1000.0;
+        prefix++;
+    }
+    return fmt::format("{:.{}f}{}", val, prefix ? 2 : 0, prefixes[prefix]);
+}
+
+static void
+PrintNetRates(const SampledDev &dev, const double secs, const uint64_t ts_ns)
+{
+    auto rate = [&](const NetStat stat) {
+        return Delta(dev, e_to_type(stat)) / secs;
+    };
+
+    if (cmdl_opts.json_output_) {
+        fmt::print("{{\"ts_ns\":{},\"name\":\"{}\",\"aux\":\"{}\",\"kind\":\"net\","
+                   "\"rx_bps\":{:.0f},\"tx_bps\":{:.0f},\"rx_pps\":{:.0f},\"tx_pps\":{:.0f},"
+                   "\"rx_drop_ps\":{:.0f},\"tx_drop_ps\":{:.0f}}}\n",
+                   ts_ns, dev.name_, dev.aux_info_,
+                   rate(NetStat::rx_bytes) * 8, rate(NetStat::tx_bytes) * 8,
+                   rate(NetStat::rx_packets), rate(NetStat::tx_packets),
+                   rate(NetStat::rx_dropped), rate(NetStat::tx_dropped));
+        return;
+    }
+
+    std::string drops;
+    if (Delta(dev, e_to_type(NetStat::rx_dropped)) || Delta(dev, e_to_type(NetStat::tx_dropped)))
+        drops = fmt::format("  drops {}/s rx {}/s tx",
+                            Scaled(rate(NetStat::rx_dropped)), Scaled(rate(NetStat::tx_dropped)));
+
+    fmt::print("{:<10} {:<10} rx {:>9}bit/s {:>8}pps  tx {:>9}bit/s {:>8}pps{}\n",
+               dev.name_, dev.aux_info_,
+               Scaled(rate(NetStat::rx_bytes) * 8), Scaled(rate(NetStat::rx_packets)),
+               Scaled(rate(NetStat::tx_bytes) * 8), Scaled(rate(NetStat::tx_packets)), drops);
+}
+
+static void
+PrintBlkRates(const SampledDev &dev, const double secs, const uint64_t ts_ns)
+{
+    auto delta = [&](const BlkStat stat) {
+        return Delta(dev, e_to_type(stat));
+    };
+
+    auto ios = delta(BlkStat::read_ios) + delta(BlkStat::write_ios);
+    // ticks are ms spent by all requests, so this is the mean service time
+    double avg_lat_ms = ios ? static_cast<double>(delta(BlkStat::read_ticks) +
+                                                  delta(BlkStat::write_ticks)) / ios
+                            : 0.0;
+    double util = std::min(100.0, delta(BlkStat::io_ticks) / 10.0 / secs);
+    double read_bps = delta(BlkStat::read_sectors) * sector_size / secs;
+    double write_bps = delta(BlkStat::write_sectors) * sector_size / secs;
+
+    if (cmdl_opts.json_output_) {
+        fmt::print("{{\"ts_ns\":{},\"name\":\"{}\",\"aux\":\"{}\",\"kind\":\"blk\","
+                   "\"read_iops\":{:.0f},\"write_iops\":{:.0f},\"read_Bps\":{:.0f},"
+                   "\"write_Bps\":{:.0f},\"avg_lat_ms\":{:.3f},\"in_flight\":{},\"util_pct\":{:.1f}}}\n",
+                   ts_ns, dev.name_, dev.aux_info_,
+                   delta(BlkStat::read_ios) / secs, delta(BlkStat::write_ios) / secs,
+                   read_bps, write_bps, avg_lat_ms,
+                   dev.cur_[e_to_type(BlkStat::in_flight)], util);
+        return;
+    }
+
+    fmt::print("{:<10} {:<10} {:>8} IOPS (r {} w {})  r {}B/s w {}B/s  {:.3f} ms avg  util {:.0f}%\n",
+               dev.name_, dev.aux_info_, Scaled(ios / secs),
+               Scaled(delta(BlkStat::read_ios) / secs), Scaled(delta(BlkStat::write_ios) / secs),
+               Scaled(read_bps), Scaled(write_bps), avg_lat_ms, util);
+}
+
+static std::vector<SampledDev>
+OpenSampledDevs()
+{
+    std::vector<SampledDev> devs;
+
+    for (const auto &[name, desc] : virtio::GetVirtioDevMap()) {
+        SampledDev dev;
+        if (desc.dev_type_ == virtio::VirtIODevType::network_card)
+            dev.kind_ = DevKind::net;
+        else if (desc.dev_type_ == virtio::VirtIODevType::block)
+            dev.kind_ = DevKind::blk;
+        else
+            continue;
+
+        // driver is not bound (yet), nothing to sample
+        if (desc.aux_info_.empty() || desc.aux_info_ == "/dev/")
+            continue;
+
+        dev.name_ = name;
+        dev.aux_info_ = desc.aux_info_;
+        if (OpenCounters(dev))
+            devs.push_back(std::move(dev));
+    }
+
+    std::sort(devs.begin(), devs.end(), [](const SampledDev &lhs, const SampledDev &rhs) {
+        return virtio::DevNameNaturalLess(lhs.name_, rhs.name_);
+    });
+    return devs;
+}
+
+// Call @sample every --sample-interval with the seconds elapsed since
+// the previous call, until interrupted or --samples reports were printed
+template <typename F>
+static void
+SampleLoop(F sample)
+{
+    util::CatchStopSignals();
+
+    auto interval_ns = static_cast<uint64_t>(cmdl_opts.sample_interval_ms_) * 1000000;
+
+    auto prev_ns = util::NowNs();
+    // absolute deadlines, so that printing doesn't make ticks drift
+    auto deadline_ns = prev_ns;
+
+    for (uint32_t reports = 0; !util::StopRequested();) {
+        deadline_ns += interval_ns;
+        const struct timespec deadline {
+            static_cast<time_t>(deadline_ns / ns_per_sec),
+            static_cast<long>(deadline_ns % ns_per_sec)
+        };
+        if (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, nullptr) != 0)
+            continue;
+
+        auto now_ns = util::NowNs();
+        sample(static_cast<double>(now_ns - prev_ns) / ns_per_sec, now_ns);
+        prev_ns = now_ns;
+        std::fflush(stdout);
+
+        if (cmdl_opts.samples_num_ && ++reports == cmdl_opts.samples_num_)
+            break;
+    }
+}
+
+void SampleDevThroughput()
+{
+    auto devs = OpenSampledDevs();
+    if (devs.empty()) {
+        fmt::print("No network or block VirtIO devices with a bound driver found\n");
+        return;
+    }
+
+    ReadAllCounters(devs);
+
+    SampleLoop([&devs](const double secs, const uint64_t now_ns) {
+        ReadAllCounters(devs);
+
+        if (!cmdl_opts.json_output_ && devs.size() > 1)
+            fmt::print("\n");
+
+        for (const auto &dev : devs) {
+            if (dev.gone_) {
+                if (!cmdl_opts.json_output_)
+                    fmt::print("{:<10} {:<10} gone\n", dev.name_, dev.aux_info_);
+                continue;
+            }
+            if (dev.kind_ == DevKind::net)
+                PrintNetRates(dev, secs, now_ns);
+            else
+                PrintBlkRates(dev, secs, now_ns);
+        }
+    });
+}
+
+// "<key> <value>" (vmstat) or "<key>: <value> kB" (meminfo) lines;
+// fields of @vals are set for the keys which were found
+template <typename E>
+static void
+ParseKeyedCounters(std::string_view buf, std::array<std::optional<uint64_t>, magic_enum::enum_count<E>()> &vals)
+{
+    vals.fill(std::nullopt);
+
+    while (!buf.empty()) {
+        auto eol = buf.find('\n');
+        auto line = buf.substr(0, eol);
+        buf = eol == std::string_view::npos ? std::string_view {} : buf.substr(eol + 1);
+
+        auto key_end = line.find_first_of(" :");
+        if (key_end == std::string_view::npos)
+            continue;
+
+        auto key = magic_enum::enum_cast<E>(line.substr(0, key_end));
+        if (!key.has_value())
+            continue;
+
+        auto val_start = line.find_first_not_of(" :", key_end);
+        uint64_t val;
+        if (val_start != std::string_view::npos && ParseCounters(line.substr(val_start), &val, 1))
+            vals[e_to_type(key.value())] = val;
+    }
+}
+
+// Whole /proc file, kept open and re-read from offset 0
+class ProcFile
+{
+    public:
+        explicit ProcFile(std::string_view path)
+            : fd_(open(std::string {path}.c_str(), O_RDONLY | O_CLOEXEC))
+        {
+            if (fd_ < 0) {
+                fmt::print("Failed to open {}: {}\n", path, std::strerror(errno));
+                throw std::runtime_error("Failed to sample balloon");
+            }
+        }
+
+        ~ProcFile()
+        {
+            close(fd_);
+        }
+
+        ProcFile(const ProcFile &) = delete;
+        ProcFile &operator=(const ProcFile &) = delete;
+
+        std::string_view Read()
+        {
+            // vmstat is a few kB and keeps growing with new kernels
+            for (;;) {
+                auto len = pread(fd_, buf_.data(), buf_.size(), 0);
+                if (len < 0)
+                    return {};
+                if (static_cast<size_t>(len) < buf_.size())
+                    return {buf_.data(), static_cast<size_t>(len)};
+                buf_.resize(buf_.size() * 2);
+            }
+        }
+
+    private:
+        int               fd_;
+        std::vector<char> buf_ = std::vector<char>(8192);
+};
+
+struct BalloonSample
+{
+    std::array<std::optional<uint64_t>, magic_enum::enum_count<VmStat>()>  vmstat_;
+    std::array<std::optional<uint64_t>, magic_enum::enum_count<MemInfo>()> meminfo_;
+
+    uint64_t Vm(const VmStat stat) const { return vmstat_[e_to_type(stat)].value_or(0); }
+    uint64_t Mem(const MemInfo field) const { return meminfo_[e_to_type(field)].value_or(0); }
+
+    // "Balloon:" in meminfo and nr_balloon_pages in vmstat both came with
+    // Linux 6.14, older kernels don't tell the balloon size at all
+    std::optional<uint64_t> BalloonKb(const uint64_t page_kb) const
+    {
+        if (meminfo_[e_to_type(MemInfo::Balloon)].has_value())
+            return meminfo_[e_to_type(MemInfo::Balloon)];
+        if (vmstat_[e_to_type(VmStat::nr_balloon_pages)].has_value())
+            return Vm(VmStat::nr_balloon_pages) * page_kb;
+        return std::nullopt;
+    }
+};
+
+// Share of guest memory held by the balloon. Inflated pages are taken
+// out of MemTotal unless VIRTIO_BALLOON_F_DEFLATE_ON_OOM is negotiated,
+// with it the driver leaves them accounted
+constexpr double
+BalloonPct(const uint64_t balloon_kb, const uint64_t total_kb, const bool deflate_on_oom)
+{
+    auto guest_kb = deflate_on_oom ? total_kb : total_kb + balloon_kb;
+    return guest_kb ? 100.0 * balloon_kb / guest_kb : 0.0;
+}
+
+static_assert(BalloonPct(1024, 3072, false) == 25.0, "inflated pages outside of MemTotal");
+static_assert(BalloonPct(1024, 4096, true) == 25.0, "inflated pages within MemTotal");
+static_assert(BalloonPct(0, 0, false) == 0.0, "no MemTotal");
+
+// Negotiated features which decide how memory goes back to the host
+static void
+PrintBalloonDevs(const std::vector<std::pair<std::string, uint64_t>> &devs)
+{
+    constexpr std::array features {
+        virtio::VirtIOBalloonFeature::VIRTIO_BALLOON_F_STATS_VQ,
+        virtio::VirtIOBalloonFeature::VIRTIO_BALLOON_F_DEFLATE_ON_OOM,
+        virtio::VirtIOBalloonFeature::VIRTIO_BALLOON_F_FREE_PAGE_HINT,
+        virtio::VirtIOBalloonFeature::VIRTIO_BALLOON_F_REPORTING,
+    };
+
+    for (const auto &[name, dev_features] : devs) {
+        std::string list;
+        for (auto feature : features) {
+            bool set = dev_features & (1ULL << e_to_type(feature));
+            if (cmdl_opts.json_output_)
+                list += fmt::format("{}\"{}\":{}", list.empty() ? "" : ",",
+                                    magic_enum::enum_name(feature), set);
+            else
+                list += fmt::format(" {}{}", set ? '+' : '-', magic_enum::enum_name(feature));
+        }
+
+        if (cmdl_opts.json_output_)
+            fmt::print("{{\"name\":\"{}\",\"kind\":\"balloon_dev\",\"features\":{{{}}}}}\n", name, list);
+        else
+            fmt::print("{:<10}{}\n", name, list);
+    }
+}
+
+void SampleBalloon()
+{
+    std::vector<std::pair<std::string, uint64_t>> devs;
+    for (const auto &[name, desc] : virtio::GetVirtioDevMap())
+        if (desc.dev_type_ == virtio::VirtIODevType::mem_balloon_traditional)
+            devs.emplace_back(name, desc.features_);
+
+    if (devs.empty()) {
+        fmt::print("No memory balloon VirtIO devices found\n");
+        return;
+    }
+
+    ProcFile vmstat {vmstat_path};
+    ProcFile meminfo {meminfo_path};
+    auto page_kb = static_cast<uint64_t>(sysconf(_SC_PAGESIZE)) / 1024;
+
+    auto read_sample = [&]() {
+        BalloonSample sample;
+        ParseKeyedCounters<VmStat>(vmstat.Read(), sample.vmstat_);
+        ParseKeyedCounters<MemInfo>(meminfo.Read(), sample.meminfo_);
+        return sample;
+    };
+
+    auto prev = read_sample();
+    if (!prev.vmstat_[e_to_type(VmStat::balloon_inflate)].has_value()) {
+        fmt::print("{} has no balloon counters (kernel built w/o CONFIG_MEMORY_BALLOON?)\n",
+                   vmstat_path);
+        throw std::runtime_error("Failed to sample balloon");
+    }
+
+    PrintBalloonDevs(devs);
+
+    // there's normally a single balloon device
+    bool deflate_on_oom = std::any_of(devs.begin(), devs.end(), [](const auto &dev) {
+        return dev.second & (1ULL << e_to_type(virtio::VirtIOBalloonFeature::VIRTIO_BALLOON_F_DEFLATE_ON_OOM));
+    });
+
+    SampleLoop([&](const double secs, const uint64_t now_ns) {
+        auto cur = read_sample();
+        // counters are monotonic, but don't report garbage if they aren't
+        auto rate = [&](const VmStat stat) {
+            return cur.Vm(stat) >= prev.Vm(stat) ? (cur.Vm(stat) - prev.Vm(stat)) / secs : 0.0;
+        };
+
+        auto balloon_kb = cur.BalloonKb(page_kb);
+        auto total_kb = cur.Mem(MemInfo::MemTotal);
+
+        if (cmdl_opts.json_output_) {
+            fmt::print("{{\"ts_ns\":{},\"kind\":\"balloon\",\"balloon_kb\":{},"
+                       "\"inflate_pps\":{:.0f},\"deflate_pps\":{:.0f},\"migrate_pps\":{:.0f},"
+                       "\"mem_total_kb\":{},\"mem_avail_kb\":{}}}\n",
+                       now_ns, balloon_kb ? fmt::format("{}", *balloon_kb) : "null",
+                       rate(VmStat::balloon_inflate), rate(VmStat::balloon_deflate),
+                       rate(VmStat::balloon_migrate),
+                       total_kb, cur.Mem(MemInfo::MemAvailable));
+        } else {
+            auto balloon = balloon_kb ?
+                fmt::format("{:>8} MiB ({:4.1f}%)", *balloon_kb / 1024,
+                            BalloonPct(*balloon_kb, total_kb, deflate_on_oom)) :
+                fmt::format("{:>8}", "n/a");
+            fmt::print("balloon {}  inflate {:>7} pages/s  deflate {:>7} pages/s"
+                       "  migrate {:>7} pages/s  available {} MiB\n",
+                       balloon,
+                       Scaled(rate(VmStat::balloon_inflate)), Scaled(rate(VmStat::balloon_deflate)),
+                       Scaled(rate(VmStat::balloon_migrate)),
+                       cur.Mem(MemInfo::MemAvailable) / 1024);
+        }
+
+        prev = cur;
+    });
+}
+
+} // namespace throughput
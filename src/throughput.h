@@ -0,0 +1,23 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2025 Petr Vyazovik <xen@f-m.fm>
+
+#pragma once
+
+#include "config.h"
+
+// Live throughput of network and block devices. Each device is mapped
+// through its aux info to the interface statistics
+// (/sys/class/net/<iface>/statistics/*) or the disk stats
+// (/sys/block/<disk>/stat); all counter files are kept open and read
+// in one pass per tick. Memory balloon activity is sampled the same way
+// from /proc/vmstat and /proc/meminfo.
+namespace throughput {
+
+// Print rates every --sample-interval until interrupted
+// (or --samples reports were printed)
+void SampleDevThroughput();
+
+// Print balloon size and inflate/deflate/migrate rates, same cadence
+void SampleBalloon();
+
+} // namespace throughput
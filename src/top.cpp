@@ -0,0 +1,572 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2025 Petr Vyazovik <xen@f-m.fm>
+
+#include "ui.h"
+#include "ui_elements.h"
+#include "transport.h"
+#include "virtio_bus.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <ftxui/component/component.hpp>
+#include <ftxui/component/event.hpp>
+#include <ftxui/component/screen_interactive.hpp>
+#include <ftxui/dom/table.hpp>
+#include <ftxui/screen/terminal.hpp>
+
+#include "magic_enum/magic_enum.hpp"
+
+extern cfg::CmdLOpts cmdl_opts;
+
+using namespace ftxui;
+
+namespace fs = std::filesystem;
+
+namespace ui {
+
+constexpr auto top_refresh_period {std::chrono::seconds(1)};
+// changed rows stay highlighted for this many refreshes
+constexpr uint64_t top_highlight_ticks {3};
+
+enum class TopSortKey
+{
+    name,
+    type,
+    status,
+    features,
+    aux_info
+};
+
+constexpr std::string_view TopSortKeyName(const TopSortKey key)
+{
+    switch (key) {
+    case TopSortKey::name:
+	return "name";
+    case TopSortKey::type:
+	return "type";
+    case TopSortKey::status:
+	return "status";
+    case TopSortKey::features:
+	return "features";
+    case TopSortKey::aux_info:
+	return "aux";
+    default:
+	return "< unknown >";
+    }
+}
+
+// Cached state of a single device row. Attribute files stay open across
+// refreshes, so polling a device is two pread()s and a compare with the
+// previous raw contents; cells are rebuilt only when those differ.
+struct TopRow
+{
+    std::string           name_;
+    fs::path              dev_path_;
+    // device directory the attribute files were opened in; a device
+    // registered under the same name later has a different one
+    dev_t                 dir_dev_ {0};
+    ino_t                 dir_ino_ {0};
+    int                   status_fd_ {-1};
+    int                   features_fd_ {-1};
+    std::string           status_raw_;
+    std::string           features_raw_;
+    virtio::VirtIODevType dev_type_ {virtio::VirtIODevType::rsvd};
+    uint32_t              status_ {0};
+    uint64_t              features_ {0};
+    bool                  parse_failed_ {false};
+    std::string           aux_info_;
+    uint64_t              changed_tick_ {0};
+    uint64_t              seen_tick_ {0};
+    Elements              cells_;
+    // built on demand when the row is selected
+    Element               detail_;
+
+    ~TopRow()
+    {
+        if (status_fd_ >= 0)
+            close(status_fd_);
+        if (features_fd_ >= 0)
+            close(features_fd_);
+    }
+};
+
+class DevTopModel
+{
+    public:
+        explicit DevTopModel(const fs::path &bus_path)
+            : bus_path_(bus_path)
+        {}
+
+        // Returns true if anything on screen has to change
+        bool Refresh()
+        {
+            tick_++;
+            bool changed = false;
+            // shared by all rows, built on the first aux info lookup
+            std::optional<virtio::AuxInfoIndex> aux_index;
+
+            DIR *bus_dir = opendir(bus_path_.c_str());
+            if (bus_dir == nullptr)
+                return false;
+
+            while (auto *entry = readdir(bus_dir)) {
+                std::string_view name {entry->d_name};
+                if (name.starts_with("."))
+                    continue;
+
+                auto it = rows_.find(std::string {name});
+                if (it == rows_.end()) {
+                    auto row = CreateRow(name, aux_index);
+                    row->seen_tick_ = tick_;
+                    rows_.emplace(row->name_, std::move(row));
+                    changed = view_dirty_ = true;
+                    continue;
+                }
+
+                // removed and re-added with the same name since the
+                // last tick: the open attribute files are stale
+                if (RowReplaced(*it->second)) {
+                    it->second = CreateRow(name, aux_index);
+                    it->second->seen_tick_ = tick_;
+                    changed = view_dirty_ = true;
+                    continue;
+                }
+
+                auto &row = *it->second;
+                row.seen_tick_ = tick_;
+                auto update = ReadRow(row, aux_index);
+                if (update == RowUpdate::failed) {
+                    it->second = CreateRow(name, aux_index);
+                    it->second->seen_tick_ = tick_;
+                    changed = view_dirty_ = true;
+                    continue;
+                }
+                if (update == RowUpdate::unchanged)
+                    continue;
+
+                BuildCells(row);
+                changed = true;
+                if (sort_key_ == TopSortKey::status || sort_key_ == TopSortKey::features)
+                    view_dirty_ = true;
+            }
+
+            closedir(bus_dir);
+
+            auto removed = std::erase_if(rows_, [this](const auto &row) {
+                return row.second->seen_tick_ != tick_;
+            });
+            if (removed)
+                changed = view_dirty_ = true;
+
+            // rows may have been replaced or removed, don't walk a stale view
+            if (view_dirty_)
+                RebuildView();
+
+            // highlighting of the rows changed a few ticks ago expires
+            for (const auto *row : view_)
+                changed |= row->changed_tick_ && row->changed_tick_ + top_highlight_ticks == tick_;
+
+            return changed;
+        }
+
+        void SetSort(const TopSortKey key, const bool reverse)
+        {
+            sort_key_ = key;
+            sort_reverse_ = reverse;
+            RebuildView();
+        }
+
+        void SetFilter(const std::string &filter)
+        {
+            filter_ = filter;
+            RebuildView();
+        }
+
+        bool RowHighlighted(const TopRow &row) const
+        {
+            return row.changed_tick_ && row.changed_tick_ + top_highlight_ticks > tick_;
+        }
+
+        const std::vector<TopRow *> &View() const { return view_; }
+        size_t DevCount() const { return rows_.size(); }
+
+    private:
+        std::unique_ptr<TopRow> CreateRow(std::string_view name,
+                                          std::optional<virtio::AuxInfoIndex> &aux_index)
+        {
+            auto row = std::make_unique<TopRow>();
+            row->name_ = name;
+            row->dev_path_ = bus_path_ / name;
+
+            struct stat st;
+            if (stat(row->dev_path_.c_str(), &st) == 0) {
+                row->dir_dev_ = st.st_dev;
+                row->dir_ino_ = st.st_ino;
+            }
+
+            // device type never changes for a registered device
+            std::array<char, 16> type_buf;
+            int type_fd = open((row->dev_path_ / "device").c_str(), O_RDONLY | O_CLOEXEC);
+            if (type_fd >= 0) {
+                auto len = pread(type_fd, type_buf.data(), type_buf.size(), 0);
+                close(type_fd);
+                uint32_t type;
+                if (len > 0 &&
+                    virtio::ParseDevTypeAttr(StripNewline({type_buf.data(), static_cast<size_t>(len)}), type))
+                    row->dev_type_ = virtio::VirtIODevType {type};
+            }
+
+            row->status_fd_ = open((row->dev_path_ / "status").c_str(), O_RDONLY | O_CLOEXEC);
+            row->features_fd_ = open((row->dev_path_ / "features").c_str(), O_RDONLY | O_CLOEXEC);
+
+            ReadRow(*row, aux_index);
+            // new devices are not highlighted on the very first scan
+            if (tick_ == 1)
+                row->changed_tick_ = 0;
+            BuildCells(*row);
+
+            return row;
+        }
+
+        // Same check as LiveSysfsDir::Removed(): the bus entry no longer
+        // leads to the device directory the row was created for
+        static bool RowReplaced(const TopRow &row)
+        {
+            struct stat st;
+            return stat(row.dev_path_.c_str(), &st) != 0 ||
+                   st.st_dev != row.dir_dev_ || st.st_ino != row.dir_ino_;
+        }
+
+        static std::string_view StripNewline(std::string_view buf)
+        {
+            if (!buf.empty() && buf.back() == '\n')
+                buf.remove_suffix(1);
+            return buf;
+        }
+
+        // nullopt if the read fails, e.g. because the device is gone
+        static std::optional<std::string_view> ReadAttr(const int fd, std::array<char, 256> &buf)
+        {
+            if (fd < 0)
+                return std::string_view {};
+            // sysfs regenerates attribute contents on every read from offset 0
+            auto len = pread(fd, buf.data(), buf.size(), 0);
+            if (len < 0)
+                return std::nullopt;
+            return StripNewline({buf.data(), static_cast<size_t>(len)});
+        }
+
+        enum class RowUpdate
+        {
+            unchanged,
+            changed,
+            failed
+        };
+
+        RowUpdate ReadRow(TopRow &row, std::optional<virtio::AuxInfoIndex> &aux_index)
+        {
+            std::array<char, 256> status_buf, features_buf;
+            auto status_read = ReadAttr(row.status_fd_, status_buf);
+            auto features_read = ReadAttr(row.features_fd_, features_buf);
+            if (!status_read.has_value() || !features_read.has_value())
+                return RowUpdate::failed;
+
+            auto status_raw = *status_read;
+            auto features_raw = *features_read;
+
+            if (status_raw == row.status_raw_ && features_raw == row.features_raw_)
+                return RowUpdate::unchanged;
+
+            row.status_raw_ = status_raw;
+            row.features_raw_ = features_raw;
+            row.parse_failed_ = !virtio::ParseDevStatusAttr(status_raw, row.status_) ||
+                                !virtio::ParseDevFeaturesAttr(features_raw, row.features_);
+
+            // aux info (e.g. iface name) appears once the driver is up;
+            // don't look for it earlier, that would print to the screen
+            constexpr auto driver_ok = 1U << e_to_type(virtio::VirtIOStatusBits::VIRTIO_CONFIG_S_DRIVER_OK);
+            if (row.status_ & driver_ok) {
+                if (!aux_index.has_value())
+                    aux_index = virtio::AuxInfoIndex::Build(bus_path_);
+                row.aux_info_ = virtio::DevGetAuxInfo(row.dev_type_, row.dev_path_, *aux_index);
+            } else
+                row.aux_info_.clear();
+            row.changed_tick_ = tick_;
+            row.detail_ = nullptr;
+
+            return RowUpdate::changed;
+        }
+
+        static void BuildCells(TopRow &row)
+        {
+            auto type_elem = hbox({
+                text(fmt::format("[{:>2}]", e_to_type(row.dev_type_))),
+                separatorEmpty(),
+                text(fmt::format("{}", virtio::VirtIODevTypeName(row.dev_type_))) | inverted,
+                separatorEmpty(),
+                text(row.aux_info_.empty() ? "" : fmt::format("({})", row.aux_info_)) |
+                color(Color::Green) | bold,
+                filler()
+            });
+
+            auto status_elem = text(fmt::format("{:#x}", row.status_));
+            if (row.status_ & (1U << e_to_type(virtio::VirtIOStatusBits::VIRTIO_CONFIG_S_FAILED)))
+                status_elem |= bgcolor(Color::Red) | color(Color::Grey15);
+            else if (row.status_ & (1U << e_to_type(virtio::VirtIOStatusBits::VIRTIO_CONFIG_S_NEEDS_RESET)))
+                status_elem |= bgcolor(Color::Yellow) | color(Color::Grey15);
+
+            row.cells_ = {
+                text(row.name_) | bold,
+                type_elem,
+                row.parse_failed_ ? text("< parse error >") | color(Color::Red)
+                                  : text(fmt::format("{:<#016x}", row.features_)),
+                status_elem
+            };
+        }
+
+        bool RowMatchesFilter(const TopRow &row) const
+        {
+            if (filter_.empty())
+                return true;
+            return row.name_.find(filter_) != std::string::npos ||
+                   row.aux_info_.find(filter_) != std::string::npos ||
+                   virtio::VirtIODevTypeName(row.dev_type_).find(filter_) != std::string_view::npos;
+        }
+
+        void RebuildView()
+        {
+            view_.clear();
+            for (auto &[name, row] : rows_) {
+                if (RowMatchesFilter(*row))
+                    view_.push_back(row.get());
+            }
+
+            auto less = [this](const TopRow *lhs, const TopRow *rhs) {
+                switch (sort_key_) {
+                case TopSortKey::type:
+                    if (lhs->dev_type_ != rhs->dev_type_)
+                        return lhs->dev_type_ < rhs->dev_type_;
+                    break;
+                case TopSortKey::status:
+                    if (lhs->status_ != rhs->status_)
+                        return lhs->status_ < rhs->status_;
+                    break;
+                case TopSortKey::features:
+                    if (lhs->features_ != rhs->features_)
+                        return lhs->features_ < rhs->features_;
+                    break;
+                case TopSortKey::aux_info:
+                    if (lhs->aux_info_ != rhs->aux_info_)
+                        return virtio::DevNameNaturalLess(lhs->aux_info_, rhs->aux_info_);
+                    break;
+                default:
+                    break;
+                }
+                return virtio::DevNameNaturalLess(lhs->name_, rhs->name_);
+            };
+
+            if (sort_reverse_)
+                std::sort(view_.rbegin(), view_.rend(), less);
+            else
+                std::sort(view_.begin(), view_.end(), less);
+
+            view_dirty_ = false;
+        }
+
+        fs::path                                                 bus_path_;
+        std::unordered_map<std::string, std::unique_ptr<TopRow>> rows_;
+        // filtered and sorted rows
+        std::vector<TopRow *>                                    view_;
+        bool                                                     view_dirty_ {false};
+        uint64_t                                                 tick_ {0};
+        TopSortKey                                               sort_key_ {TopSortKey::name};
+        bool                                                     sort_reverse_ {false};
+        std::string                                              filter_;
+};
+
+static Element
+CreateTopDetailElement(TopRow &row)
+{
+    if (row.detail_)
+        return row.detail_;
+
+    Elements elems {
+        hbox({
+            text(" Device ->"),
+            separatorEmpty(),
+            text(row.name_) | bold,
+            separatorEmpty(),
+            text(fmt::format("{}", virtio::VirtIODevTypeName(row.dev_type_))) | bold,
+            filler()
+        })
+    };
+
+    if (!cmdl_opts.no_status_)
+        elems.push_back(VirtIODevCreateStatusElement(row.status_));
+
+    virtio::VirtIODevDesc desc {row.dev_type_, row.status_, row.features_,
+                                row.aux_info_, row.dev_path_};
+    elems.push_back(VirtIODevCreateTransportElement(virtio::DevGetTransportInfo(desc)));
+    elems.push_back(VirtIODevCreateFeaturesElement(row.features_, row.dev_type_));
+
+    row.detail_ = vbox(std::move(elems));
+    return row.detail_;
+}
+
+void VirtIODevTop()
+{
+    DevTopModel model {virtio::virtio_devs_path};
+    model.Refresh();
+
+    auto screen = ScreenInteractive::Fullscreen();
+
+    size_t selected = 0;
+    size_t scroll = 0;
+    size_t list_rows = 1;
+    bool show_detail = false;
+    bool filter_edit = false;
+    std::string filter;
+    auto sort_key = TopSortKey::name;
+    bool sort_reverse = false;
+
+    auto renderer = Renderer([&] {
+        const auto &view = model.View();
+        auto term_rows = static_cast<size_t>(std::max(Terminal::Size().dimy, 8));
+
+        // header line, table header and status bar
+        list_rows = show_detail ? std::max<size_t>(3, term_rows / 3) : term_rows - 3;
+        selected = view.empty() ? 0 : std::min(selected, view.size() - 1);
+        if (selected < scroll)
+            scroll = selected;
+        else if (selected >= scroll + list_rows)
+            scroll = selected - list_rows + 1;
+
+        // only the rows that fit on the screen are handed to the renderer
+        std::vector<Elements> tbl;
+        tbl.push_back({text("name "), text("type "), text("features "), text("status ")});
+        auto last = std::min(view.size(), scroll + list_rows);
+        for (auto idx = scroll; idx < last; idx++)
+            tbl.push_back(view[idx]->cells_);
+
+        auto table = Table(std::move(tbl));
+        table.SelectAll().Border(EMPTY);
+        table.SelectAll().Separator(EMPTY);
+        table.SelectRow(0).Border(EMPTY);
+        table.SelectRow(0).DecorateCells(bold | bgcolor(Color::Yellow) | color(Color::Grey15));
+        for (auto idx = scroll; idx < last; idx++) {
+            if (model.RowHighlighted(*view[idx]))
+                table.SelectRow(idx - scroll + 1).Decorate(color(Color::Yellow));
+        }
+        if (!view.empty())
+            table.SelectRow(selected - scroll + 1).Decorate(inverted);
+
+        auto status_bar = text(fmt::format(
+                " {} devices, {} shown | sort: {}{} | filter: {}{} | "
+                "q quit  / filter  s sort  r reverse  enter details",
+                model.DevCount(), view.size(), TopSortKeyName(sort_key),
+                sort_reverse ? " (rev)" : "", filter, filter_edit ? "_" : "")) | inverted;
+
+        Elements elems {table.Render() | size(HEIGHT, EQUAL, static_cast<int>(list_rows + 1))};
+        if (show_detail && !view.empty()) {
+            elems.push_back(separator());
+            elems.push_back(CreateTopDetailElement(*view[selected]) | yframe | flex);
+        } else {
+            elems.push_back(filler());
+        }
+        elems.push_back(status_bar);
+
+        return vbox(std::move(elems));
+    });
+
+    auto component = CatchEvent(renderer, [&](Event event) {
+        const auto view_size = model.View().size();
+
+        if (filter_edit) {
+            if (event == Event::Return || event == Event::Escape)
+                filter_edit = false;
+            else if (event == Event::Backspace && !filter.empty())
+                filter.pop_back();
+            else if (event.is_character())
+                filter += event.character();
+            else
+                return false;
+            model.SetFilter(filter);
+            return true;
+        }
+
+        if (event == Event::Character('q') || event == Event::Escape) {
+            screen.Exit();
+        } else if (event == Event::ArrowDown || event == Event::Character('j')) {
+            if (selected + 1 < view_size)
+                selected++;
+        } else if (event == Event::ArrowUp || event == Event::Character('k')) {
+            if (selected > 0)
+                selected--;
+        } else if (event == Event::PageDown) {
+            selected = view_size ? std::min(selected + list_rows, view_size - 1) : 0;
+        } else if (event == Event::PageUp) {
+            selected -= std::min(selected, list_rows);
+        } else if (event == Event::Home) {
+            selected = 0;
+        } else if (event == Event::End) {
+            selected = view_size ? view_size - 1 : 0;
+        } else if (event == Event::Character('/')) {
+            filter_edit = true;
+        } else if (event == Event::Character('s')) {
+            auto keys = magic_enum::enum_values<TopSortKey>();
+            sort_key = keys[(e_to_type(sort_key) + 1) % keys.size()];
+            model.SetSort(sort_key, sort_reverse);
+        } else if (event == Event::Character('r')) {
+            sort_reverse = !sort_reverse;
+            model.SetSort(sort_key, sort_reverse);
+        } else if (event == Event::Return) {
+            show_detail = !show_detail;
+        } else {
+            return false;
+        }
+
+        return true;
+    });
+
+    // sysfs is polled from the UI thread, the ticker only schedules it,
+    // and a frame is requested only if something has changed
+    std::atomic<bool> stop {false};
+    std::thread ticker([&] {
+        constexpr auto step = std::chrono::milliseconds(50);
+        auto next = std::chrono::steady_clock::now() + top_refresh_period;
+        while (!stop) {
+            if (std::chrono::steady_clock::now() < next) {
+                std::this_thread::sleep_for(step);
+                continue;
+            }
+            next += top_refresh_period;
+            screen.Post([&] {
+                if (model.Refresh())
+                    screen.PostEvent(Event::Custom);
+            });
+        }
+    });
+
+    screen.Loop(component);
+
+    stop = true;
+    ticker.join();
+}
+
+} // namespace ui
@@ -0,0 +1,250 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2025 Petr Vyazovik <xen@f-m.fm>
+
+#include "transport.h"
+#include "sysfs_source.h"
+#include "util.h"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+namespace fs = std::filesystem;
+
+namespace virtio {
+
+constexpr size_t pci_cfg_space_size {256};
+constexpr size_t pci_std_header_size {64};
+
+constexpr uint16_t pci_vendor_id_redhat_qumranet {0x1af4};
+
+// offsets within the standard configuration header
+constexpr uint8_t pci_status {0x06};
+constexpr uint16_t pci_status_cap_list {0x10};
+constexpr uint8_t pci_capability_list {0x34};
+
+constexpr uint8_t pci_cap_id_msix {0x11};
+constexpr uint8_t pci_cap_id_vndr {0x09};
+
+// struct virtio_pci_cap / virtio_pci_notify_cap / virtio_pci_cap64 field offsets
+constexpr uint8_t virtio_pci_cap_cfg_type {3};
+constexpr uint8_t virtio_pci_cap_bar {4};
+constexpr uint8_t virtio_pci_cap_id {5};
+constexpr uint8_t virtio_pci_cap_offset {8};
+constexpr uint8_t virtio_pci_cap_length {12};
+constexpr uint8_t virtio_pci_notify_cap_mult {16};
+constexpr uint8_t virtio_pci_cap64_offset_hi {16};
+constexpr uint8_t virtio_pci_cap64_length_hi {20};
+
+constexpr uint16_t pci_msix_flags_qsize {0x07ff};
+constexpr uint16_t pci_msix_flags_enable {0x8000};
+
+using pci_cfg_space_ct = std::array<uint8_t, pci_cfg_space_size>;
+
+static std::string
+ReadLinkName(const fs::path &path)
+{
+    auto target = ActiveSysfs().ReadLink(path);
+    return target.has_value() ? target->filename().string() : std::string {};
+}
+
+static std::string
+ReadAttr(const fs::path &path)
+{
+    return ActiveSysfs().ReadAttr(path).value_or(std::string {});
+}
+
+static uint32_t
+CountEntries(const fs::path &path, std::string_view prefix = {})
+{
+    uint32_t count = 0;
+    for (const auto &entry : ActiveSysfs().ListDir(path).value_or(std::vector<std::string> {}))
+        count += entry.starts_with(prefix);
+    return count;
+}
+
+template <typename T>
+static T
+CfgRead(const pci_cfg_space_ct &cfg, const size_t pos)
+{
+    // PCI configuration space is little-endian
+    T val {0};
+    for (size_t byte = 0; byte < sizeof(T); byte++)
+        val |= static_cast<T>(cfg[pos + byte]) << (8 * byte);
+    return val;
+}
+
+// Returns number of bytes read: unprivileged users only get the
+// standard header
+static size_t
+ReadPciConfig(const fs::path &pci_path, pci_cfg_space_ct &cfg)
+{
+    auto contents = ActiveSysfs().ReadFile(pci_path / "config");
+    if (!contents.has_value())
+        return 0;
+
+    auto len = std::min(contents->size(), cfg.size());
+    std::memcpy(cfg.data(), contents->data(), len);
+    return len;
+}
+
+static void
+PciDecodeCaps(const pci_cfg_space_ct &cfg, PciTransportInfo &info)
+{
+    if (!(CfgRead<uint16_t>(cfg, pci_status) & pci_status_cap_list))
+        return;
+
+    bool is_virtio = CfgRead<uint16_t>(cfg, 0) == pci_vendor_id_redhat_qumranet;
+    size_t pos = cfg[pci_capability_list] & ~3;
+
+    // bound the walk in case of a malformed (looped) list
+    for (uint32_t ttl = 48; pos >= pci_std_header_size && ttl; ttl--) {
+        if (pos + 2 > cfg.size())
+            break;
+
+        uint8_t cap_id = cfg[pos];
+
+        if (cap_id == pci_cap_id_msix && pos + 4 <= cfg.size()) {
+            auto flags = CfgRead<uint16_t>(cfg, pos + 2);
+            info.msix_table_size_ = (flags & pci_msix_flags_qsize) + 1;
+            info.msix_enabled_ = flags & pci_msix_flags_enable;
+        } else if (cap_id == pci_cap_id_vndr && is_virtio &&
+                   pos + virtio_pci_cap_length + 4 <= cfg.size()) {
+            VirtIOPciCap cap {
+                VirtIOPciCapType {cfg[pos + virtio_pci_cap_cfg_type]},
+                cfg[pos + virtio_pci_cap_bar],
+                cfg[pos + virtio_pci_cap_id],
+                CfgRead<uint32_t>(cfg, pos + virtio_pci_cap_offset),
+                CfgRead<uint32_t>(cfg, pos + virtio_pci_cap_length)
+            };
+
+            if (cap.cfg_type_ == VirtIOPciCapType::notify_cfg &&
+                pos + virtio_pci_notify_cap_mult + 4 <= cfg.size())
+                info.notify_off_multiplier_ = CfgRead<uint32_t>(cfg, pos + virtio_pci_notify_cap_mult);
+
+            if (cap.cfg_type_ == VirtIOPciCapType::shared_memory_cfg &&
+                pos + virtio_pci_cap64_length_hi + 4 <= cfg.size()) {
+                cap.offset_ |= uint64_t {CfgRead<uint32_t>(cfg, pos + virtio_pci_cap64_offset_hi)} << 32;
+                cap.length_ |= uint64_t {CfgRead<uint32_t>(cfg, pos + virtio_pci_cap64_length_hi)} << 32;
+            }
+
+            info.caps_.push_back(cap);
+        }
+
+        pos = cfg[pos + 1] & ~3;
+    }
+}
+
+static PciTransportInfo
+PciGetTransportInfo(const fs::path &pci_path)
+{
+    PciTransportInfo info {};
+    info.addr_ = pci_path.filename().string();
+
+    pci_cfg_space_ct cfg {};
+    auto cfg_size = ReadPciConfig(pci_path, cfg);
+    info.caps_readable_ = cfg_size > pci_std_header_size;
+    if (info.caps_readable_)
+        PciDecodeCaps(cfg, info);
+
+    // irq mode as set up by the driver: every allocated vector is listed
+    // in msi_irqs/ with "msi" or "msix" as the contents
+    auto vectors = ActiveSysfs().ListDir(pci_path / "msi_irqs");
+    for (const auto &vec_entry : vectors.value_or(std::vector<std::string> {})) {
+        if (info.irq_vectors_++ == 0)
+            info.irq_mode_ = ReadAttr(pci_path / "msi_irqs" / vec_entry) == "msix" ? PciIrqMode::msix
+                                                                                   : PciIrqMode::msi;
+    }
+
+    // 0 (unknown) if missing or malformed, e.g. in a hand-made archive
+    if (!util::ParseNumber(ReadAttr(pci_path / "irq"), info.irq_))
+        info.irq_ = 0;
+
+    // PCI Express only
+    info.link_speed_ = ReadAttr(pci_path / "current_link_speed");
+    info.link_width_ = ReadAttr(pci_path / "current_link_width");
+    info.max_link_speed_ = ReadAttr(pci_path / "max_link_speed");
+    info.max_link_width_ = ReadAttr(pci_path / "max_link_width");
+
+    return info;
+}
+
+// virtio_net registers the control vq without a callback, so
+// vp_find_vqs() never assigns it a vector: only rx/tx queues count
+constexpr uint32_t NetIrqQueuesNum(const uint32_t rx_queues, const uint32_t tx_queues)
+{
+    return rx_queues + tx_queues;
+}
+
+static_assert(!IrqVectorsShort(2 * 4 + 1, NetIrqQueuesNum(4, 4)),
+              "4 queue pairs with CTRL_VQ are served by 2*4+1 vectors");
+static_assert(IrqVectorsShort(2 * 4, NetIrqQueuesNum(4, 4)),
+              "config change vector is still needed");
+
+static std::optional<uint32_t>
+DevGetQueuesNum(const VirtIODevDesc &desc)
+{
+    switch (desc.dev_type_) {
+    case VirtIODevType::network_card: {
+        if (desc.aux_info_.empty())
+            return std::nullopt;
+        auto queues = desc.dev_path_ / "net" / desc.aux_info_ / "queues";
+        return NetIrqQueuesNum(CountEntries(queues, "rx-"), CountEntries(queues, "tx-"));
+    }
+    case VirtIODevType::block: {
+        auto mq_path = desc.dev_path_ / "block" / fs::path {desc.aux_info_}.filename() / "mq";
+        if (desc.aux_info_.empty() || !ActiveSysfs().Exists(mq_path))
+            return std::nullopt;
+        return CountEntries(mq_path);
+    }
+    default:
+        return std::nullopt;
+    }
+}
+
+TransportInfo DevGetTransportInfo(const VirtIODevDesc &desc)
+{
+    TransportInfo info {};
+
+    auto dev_path = ActiveSysfs().Canonical(desc.dev_path_);
+    if (!dev_path.has_value())
+        return info;
+    auto parent = dev_path->parent_path();
+
+    info.parent_ = parent.filename().string();
+    auto parent_bus = ReadLinkName(parent / "subsystem");
+
+    if (parent_bus == "pci") {
+        info.transport_ = VirtIOTransport::pci;
+        info.pci_ = PciGetTransportInfo(parent);
+    } else if (parent_bus == "platform") {
+        // virtio-mmio devices are platform devices, either from DT/ACPI
+        // or from the virtio_mmio.device= command line parameter
+        if (ReadLinkName(parent / "driver") == "virtio-mmio")
+            info.transport_ = VirtIOTransport::mmio;
+    } else if (parent_bus == "ccw") {
+        info.transport_ = VirtIOTransport::ccw;
+    } else if (parent_bus == "vdpa") {
+        info.transport_ = VirtIOTransport::vdpa;
+    }
+
+    info.queues_ = DevGetQueuesNum(desc);
+
+    return info;
+}
+
+bool TransportIrqStarved(const TransportInfo &info)
+{
+    if (!info.pci_.has_value())
+        return false;
+
+    const auto &pci = info.pci_.value();
+    if (pci.irq_mode_ == PciIrqMode::intx)
+        return true;
+
+    return info.queues_.has_value() && IrqVectorsShort(pci.irq_vectors_, info.queues_.value());
+}
+
+} // namespace virtio
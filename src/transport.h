@@ -0,0 +1,143 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2025 Petr Vyazovik <xen@f-m.fm>
+
+#pragma once
+
+#include "virtio_bus.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace virtio {
+
+enum class VirtIOTransport
+{
+    pci,
+    mmio,
+    ccw,
+    vdpa,
+    unknown
+};
+
+constexpr std::string_view VirtIOTransportName(const VirtIOTransport transport)
+{
+    switch (transport) {
+    case VirtIOTransport::pci:
+	return "virtio-pci";
+    case VirtIOTransport::mmio:
+	return "virtio-mmio";
+    case VirtIOTransport::ccw:
+	return "virtio-ccw";
+    case VirtIOTransport::vdpa:
+	return "vdpa";
+    default:
+	return "< unknown >";
+    }
+}
+
+// cfg_type of struct virtio_pci_cap, see include/uapi/linux/virtio_pci.h
+enum class VirtIOPciCapType : uint8_t
+{
+    common_cfg = 1,
+    notify_cfg = 2,
+    isr_cfg = 3,
+    device_cfg = 4,
+    pci_cfg = 5,
+    shared_memory_cfg = 8,
+    vendor_cfg = 9
+};
+
+constexpr std::string_view VirtIOPciCapTypeName(const VirtIOPciCapType type)
+{
+    switch (type) {
+    case VirtIOPciCapType::common_cfg:
+	return "common";
+    case VirtIOPciCapType::notify_cfg:
+	return "notify";
+    case VirtIOPciCapType::isr_cfg:
+	return "isr";
+    case VirtIOPciCapType::device_cfg:
+	return "device";
+    case VirtIOPciCapType::pci_cfg:
+	return "pci cfg access";
+    case VirtIOPciCapType::shared_memory_cfg:
+	return "shared memory";
+    case VirtIOPciCapType::vendor_cfg:
+	return "vendor";
+    default:
+	return "< unknown >";
+    }
+}
+
+struct VirtIOPciCap
+{
+    VirtIOPciCapType cfg_type_;
+    uint8_t          bar_;
+    // tells apart multiple shared memory regions, e.g. the virtio-fs
+    // DAX window is id 0
+    uint8_t          id_;
+    // shared memory regions use struct virtio_pci_cap64 with 64-bit
+    // offset and length
+    uint64_t         offset_;
+    uint64_t         length_;
+};
+
+enum class PciIrqMode
+{
+    intx,
+    msi,
+    msix
+};
+
+struct PciTransportInfo
+{
+    // e.g. 0000:00:01.0
+    std::string               addr_;
+    std::vector<VirtIOPciCap> caps_;
+    // only valid if a notify capability is present
+    uint32_t                  notify_off_multiplier_ {0};
+    // false if config space beyond the standard header is not
+    // readable, i.e. capabilities can't be decoded without root
+    bool                      caps_readable_ {false};
+    // 0 if the function has no MSI-X capability
+    uint16_t                  msix_table_size_ {0};
+    bool                      msix_enabled_ {false};
+    PciIrqMode                irq_mode_ {PciIrqMode::intx};
+    // number of allocated MSI/MSI-X vectors
+    uint32_t                  irq_vectors_ {0};
+    // legacy INTx line
+    uint32_t                  irq_ {0};
+    // empty for conventional PCI functions
+    std::string               link_speed_;
+    std::string               link_width_;
+    std::string               max_link_speed_;
+    std::string               max_link_width_;
+};
+
+struct TransportInfo
+{
+    VirtIOTransport                 transport_ {VirtIOTransport::unknown};
+    // name of the parent device on the transport bus
+    std::string                     parent_;
+    std::optional<PciTransportInfo> pci_;
+    // number of virtqueues in use that get an interrupt (callback-less
+    // ones like the virtio-net control vq don't), if the type exposes it
+    std::optional<uint32_t>         queues_;
+};
+
+TransportInfo DevGetTransportInfo(const VirtIODevDesc &desc);
+
+// Modern virtio-pci needs a vector per queue with a callback plus one for
+// config changes, otherwise the driver falls back to shared vectors or INTx
+constexpr bool IrqVectorsShort(const uint32_t vectors, const uint32_t irq_queues)
+{
+    return vectors < irq_queues + 1;
+}
+
+bool TransportIrqStarved(const TransportInfo &info);
+
+} // namespace virtio
@@ -2,10 +2,22 @@
 // Copyright (C) 2025 Petr Vyazovik <xen@f-m.fm>
 
 #include "ui.h"
+#include "ui_elements.h"
+#include "bounded_queue.h"
+#include "feat_names.h"
+#include "instrument.h"
+#include "transport.h"
+#include "vdpa_bus.h"
 #include "virtio_bus.h"
 
 #include <fmt/core.h>
 
+#include <algorithm>
+#include <bit>
+#include <cstdio>
+#include <exception>
+#include <stdexcept>
+#include <thread>
 #include <vector>
 
 #include <ftxui/dom/table.hpp>
@@ -21,6 +33,8 @@ namespace ui {
 
 static void RenderOnScreen(Element elem)
 {
+    VI_PHASE_SCOPE(render);
+
     auto screen = Screen::Create(Dimension::Fit(elem, true));
     Render(screen, elem);
 
@@ -28,13 +42,9 @@ static void RenderOnScreen(Element elem)
     fmt::print("\n");
 }
 
-void ListVirtIODevices()
+Element CreateDevListElement(const virtio::virtio_devs_ct &devs)
 {
-    auto devs = virtio::GetVirtioDevMap();
-    if (devs.empty()) {
-        fmt::print("No registered VirtIO devices found\n");
-        return;
-    }
+    VI_PHASE_SCOPE(table_build);
 
     std::vector<Elements> tbl;
 
@@ -77,10 +87,140 @@ void ListVirtIODevices()
         table.Render()
     });
 
-    RenderOnScreen(doc);
+    return doc;
 }
 
-static Element
+static void
+PrintDevScanErrors(const std::vector<virtio::DevScanErrorRecord> &errors)
+{
+    if (errors.empty())
+        return;
+
+    fmt::print("{} devices could not be read:\n", errors.size());
+    for (const auto &err : errors)
+        fmt::print("  {}: {}\n", err.name_, virtio::DevScanErrorMsg(err));
+}
+
+// device record handed from the bus scanner to the list renderer
+struct DevListRecord
+{
+    std::string           name_;
+    virtio::DevDescResult dev_;
+};
+
+// enough to keep the renderer busy, small enough to bound memory
+constexpr size_t dev_list_queue_capacity {64};
+
+static constexpr size_t
+DevTypeNameMaxLen()
+{
+    size_t len = 0;
+    for (auto type : magic_enum::enum_values<virtio::VirtIODevType>())
+        len = std::max(len, virtio::VirtIODevTypeName(type).size());
+    return len;
+}
+
+// Rows are printed as soon as the device is read, so all column
+// widths have to be known upfront: names come from the bus listing,
+// the rest are fixed-width.
+static void
+ListVirtIODevicesProgressive()
+{
+    auto names = virtio::GetVirtioDevNames();
+    if (names.empty()) {
+        fmt::print("No registered VirtIO devices found\n");
+        return;
+    }
+
+    size_t name_width = std::string_view {"name"}.size();
+    for (const auto &name : names)
+        name_width = std::max(name_width, name.size());
+    // "[NN] <type name>"
+    constexpr size_t type_width = 5 + DevTypeNameMaxLen();
+    // "0x" + 16 / 8 hex digits
+    constexpr size_t features_width = 18;
+    constexpr size_t status_width = 10;
+
+    auto print_row = [&](std::string_view name, std::string_view type,
+                         std::string_view features, std::string_view status,
+                         std::string_view aux) {
+        VI_PHASE_SCOPE(render);
+        fmt::print("{:<{}}  {:<{}}  {:<{}}  {:<{}}  {}\n",
+                   name, name_width, type, type_width,
+                   features, features_width, status, status_width, aux);
+    };
+
+    BoundedQueue<DevListRecord> queue {dev_list_queue_capacity};
+    std::exception_ptr scan_error;
+
+    std::thread scanner {[&]() {
+        try {
+            auto aux_index = virtio::AuxInfoIndex::Build();
+            for (const auto &name : names) {
+                if (!queue.Push({name, virtio::ScanBusEntry(virtio::virtio_devs_path, name, aux_index)}))
+                    break;
+            }
+        } catch (...) {
+            scan_error = std::current_exception();
+        }
+        queue.Close();
+    }};
+
+    print_row("name", "type", "features", "status", "aux");
+    size_t count = 0;
+    std::vector<virtio::DevScanErrorRecord> errors;
+
+    auto next_record = [&queue]() {
+        auto rec = queue.TryPop();
+        if (rec.has_value())
+            return rec;
+        // about to wait for the scanner, show what we have so far
+        std::fflush(stdout);
+        return queue.Pop();
+    };
+
+    while (auto rec = next_record()) {
+        if (!rec->dev_) {
+            errors.push_back(std::move(rec->dev_.error_));
+            continue;
+        }
+
+        const auto &desc = rec->dev_.desc_.value();
+        print_row(rec->name_,
+                  fmt::format("[{:>2}] {}", e_to_type(desc.dev_type_),
+                              virtio::VirtIODevTypeName(desc.dev_type_)),
+                  fmt::format("{:#018x}", desc.features_),
+                  fmt::format("{:#010x}", desc.status_),
+                  desc.aux_info_);
+        count++;
+    }
+
+    scanner.join();
+    if (scan_error)
+        std::rethrow_exception(scan_error);
+
+    fmt::print("{} devices\n", count);
+    PrintDevScanErrors(errors);
+}
+
+void ListVirtIODevices()
+{
+    if (cmdl_opts.progressive_list_) {
+        ListVirtIODevicesProgressive();
+        return;
+    }
+
+    auto scan = virtio::ScanVirtioDevs();
+    if (scan.devs_.empty() && scan.errors_.empty()) {
+        fmt::print("No registered VirtIO devices found\n");
+        return;
+    }
+
+    RenderOnScreen(CreateDevListElement(scan.devs_));
+    PrintDevScanErrors(scan.errors_);
+}
+
+Element
 VirtIODevCreateStatusElement(const uint32_t dev_status)
 {
     std::vector<Elements> tbl;
@@ -280,7 +420,7 @@ DevFeaturesTablePopulate(const uint64_t dev1_features, const uint64_t dev2_featu
     }
 }
 
-static void
+void
 VirtIODevFeaturesTablePopulate(const uint64_t dev1_features,
                                const uint64_t dev2_features,
                                bool diff_mode,
@@ -293,12 +433,52 @@ VirtIODevFeaturesTablePopulate(const uint64_t dev1_features,
                 dev1_features, dev2_features, diff_mode, tbl,
                 magic_enum::enum_values<virtio::VirtIONetFeature>(),
                 virtio::VirtIONetDevFeatureDesc);
+    case virtio::VirtIODevType::mem_balloon_traditional:
+        return DevFeaturesTablePopulate(
+                dev1_features, dev2_features, diff_mode, tbl,
+                magic_enum::enum_values<virtio::VirtIOBalloonFeature>(),
+                virtio::VirtIOBalloonDevFeatureDesc);
+    case virtio::VirtIODevType::scsi_host:
+        return DevFeaturesTablePopulate(
+                dev1_features, dev2_features, diff_mode, tbl,
+                magic_enum::enum_values<virtio::VirtIOScsiFeature>(),
+                virtio::VirtIOScsiDevFeatureDesc);
     default:
         return;
     }
 }
 
-static Element
+// A line per negotiated feature whose required bits are missing, i.e.
+// the offload / control command it stands for is silently off
+static Elements
+FeatureDepsElements(const uint64_t dev_features, const virtio::VirtIODevType dev_type,
+                    std::string_view label = {})
+{
+    Elements elems;
+    auto broken = virtio::BrokenFeatureDeps(dev_type, dev_features);
+    const auto &names = virtio::FeatureNames(dev_type);
+
+    for (const auto &dep : virtio::FeatureDeps(dev_type)) {
+        if (!(broken >> dep.bit_ & 1))
+            continue;
+
+        std::string required;
+        for (uint32_t bit = 0; bit < virtio::feature_bits_max; bit++) {
+            if (!(dep.requires_ >> bit & 1))
+                continue;
+            if (!required.empty())
+                required += " or ";
+            required += names[bit];
+        }
+
+        elems.push_back(text(fmt::format(" {}{} requires {}", label, names[dep.bit_], required)) |
+                        color(Color::Red));
+    }
+
+    return elems;
+}
+
+Element
 VirtIODevCreateFeaturesElement(const uint64_t dev_features,
                                const virtio::VirtIODevType dev_type)
 {
@@ -323,19 +503,125 @@ VirtIODevCreateFeaturesElement(const uint64_t dev_features,
         elem = table.Render();
     }
 
-    auto features_elem = vbox({
+    Elements elems {
         hbox({
             separatorEmpty(),
             text(fmt::format("features -> {:#x}", dev_features)) | inverted,
             filler()
         }),
         elem
-    });
+    };
+
+    auto deps_elems = FeatureDepsElements(dev_features, dev_type);
+    if (!deps_elems.empty()) {
+        elems.push_back(text(" broken feature dependencies:") | bold);
+        elems.insert(elems.end(), deps_elems.begin(), deps_elems.end());
+    }
 
-    return features_elem;
+    return vbox(std::move(elems));
 }
 
 
+static std::string
+PciIrqModeName(const virtio::PciIrqMode mode)
+{
+    switch (mode) {
+    case virtio::PciIrqMode::msix:
+        return "MSI-X";
+    case virtio::PciIrqMode::msi:
+        return "MSI";
+    default:
+        return "INTx";
+    }
+}
+
+static std::string
+TransportIrqSummary(const virtio::TransportInfo &info)
+{
+    if (!info.pci_.has_value())
+        return "-";
+
+    const auto &pci = info.pci_.value();
+    if (pci.irq_mode_ == virtio::PciIrqMode::intx)
+        return fmt::format("INTx (irq {})", pci.irq_);
+
+    return fmt::format("{} {}{}", PciIrqModeName(pci.irq_mode_), pci.irq_vectors_,
+                       info.queues_.has_value() ? fmt::format("/{}", info.queues_.value() + 1) : "");
+}
+
+static std::string
+TransportLinkSummary(const virtio::PciTransportInfo &pci)
+{
+    if (pci.link_speed_.empty())
+        return "conventional PCI";
+
+    return fmt::format("{} x{} (max {} x{})", pci.link_speed_, pci.link_width_,
+                       pci.max_link_speed_, pci.max_link_width_);
+}
+
+Element
+VirtIODevCreateTransportElement(const virtio::TransportInfo &info)
+{
+    Elements elems {
+        hbox({
+            separatorEmpty(),
+            text(fmt::format("transport -> {}", virtio::VirtIOTransportName(info.transport_))) | inverted,
+            separatorEmpty(),
+            text(info.parent_) | bold,
+            filler()
+        })
+    };
+
+    if (!info.pci_.has_value())
+        return vbox(elems);
+
+    const auto &pci = info.pci_.value();
+    auto irq_elem = text(" interrupts: " + TransportIrqSummary(info) +
+                         (info.queues_.has_value() ? " vectors/needed" : " vectors"));
+    if (virtio::TransportIrqStarved(info))
+        irq_elem = irq_elem | color(Color::Red) | bold;
+
+    elems.push_back(irq_elem);
+    elems.push_back(text(fmt::format(" MSI-X table size: {}{}", pci.msix_table_size_,
+                                     pci.msix_enabled_ ? "" : " (disabled)")));
+    elems.push_back(text(" link: " + TransportLinkSummary(pci)));
+
+    if (!pci.caps_readable_) {
+        elems.push_back(text(" capabilities: config space is not readable, run as root") | dim);
+        return vbox(elems);
+    }
+
+    if (pci.caps_.empty()) {
+        elems.push_back(text(" capabilities: no virtio vendor capabilities (legacy device)") | dim);
+        return vbox(elems);
+    }
+
+    std::vector<Elements> tbl;
+    tbl.push_back({text("cap "), text("bar "), text("offset "), text("length ")});
+
+    for (const auto &cap : pci.caps_) {
+        auto cap_name = std::string {virtio::VirtIOPciCapTypeName(cap.cfg_type_)};
+        if (cap.cfg_type_ == virtio::VirtIOPciCapType::notify_cfg)
+            cap_name += fmt::format(" (off multiplier {})", pci.notify_off_multiplier_);
+
+        tbl.push_back({
+            text(cap_name),
+            text(fmt::format("{}", cap.bar_)),
+            text(fmt::format("{:#x}", cap.offset_)),
+            text(fmt::format("{:#x}", cap.length_))
+        });
+    }
+
+    auto table = Table(std::move(tbl));
+    table.SelectAll().Border(EMPTY);
+    table.SelectAll().SeparatorVertical(EMPTY);
+    table.SelectRow(0).Border(EMPTY);
+    table.SelectRow(0).DecorateCells(bold | bgcolor(Color::Blue) | color(Color::Grey15));
+    elems.push_back(table.Render());
+
+    return vbox(elems);
+}
+
 void VirtIODevDetailedInfo()
 {
     std::filesystem::path virtio_path {virtio::virtio_devs_path};
@@ -364,6 +650,8 @@ void VirtIODevDetailedInfo()
     if (!cmdl_opts.no_status_)
         elems.push_back(VirtIODevCreateStatusElement(dev_desc.status_));
 
+    elems.push_back(VirtIODevCreateTransportElement(virtio::DevGetTransportInfo(dev_desc)));
+
     elems.push_back(VirtIODevCreateFeaturesElement(dev_desc.features_,
                                                    dev_desc.dev_type_));
 
@@ -428,7 +716,18 @@ void VirtIODevFeaturesDiff()
     table.SelectCell(2, 0).DecorateCells(bold | bgcolor(Color::Yellow) | color(Color::Grey15));
     table.SelectCell(3, 0).DecorateCells(bold | bgcolor(Color::Magenta) | color(Color::Grey15));
 
-    RenderOnScreen(table.Render());
+    Elements elems {table.Render()};
+    auto dev1_deps = FeatureDepsElements(dev1_desc.features_, dev1_desc.dev_type_,
+                                         cmdl_opts.first_dev_name_ + ": ");
+    auto dev2_deps = FeatureDepsElements(dev2_desc.features_, dev2_desc.dev_type_,
+                                         cmdl_opts.second_dev_name_ + ": ");
+    if (!dev1_deps.empty() || !dev2_deps.empty()) {
+        elems.push_back(text(" broken feature dependencies:") | bold);
+        elems.insert(elems.end(), dev1_deps.begin(), dev1_deps.end());
+        elems.insert(elems.end(), dev2_deps.begin(), dev2_deps.end());
+    }
+
+    RenderOnScreen(vbox(std::move(elems)));
 }
 
 void ListVirtIODevTypes()
@@ -483,4 +782,333 @@ void VirtIODevRawFeaturesInfo()
     RenderOnScreen(doc);
 }
 
+
+static std::string
+VdpaDataPathName(const virtio::VdpaDataPath data_path)
+{
+    return data_path == virtio::VdpaDataPath::hardware ? "hardware" : "software";
+}
+
+static Element
+VdpaDataPathElement(const virtio::VdpaDataPath data_path)
+{
+    auto elem = text(VdpaDataPathName(data_path)) | bold;
+    return data_path == virtio::VdpaDataPath::hardware ? elem | color(Color::Green)
+                                                       : elem | color(Color::Yellow);
+}
+
+static std::string
+VdpaDevBinding(const virtio::VdpaDevDesc &desc)
+{
+    if (!desc.virtio_dev_.empty())
+        return desc.virtio_dev_;
+    if (!desc.vhost_dev_.empty())
+        return "/dev/" + desc.vhost_dev_;
+    return {};
+}
+
+static std::string
+VdpaSupportedClasses(uint64_t classes)
+{
+    std::string res;
+    for (; classes; classes &= classes - 1) {
+        auto dev_type = virtio::VirtIODevType {static_cast<uint32_t>(std::countr_zero(classes))};
+        if (!res.empty())
+            res += ",";
+        res += virtio::VirtIODevTypeName(dev_type);
+    }
+    return res;
+}
+
+static Element
+CreateVdpaMgmtDevListElement(const virtio::vdpa_mgmt_devs_ct &mgmt_devs)
+{
+    std::vector<Elements> tbl;
+
+    tbl.push_back({text("mgmtdev "), text("classes "),
+                   text("max vqs "), text("supported features ")});
+
+    for (const auto &mdev : mgmt_devs) {
+        auto name = mdev.bus_name_.empty() ? mdev.dev_name_
+                                           : fmt::format("{}/{}", mdev.bus_name_, mdev.dev_name_);
+        tbl.push_back({
+            text(name) | bold,
+            text(VdpaSupportedClasses(mdev.supported_classes_)),
+            text(mdev.max_vqs_ ? fmt::format("{}", mdev.max_vqs_) : "-"),
+            text(fmt::format("{:<#016x}", mdev.supported_features_))
+        });
+    }
+
+    auto table = Table(std::move(tbl));
+    table.SelectAll().Border(EMPTY);
+    table.SelectAll().Separator(EMPTY);
+    table.SelectRow(0).Border(EMPTY);
+    table.SelectRow(0).DecorateCells(bold | bgcolor(Color::Yellow) | color(Color::Grey15));
+
+    return vbox({
+        hbox({
+            separatorEmpty(),
+            text(fmt::format("{} vDPA management devices:", mgmt_devs.size())) | underlined,
+            filler()
+        }),
+        table.Render()
+    });
+}
+
+static Element
+CreateVdpaDevListElement(const virtio::vdpa_devs_ct &vdpa_devs)
+{
+    std::vector<Elements> tbl;
+
+    tbl.push_back({text("name "), text("mgmtdev "), text("data path "),
+                   text("driver "), text("bound to "), text("type "),
+                   text("features ")});
+
+    for (const auto &[name, desc] : vdpa_devs) {
+        tbl.push_back({
+            text(name) | bold,
+            text(desc.mgmt_dev_),
+            VdpaDataPathElement(desc.data_path_),
+            text(desc.driver_.empty() ? "-" : desc.driver_),
+            text(VdpaDevBinding(desc)) | color(Color::Green),
+            text(fmt::format("{}", virtio::VirtIODevTypeName(desc.dev_type_))) | inverted,
+            desc.features_valid_ ? text(fmt::format("{:<#016x}", desc.features_))
+                                 : text("not negotiated") | dim
+        });
+    }
+
+    auto table = Table(std::move(tbl));
+    table.SelectAll().Border(EMPTY);
+    table.SelectAll().Separator(EMPTY);
+    table.SelectRow(0).Border(EMPTY);
+    table.SelectRow(0).DecorateCells(bold | bgcolor(Color::Yellow) | color(Color::Grey15));
+
+    return vbox({
+        hbox({
+            separatorEmpty(),
+            text(fmt::format("{} vDPA devices:", vdpa_devs.size())) | underlined,
+            filler()
+        }),
+        table.Render()
+    });
+}
+
+// Data path of every registered VirtIO device: offloaded through
+// a vDPA device, or a plain software (emulated/paravirtual) device
+static Element
+CreateVirtioDataPathElement(const virtio::virtio_devs_ct &devs,
+                            const virtio::vdpa_devs_ct &vdpa_devs)
+{
+    std::vector<Elements> tbl;
+    uint32_t offloaded = 0;
+
+    tbl.push_back({text("name "), text("type "), text("data path ")});
+
+    for (const auto &[name, desc] : devs) {
+        auto vdpa_name = virtio::VirtioDevVdpaParent(desc.dev_path_);
+        auto vdpa_dev = vdpa_devs.find(vdpa_name);
+
+        Element data_path_elem;
+        if (vdpa_dev == vdpa_devs.end()) {
+            data_path_elem = text("software virtio") | dim;
+        } else {
+            offloaded += vdpa_dev->second.data_path_ == virtio::VdpaDataPath::hardware;
+            data_path_elem = hbox({
+                VdpaDataPathElement(vdpa_dev->second.data_path_),
+                text(fmt::format(" (vDPA {})", vdpa_name))
+            });
+        }
+
+        tbl.push_back({
+            text(name) | bold,
+            hbox({
+                text(fmt::format("{}", virtio::VirtIODevTypeName(desc.dev_type_))) | inverted,
+                separatorEmpty(),
+                text(desc.aux_info_.empty() ? "" : fmt::format("({})", desc.aux_info_)) |
+                color(Color::Green) | bold
+            }),
+            data_path_elem
+        });
+    }
+
+    auto table = Table(std::move(tbl));
+    table.SelectAll().Border(EMPTY);
+    table.SelectAll().Separator(EMPTY);
+    table.SelectRow(0).Border(EMPTY);
+    table.SelectRow(0).DecorateCells(bold | bgcolor(Color::Yellow) | color(Color::Grey15));
+
+    return vbox({
+        hbox({
+            separatorEmpty(),
+            text(fmt::format("{} VirtIO devices, {} hardware-offloaded:",
+                             devs.size(), offloaded)) | underlined,
+            filler()
+        }),
+        table.Render()
+    });
+}
+
+static void
+PrintVdpaDevsJson(const virtio::virtio_devs_ct &devs, const virtio::vdpa_devs_ct &vdpa_devs)
+{
+    for (const auto &[name, desc] : vdpa_devs) {
+        fmt::print("{{\"vdpa\":\"{}\",\"mgmtdev\":\"{}\",\"data_path\":\"{}\",\"driver\":\"{}\","
+                   "\"bound_to\":\"{}\",\"type\":{},\"features\":{}}}\n",
+                   name, desc.mgmt_dev_, VdpaDataPathName(desc.data_path_), desc.driver_,
+                   VdpaDevBinding(desc), e_to_type(desc.dev_type_),
+                   desc.features_valid_ ? fmt::format("\"{:#x}\"", desc.features_) : "null");
+    }
+
+    for (const auto &[name, desc] : devs) {
+        auto vdpa_name = virtio::VirtioDevVdpaParent(desc.dev_path_);
+        auto vdpa_dev = vdpa_devs.find(vdpa_name);
+        fmt::print("{{\"name\":\"{}\",\"type\":{},\"aux\":\"{}\",\"data_path\":\"{}\",\"vdpa\":\"{}\"}}\n",
+                   name, e_to_type(desc.dev_type_), desc.aux_info_,
+                   vdpa_dev == vdpa_devs.end() ? "software virtio"
+                                               : VdpaDataPathName(vdpa_dev->second.data_path_),
+                   vdpa_name);
+    }
+}
+
+void ListVdpaDevices()
+{
+    auto vdpa_devs = virtio::GetVdpaDevMap();
+    auto devs = virtio::GetVirtioDevMap();
+
+    if (cmdl_opts.json_output_) {
+        PrintVdpaDevsJson(devs, vdpa_devs);
+        return;
+    }
+
+    Elements elems;
+
+    auto mgmt_devs = virtio::GetVdpaMgmtDevs();
+    if (!mgmt_devs.empty())
+        elems.push_back(CreateVdpaMgmtDevListElement(mgmt_devs));
+
+    if (vdpa_devs.empty())
+        elems.push_back(text(" No vDPA devices found") | dim);
+    else
+        elems.push_back(CreateVdpaDevListElement(vdpa_devs));
+
+    if (!devs.empty())
+        elems.push_back(CreateVirtioDataPathElement(devs, vdpa_devs));
+
+    RenderOnScreen(vbox(elems));
+}
+
+void VdpaDevDetailedInfo()
+{
+    auto vdpa_devs = virtio::GetVdpaDevMap();
+    auto it = vdpa_devs.find(cmdl_opts.first_dev_name_);
+    if (it == vdpa_devs.end()) {
+        fmt::print("Non-existent vDPA device: {}\n", cmdl_opts.first_dev_name_);
+        throw std::runtime_error("Failed to show vDPA device info");
+    }
+
+    const auto &desc = it->second;
+    auto binding = VdpaDevBinding(desc);
+
+    Elements elems {
+        hbox({
+            text(" vDPA device ->"),
+            separatorEmpty(),
+            text(it->first) | bold,
+            separatorEmpty(),
+            text(fmt::format("type [{:#2}]:", e_to_type(desc.dev_type_))),
+            separatorEmpty(),
+            text(fmt::format("{}", virtio::VirtIODevTypeName(desc.dev_type_))) | bold,
+            separatorEmpty(),
+            text(binding.empty() ? "" : fmt::format("({})", binding)) |
+            color(Color::Green) | bold,
+            filler()
+        }),
+        hbox({
+            text(fmt::format(" mgmtdev: {}, driver: {}, data path: ", desc.mgmt_dev_,
+                             desc.driver_.empty() ? "-" : desc.driver_)),
+            VdpaDataPathElement(desc.data_path_),
+            filler()
+        })
+    };
+
+    if (desc.features_valid_)
+        elems.push_back(VirtIODevCreateFeaturesElement(desc.features_, desc.dev_type_));
+    else
+        elems.push_back(text(" features have not been negotiated yet") | dim);
+
+    RenderOnScreen(vbox(elems));
+}
+
+void ListVirtIODevTransports()
+{
+    auto devs = virtio::GetVirtioDevMap();
+    if (devs.empty()) {
+        fmt::print("No registered VirtIO devices found\n");
+        return;
+    }
+
+    std::vector<Elements> tbl;
+    uint32_t starved = 0;
+
+    tbl.push_back({text("name "), text("type "), text("transport "), text("parent "),
+                   text("interrupts "), text("msix "), text("link ")});
+
+    for (const auto &[name, desc] : devs) {
+        auto info = virtio::DevGetTransportInfo(desc);
+        bool irq_starved = virtio::TransportIrqStarved(info);
+        starved += irq_starved;
+
+        if (cmdl_opts.json_output_) {
+            const auto *pci = info.pci_.has_value() ? &info.pci_.value() : nullptr;
+            fmt::print("{{\"name\":\"{}\",\"type\":{},\"transport\":\"{}\",\"parent\":\"{}\","
+                       "\"irq_mode\":\"{}\",\"irq_vectors\":{},\"queues\":{},\"msix_table_size\":{},"
+                       "\"notify_off_multiplier\":{},\"link_speed\":\"{}\",\"link_width\":\"{}\","
+                       "\"irq_starved\":{}}}\n",
+                       name, e_to_type(desc.dev_type_), virtio::VirtIOTransportName(info.transport_),
+                       info.parent_, pci ? PciIrqModeName(pci->irq_mode_) : "",
+                       pci ? pci->irq_vectors_ : 0,
+                       info.queues_.has_value() ? fmt::format("{}", info.queues_.value()) : "null",
+                       pci ? pci->msix_table_size_ : 0, pci ? pci->notify_off_multiplier_ : 0,
+                       pci ? pci->link_speed_ : "", pci ? pci->link_width_ : "", irq_starved);
+            continue;
+        }
+
+        auto irq_elem = text(TransportIrqSummary(info));
+        if (irq_starved)
+            irq_elem = irq_elem | color(Color::Red) | bold;
+
+        tbl.push_back({
+            text(name) | bold,
+            text(fmt::format("{}", virtio::VirtIODevTypeName(desc.dev_type_))) | inverted,
+            text(fmt::format("{}", virtio::VirtIOTransportName(info.transport_))),
+            text(info.parent_),
+            irq_elem,
+            text(info.pci_.has_value() && info.pci_->msix_table_size_ ?
+                 fmt::format("{}", info.pci_->msix_table_size_) : "-"),
+            text(info.pci_.has_value() ? TransportLinkSummary(info.pci_.value()) : "-")
+        });
+    }
+
+    if (cmdl_opts.json_output_)
+        return;
+
+    auto table = Table(std::move(tbl));
+    table.SelectAll().Border(EMPTY);
+    table.SelectAll().Separator(EMPTY);
+    table.SelectRow(0).Border(EMPTY);
+    table.SelectRow(0).DecorateCells(bold | bgcolor(Color::Yellow) | color(Color::Grey15));
+
+    auto doc = vbox({
+        hbox({
+            separatorEmpty(),
+            text(fmt::format("{} devices, {} with INTx or too few vectors for their queues:",
+                             devs.size(), starved)) | underlined,
+            filler()
+        }),
+        table.Render()
+    });
+
+    RenderOnScreen(doc);
+}
+
 } // namespace ui
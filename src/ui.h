@@ -12,5 +12,10 @@ void VirtIODevDetailedInfo();
 void VirtIODevFeaturesDiff();
 void ListVirtIODevTypes();
 void VirtIODevRawFeaturesInfo();
+void ListVdpaDevices();
+void VdpaDevDetailedInfo();
+void ListVirtIODevTransports();
+// interactive, periodically refreshed devices view
+void VirtIODevTop();
 
 } // namespace ui
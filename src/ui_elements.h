@@ -0,0 +1,36 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2025 Petr Vyazovik <xen@f-m.fm>
+
+#pragma once
+
+#include "transport.h"
+#include "virtio_bus.h"
+
+#include <cstdint>
+#include <vector>
+
+#include <ftxui/dom/elements.hpp>
+
+// Building blocks of the screens produced by ui:: operation modes
+namespace ui {
+
+// table of registered devices as shown by --list
+ftxui::Element CreateDevListElement(const virtio::virtio_devs_ct &devs);
+
+ftxui::Element VirtIODevCreateStatusElement(const uint32_t dev_status);
+
+ftxui::Element VirtIODevCreateFeaturesElement(const uint64_t dev_features,
+                                              const virtio::VirtIODevType dev_type);
+
+// transport, interrupts and virtio-pci capabilities
+ftxui::Element VirtIODevCreateTransportElement(const virtio::TransportInfo &info);
+
+// Append a row per feature bit of @dev_type to @tbl.
+// In diff mode bits of both devices are shown side by side.
+void VirtIODevFeaturesTablePopulate(const uint64_t dev1_features,
+                                    const uint64_t dev2_features,
+                                    bool diff_mode,
+                                    const virtio::VirtIODevType dev_type,
+                                    std::vector<ftxui::Elements> &tbl);
+
+} // namespace ui
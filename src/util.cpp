@@ -0,0 +1,74 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2025 Petr Vyazovik <xen@f-m.fm>
+
+#include "util.h"
+
+#include <fmt/core.h>
+
+#include <csignal>
+#include <ctime>
+
+namespace util {
+
+constexpr uint64_t ns_per_sec {1000000000};
+
+static volatile sig_atomic_t stop_requested {0};
+
+static void
+RequestStop([[maybe_unused]] int sig)
+{
+    stop_requested = 1;
+}
+
+std::string JsonEscape(std::string_view str)
+{
+    std::string out;
+    out.reserve(str.size());
+
+    for (char ch : str) {
+        switch (ch) {
+        case '"':
+            out += "\\\"";
+            break;
+        case '\\':
+            out += "\\\\";
+            break;
+        case '\n':
+            out += "\\n";
+            break;
+        case '\t':
+            out += "\\t";
+            break;
+        default:
+            if (static_cast<unsigned char>(ch) < 0x20)
+                out += fmt::format("\\u{:04x}", static_cast<unsigned>(ch));
+            else
+                out += ch;
+            break;
+        }
+    }
+
+    return out;
+}
+
+uint64_t NowNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * ns_per_sec + ts.tv_nsec;
+}
+
+void CatchStopSignals()
+{
+    struct sigaction sa {};
+    sa.sa_handler = RequestStop;
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+}
+
+bool StopRequested()
+{
+    return stop_requested;
+}
+
+} // namespace util
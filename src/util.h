@@ -0,0 +1,42 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2025 Petr Vyazovik <xen@f-m.fm>
+
+#pragma once
+
+#include <charconv>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Helpers shared by the report modes: number parsing for /proc and
+// sysfs contents, JSON output, timestamps and stopping a sampling loop
+// on ^C
+namespace util {
+
+// Whole of @str has to be a number, "0x" prefix switches to hex
+template <typename T>
+bool ParseNumber(std::string_view str, T &val, int base = 10)
+{
+    if (str.starts_with("0x")) {
+        str.remove_prefix(2);
+        base = 16;
+    }
+
+    auto res = std::from_chars(str.data(), str.data() + str.size(), val, base);
+    return res.ec == std::errc {} && res.ptr == str.data() + str.size();
+}
+
+// @str escaped for use inside a JSON string literal: quotes, backslashes
+// and control characters. Aux info, mount tags and paths may hold any
+// of them.
+std::string JsonEscape(std::string_view str);
+
+// CLOCK_MONOTONIC, ns
+uint64_t NowNs();
+
+// Make SIGINT and SIGTERM only set the flag StopRequested() returns,
+// so that a loop can finish with a report
+void CatchStopSignals();
+bool StopRequested();
+
+} // namespace util
@@ -0,0 +1,369 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2025 Petr Vyazovik <xen@f-m.fm>
+
+#include "vdpa_bus.h"
+#include "sysfs_source.h"
+
+#include <linux/genetlink.h>
+#include <linux/netlink.h>
+#include <linux/vdpa.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <fmt/core.h>
+
+#include <array>
+#include <cstring>
+#include <functional>
+#include <optional>
+
+namespace fs = std::filesystem;
+
+namespace virtio {
+
+using genl_attrs_ct = std::array<std::string_view, VDPA_ATTR_MAX + 1>;
+
+// Minimal synchronous generic netlink client, just enough to issue
+// "vdpa" family GET/dump requests
+class GenlSocket
+{
+    public:
+        GenlSocket()
+        {
+            fd_ = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_GENERIC);
+        }
+
+        ~GenlSocket()
+        {
+            if (fd_ >= 0)
+                close(fd_);
+        }
+
+        GenlSocket(const GenlSocket &) = delete;
+        GenlSocket &operator=(const GenlSocket &) = delete;
+
+        // Returns false if the family is not registered (vdpa module not loaded)
+        bool Resolve(std::string_view family)
+        {
+            if (fd_ < 0)
+                return false;
+
+            std::string name {family};
+            bool resolved = false;
+
+            Request(GENL_ID_CTRL, CTRL_CMD_GETFAMILY, 0,
+                    CTRL_ATTR_FAMILY_NAME, {name.c_str(), name.size() + 1},
+                    [&](std::string_view payload) {
+                        ForEachAttr(payload, [&](uint16_t type, std::string_view data) {
+                            if (type == CTRL_ATTR_FAMILY_ID && data.size() >= sizeof(uint16_t)) {
+                                std::memcpy(&family_id_, data.data(), sizeof(uint16_t));
+                                resolved = true;
+                            }
+                        });
+                    });
+
+            return resolved;
+        }
+
+        // Dump all objects returned by @cmd, @cb is called with the
+        // attributes of each object
+        bool Dump(uint8_t cmd, const std::function<void(const genl_attrs_ct &)> &cb)
+        {
+            return Request(family_id_, cmd, NLM_F_DUMP, 0, {},
+                           [&](std::string_view payload) {
+                               genl_attrs_ct attrs {};
+                               ForEachAttr(payload, [&](uint16_t type, std::string_view data) {
+                                   if (type < attrs.size())
+                                       attrs[type] = data;
+                               });
+                               cb(attrs);
+                           });
+        }
+
+    private:
+        static void
+        ForEachAttr(std::string_view payload,
+                    const std::function<void(uint16_t, std::string_view)> &cb)
+        {
+            while (payload.size() >= NLA_HDRLEN) {
+                nlattr attr;
+                std::memcpy(&attr, payload.data(), sizeof(attr));
+                if (attr.nla_len < NLA_HDRLEN || attr.nla_len > payload.size())
+                    return;
+
+                cb(attr.nla_type & NLA_TYPE_MASK,
+                   payload.substr(NLA_HDRLEN, attr.nla_len - NLA_HDRLEN));
+
+                auto step = std::min<size_t>(NLA_ALIGN(attr.nla_len), payload.size());
+                payload.remove_prefix(step);
+            }
+        }
+
+        bool Request(uint16_t family, uint8_t cmd, uint16_t flags,
+                     uint16_t attr_type, std::string_view attr_data,
+                     const std::function<void(std::string_view)> &cb)
+        {
+            alignas(nlmsghdr) std::array<char, 256> req {};
+            auto *nlh = reinterpret_cast<nlmsghdr *>(req.data());
+            auto *genlh = reinterpret_cast<genlmsghdr *>(NLMSG_DATA(nlh));
+
+            nlh->nlmsg_len = NLMSG_LENGTH(GENL_HDRLEN);
+            nlh->nlmsg_type = family;
+            nlh->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK | flags;
+            nlh->nlmsg_seq = ++seq_;
+            genlh->cmd = cmd;
+            genlh->version = family == GENL_ID_CTRL ? 1 : VDPA_GENL_VERSION;
+
+            if (attr_type != 0) {
+                auto attr_len = NLA_HDRLEN + attr_data.size();
+                if (NLMSG_ALIGN(nlh->nlmsg_len) + NLA_ALIGN(attr_len) > req.size())
+                    return false;
+                auto *attr = reinterpret_cast<nlattr *>(req.data() + NLMSG_ALIGN(nlh->nlmsg_len));
+                attr->nla_type = attr_type;
+                attr->nla_len = attr_len;
+                std::memcpy(reinterpret_cast<char *>(attr) + NLA_HDRLEN,
+                            attr_data.data(), attr_data.size());
+                nlh->nlmsg_len = NLMSG_ALIGN(nlh->nlmsg_len) + NLA_ALIGN(attr_len);
+            }
+
+            if (send(fd_, req.data(), nlh->nlmsg_len, 0) < 0)
+                return false;
+
+            std::array<char, 32768> buf;
+
+            for (;;) {
+                auto len = recv(fd_, buf.data(), buf.size(), 0);
+                if (len < 0)
+                    return false;
+
+                for (auto *msg = reinterpret_cast<nlmsghdr *>(buf.data());
+                     NLMSG_OK(msg, static_cast<uint32_t>(len));
+                     msg = NLMSG_NEXT(msg, len)) {
+                    if (msg->nlmsg_seq != seq_)
+                        continue;
+                    if (msg->nlmsg_type == NLMSG_DONE)
+                        return true;
+                    if (msg->nlmsg_type == NLMSG_ERROR) {
+                        // ack is an error message with zero error code
+                        auto *err = reinterpret_cast<nlmsgerr *>(NLMSG_DATA(msg));
+                        return err->error == 0;
+                    }
+                    if (msg->nlmsg_len < NLMSG_LENGTH(GENL_HDRLEN))
+                        continue;
+
+                    auto *payload = static_cast<char *>(NLMSG_DATA(msg)) + GENL_HDRLEN;
+                    cb({payload, msg->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN)});
+                }
+            }
+        }
+
+        int      fd_ {-1};
+        uint16_t family_id_ {0};
+        uint32_t seq_ {0};
+};
+
+template <typename T>
+static std::optional<T>
+AttrGet(const genl_attrs_ct &attrs, const int type)
+{
+    if (attrs[type].size() < sizeof(T))
+        return std::nullopt;
+
+    T val;
+    std::memcpy(&val, attrs[type].data(), sizeof(T));
+    return val;
+}
+
+static std::string
+AttrGetString(const genl_attrs_ct &attrs, const int type)
+{
+    auto str = attrs[type];
+    // strip NUL terminator
+    return std::string {str.substr(0, str.find('\0'))};
+}
+
+static std::string
+ReadLinkName(const fs::path &path)
+{
+    auto target = ActiveSysfs().ReadLink(path);
+    return target.has_value() ? target->filename().string() : std::string {};
+}
+
+// Decide whether the vDPA parent is a real device and build the
+// management device name in the same form as `vdpa mgmtdev show`
+static void
+DevGetParentInfo(const fs::path &dev_path, VdpaDevDesc &desc)
+{
+    auto canonical = ActiveSysfs().Canonical(dev_path);
+    if (!canonical.has_value()) {
+        desc.data_path_ = VdpaDataPath::software;
+        return;
+    }
+
+    auto parent = canonical->parent_path();
+
+    auto parent_bus = ReadLinkName(parent / "subsystem");
+    auto parent_name = parent.filename().string();
+
+    if (parent_bus.empty()) {
+        desc.mgmt_dev_ = parent_name;
+        desc.data_path_ = VdpaDataPath::software;
+        return;
+    }
+
+    desc.mgmt_dev_ = fmt::format("{}/{}", parent_bus, parent_name);
+
+    // SmartNIC drivers (e.g. mlx5) expose vDPA through an auxiliary
+    // device which is itself a child of the PCI function
+    if (parent_bus == "auxiliary")
+        parent_bus = ReadLinkName(parent.parent_path() / "subsystem");
+
+    desc.data_path_ = parent_bus == "pci" ? VdpaDataPath::hardware
+                                          : VdpaDataPath::software;
+}
+
+static void
+DevGetChildren(const fs::path &dev_path, VdpaDevDesc &desc)
+{
+    const auto &sysfs = ActiveSysfs();
+
+    for (const auto &name : sysfs.ListDir(dev_path).value_or(std::vector<std::string> {})) {
+        if (name.starts_with("virtio") && sysfs.ListDir(dev_path / name).has_value())
+            desc.virtio_dev_ = name;
+        else if (name.starts_with("vhost-vdpa-"))
+            desc.vhost_dev_ = name;
+    }
+}
+
+static VdpaDevDesc
+CreateVdpaDevDesc(const fs::path &dev_path)
+{
+    VdpaDevDesc desc {};
+    desc.dev_path_ = dev_path;
+    desc.driver_ = ReadLinkName(dev_path / "driver");
+
+    DevGetParentInfo(dev_path, desc);
+    DevGetChildren(dev_path, desc);
+
+    // virtio_vdpa: the virtio device carries type and negotiated features;
+    // only these two attributes are read, a full device description
+    // would look up aux info for every vDPA device
+    if (!desc.virtio_dev_.empty()) {
+        fs::path vdev_path {fs::path {virtio_devs_path} / desc.virtio_dev_};
+        auto type_attr = ActiveSysfs().ReadAttr(vdev_path / "device");
+        auto features_attr = ActiveSysfs().ReadAttr(vdev_path / "features");
+
+        uint32_t type;
+        uint64_t features;
+        if (type_attr.has_value() && features_attr.has_value() &&
+            ParseDevTypeAttr(*type_attr, type) && ParseDevFeaturesAttr(*features_attr, features)) {
+            desc.dev_type_ = VirtIODevType {type};
+            desc.features_ = features;
+            desc.features_valid_ = true;
+        }
+    }
+
+    return desc;
+}
+
+// vhost_vdpa-bound and unbound devices have no virtio counterpart
+// in the guest kernel, ask the vdpa core directly
+static void
+DevsGetNetlinkInfo(vdpa_devs_ct &devs)
+{
+    GenlSocket sock;
+    if (!sock.Resolve(VDPA_GENL_NAME))
+        return;
+
+    sock.Dump(VDPA_CMD_DEV_GET, [&](const genl_attrs_ct &attrs) {
+        auto it = devs.find(AttrGetString(attrs, VDPA_ATTR_DEV_NAME));
+        if (it == devs.end())
+            return;
+
+        auto &desc = it->second;
+        desc.max_vqs_ = AttrGet<uint32_t>(attrs, VDPA_ATTR_DEV_MAX_VQS).value_or(0);
+        if (desc.dev_type_ == VirtIODevType::rsvd)
+            desc.dev_type_ = VirtIODevType {AttrGet<uint32_t>(attrs, VDPA_ATTR_DEV_ID).value_or(0)};
+    });
+
+    sock.Dump(VDPA_CMD_DEV_CONFIG_GET, [&](const genl_attrs_ct &attrs) {
+        auto it = devs.find(AttrGetString(attrs, VDPA_ATTR_DEV_NAME));
+        if (it == devs.end() || it->second.features_valid_)
+            return;
+
+        // only reported once the driver has set FEATURES_OK
+        auto features = AttrGet<uint64_t>(attrs, VDPA_ATTR_DEV_NEGOTIATED_FEATURES);
+        if (features.has_value()) {
+            it->second.features_ = features.value();
+            it->second.features_valid_ = true;
+        }
+    });
+}
+
+vdpa_devs_ct GetVdpaDevMap()
+{
+    vdpa_devs_ct devs;
+    fs::path vdpa_path {vdpa_devs_path};
+
+    auto entries = ActiveSysfs().ListDir(vdpa_path);
+    if (!entries.has_value())
+        return devs;
+
+    // a bad entry only costs that device, not the report; warnings go
+    // to stderr to keep --json output intact
+    for (const auto &bus_entry : entries.value()) {
+        if (!ActiveSysfs().IsSymlink(vdpa_path / bus_entry)) {
+            fmt::print(stderr, "Skipping {}: vDPA bus entry is not a symlink\n", bus_entry);
+            continue;
+        }
+
+        auto res = devs.insert({bus_entry, CreateVdpaDevDesc(vdpa_path / bus_entry)});
+        if (!res.second)
+            fmt::print(stderr, "Skipping {}: duplicate vDPA bus entry\n", bus_entry);
+    }
+
+    // there is no kernel to ask when working on a capture
+    if (ActiveSysfs().IsLive())
+        DevsGetNetlinkInfo(devs);
+
+    return devs;
+}
+
+vdpa_mgmt_devs_ct GetVdpaMgmtDevs()
+{
+    vdpa_mgmt_devs_ct mgmt_devs;
+
+    if (!ActiveSysfs().IsLive())
+        return mgmt_devs;
+
+    GenlSocket sock;
+    if (!sock.Resolve(VDPA_GENL_NAME))
+        return mgmt_devs;
+
+    sock.Dump(VDPA_CMD_MGMTDEV_GET, [&](const genl_attrs_ct &attrs) {
+        mgmt_devs.push_back({
+            AttrGetString(attrs, VDPA_ATTR_MGMTDEV_BUS_NAME),
+            AttrGetString(attrs, VDPA_ATTR_MGMTDEV_DEV_NAME),
+            AttrGet<uint64_t>(attrs, VDPA_ATTR_MGMTDEV_SUPPORTED_CLASSES).value_or(0),
+            AttrGet<uint32_t>(attrs, VDPA_ATTR_DEV_MGMTDEV_MAX_VQS).value_or(0),
+            AttrGet<uint64_t>(attrs, VDPA_ATTR_DEV_SUPPORTED_FEATURES).value_or(0)
+        });
+    });
+
+    return mgmt_devs;
+}
+
+std::string VirtioDevVdpaParent(const fs::path &virtio_dev_path)
+{
+    auto canonical = ActiveSysfs().Canonical(virtio_dev_path);
+    if (!canonical.has_value())
+        return {};
+
+    auto parent = canonical->parent_path();
+    if (ReadLinkName(parent / "subsystem") != "vdpa")
+        return {};
+
+    return parent.filename().string();
+}
+
+} // namespace virtio
@@ -0,0 +1,71 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2025 Petr Vyazovik <xen@f-m.fm>
+
+#pragma once
+
+#include "virtio_bus.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace virtio {
+
+enum class VdpaDataPath
+{
+    // parent device is a PCI (or PCI-backed auxiliary) function, e.g. a SmartNIC VF
+    hardware,
+    // simulator, VDUSE and other purely software parents
+    software
+};
+
+// vDPA management device, as reported by the "vdpa" generic netlink family
+struct VdpaMgmtDevDesc
+{
+    std::string bus_name_;
+    std::string dev_name_;
+    // bitmask of VirtIODevType ids the management device can create
+    uint64_t    supported_classes_ {0};
+    uint32_t    max_vqs_ {0};
+    uint64_t    supported_features_ {0};
+};
+
+struct VdpaDevDesc
+{
+    // "<bus>/<device>" for bus-backed parents, device name otherwise
+    std::string           mgmt_dev_;
+    VdpaDataPath          data_path_;
+    // virtio_vdpa, vhost_vdpa or empty if unbound
+    std::string           driver_;
+    // virtioN device created by virtio_vdpa
+    std::string           virtio_dev_;
+    // vhost-vdpa-N char device created by vhost_vdpa
+    std::string           vhost_dev_;
+    VirtIODevType         dev_type_ {VirtIODevType::rsvd};
+    uint64_t              features_ {0};
+    // features are known either from the linked virtio device
+    // or from the netlink device config
+    bool                  features_valid_ {false};
+    uint32_t              max_vqs_ {0};
+    std::filesystem::path dev_path_;
+};
+
+constexpr std::string_view vdpa_devs_path {"/sys/bus/vdpa/devices"};
+
+using vdpa_devs_ct = std::map<std::string, VdpaDevDesc>;
+using vdpa_mgmt_devs_ct = std::vector<VdpaMgmtDevDesc>;
+
+// Empty if vDPA bus is not present
+vdpa_devs_ct GetVdpaDevMap();
+
+// Empty if vdpa netlink family is not available
+vdpa_mgmt_devs_ct GetVdpaMgmtDevs();
+
+// Name of the vDPA device @virtio_dev_path sits on, empty for
+// virtio devices on any other transport
+std::string VirtioDevVdpaParent(const std::filesystem::path &virtio_dev_path);
+
+} // namespace virtio
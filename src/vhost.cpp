@@ -0,0 +1,592 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2025 Petr Vyazovik <xen@f-m.fm>
+
+#include "vhost.h"
+#include "util.h"
+
+#include <fmt/core.h>
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+extern cfg::CmdLOpts cmdl_opts;
+
+namespace vhost {
+
+namespace fs = std::filesystem;
+
+constexpr std::string_view proc_path {"/proc"};
+constexpr std::string_view qemu_comm_prefix {"qemu"};
+constexpr std::string_view worker_comm_prefix {"vhost-"};
+constexpr std::string_view iothread_comm_prefix {"IO "};
+// TASK_COMM_LEN - 1
+constexpr size_t comm_len_max {15};
+
+// vhost character devices, /dev/vhost-<kind>
+enum class VhostKind
+{
+    none,
+    net,
+    scsi,
+    vsock
+};
+
+constexpr std::string_view VhostKindName(const VhostKind kind)
+{
+    switch (kind) {
+    case VhostKind::net:
+        return "vhost-net";
+    case VhostKind::scsi:
+        return "vhost-scsi";
+    case VhostKind::vsock:
+        return "vhost-vsock";
+    default:
+        return "-";
+    }
+}
+
+struct ProcThread
+{
+    int         tid_ {0};
+    std::string comm_;
+    // utime + stime, clock ticks
+    uint64_t    cpu_ticks_ {0};
+    // since boot, clock ticks
+    uint64_t    start_ticks_ {0};
+    // CPU the thread last ran on
+    int         last_cpu_ {-1};
+    std::string affinity_;
+};
+
+// -device of a virtio (or vhost) device
+struct QemuDevice
+{
+    std::string              driver_;
+    std::string              id_;
+    std::string              iothread_;
+    VhostKind                vhost_ {VhostKind::none};
+    // one vhost device (and worker) per queue pair for net
+    std::vector<int>         vhost_fds_;
+    size_t                   vhost_num_ {0};
+    std::vector<ProcThread>  workers_;
+};
+
+struct QemuProc
+{
+    int                      pid_ {0};
+    std::string              guest_;
+    std::vector<QemuDevice>  devices_;
+    // vhost fds found in /proc/<pid>/fd
+    std::map<int, VhostKind> vhost_fds_;
+    std::vector<ProcThread>  workers_;
+    std::vector<ProcThread>  iothreads_;
+};
+
+using qemu_props_type = std::map<std::string, std::string, std::less<>>;
+
+static std::optional<std::string>
+ReadProcFile(const fs::path &path)
+{
+    std::ifstream input {path, std::ios::binary};
+    if (!input)
+        return std::nullopt;
+    return std::string {std::istreambuf_iterator<char> {input}, {}};
+}
+
+static std::string
+ReadComm(const fs::path &dir)
+{
+    auto comm = ReadProcFile(dir / "comm").value_or("");
+    if (comm.ends_with('\n'))
+        comm.pop_back();
+    return comm;
+}
+
+// /proc/<pid>/task/<tid>/{stat,status}
+static ProcThread
+ReadThread(const fs::path &dir, const int tid, std::string comm)
+{
+    ProcThread thread;
+    thread.tid_ = tid;
+    thread.comm_ = std::move(comm);
+
+    // fields after "(comm)", starting with the state (field 3)
+    auto stat = ReadProcFile(dir / "stat").value_or("");
+    auto comm_end = stat.rfind(')');
+    if (comm_end != std::string::npos) {
+        std::vector<std::string_view> fields;
+        std::string_view rest {stat};
+        rest.remove_prefix(comm_end + 1);
+        while (!rest.empty()) {
+            auto start = rest.find_first_not_of(" \n");
+            if (start == std::string_view::npos)
+                break;
+            rest.remove_prefix(start);
+            auto end = rest.find_first_of(" \n");
+            fields.push_back(rest.substr(0, end));
+            rest.remove_prefix(end == std::string_view::npos ? rest.size() : end);
+        }
+
+        // utime (14), stime (15), starttime (22), processor (39)
+        uint64_t utime = 0, stime = 0;
+        if (fields.size() > 12 && util::ParseNumber(fields[11], utime) && util::ParseNumber(fields[12], stime))
+            thread.cpu_ticks_ = utime + stime;
+        if (fields.size() > 19)
+            util::ParseNumber(fields[19], thread.start_ticks_);
+        if (fields.size() > 36)
+            util::ParseNumber(fields[36], thread.last_cpu_);
+    }
+
+    std::ifstream status {dir / "status"};
+    std::string line;
+    while (std::getline(status, line)) {
+        constexpr std::string_view key {"Cpus_allowed_list:"};
+        if (!line.starts_with(key))
+            continue;
+        auto start = line.find_first_not_of(" \t", key.size());
+        if (start != std::string::npos)
+            thread.affinity_ = line.substr(start);
+        break;
+    }
+
+    return thread;
+}
+
+// -device/-netdev/-name value, either QemuOpts ("virtio-net-pci,id=net0",
+// ",," escapes a comma, the first value may omit its key) or a flat JSON
+// object ({"driver":"virtio-net-pci","id":"net0"})
+static qemu_props_type
+ParseQemuProps(std::string_view arg, std::string_view implied_key)
+{
+    qemu_props_type props;
+
+    if (arg.starts_with('{')) {
+        size_t pos = 1;
+        auto read_token = [&]() {
+            std::string token;
+            while (pos < arg.size() && (arg[pos] == ' ' || arg[pos] == ',' || arg[pos] == ':'))
+                pos++;
+            if (pos < arg.size() && arg[pos] == '"') {
+                for (pos++; pos < arg.size() && arg[pos] != '"'; pos++) {
+                    if (arg[pos] == '\\' && pos + 1 < arg.size())
+                        pos++;
+                    token += arg[pos];
+                }
+                pos++;
+                return token;
+            }
+            // nested values aren't needed, skip them as a whole
+            int depth = 0;
+            for (; pos < arg.size(); pos++) {
+                auto chr = arg[pos];
+                if (chr == '{' || chr == '[')
+                    depth++;
+                else if (chr == '}' || chr == ']')
+                    depth--;
+                if (depth < 0 || (depth == 0 && chr == ','))
+                    break;
+                token += chr;
+            }
+            return token;
+        };
+
+        while (pos < arg.size() && arg[pos] != '}') {
+            auto key = read_token();
+            auto val = read_token();
+            if (key.empty())
+                break;
+            props[key] = val;
+        }
+        return props;
+    }
+
+    std::string elem;
+    auto add_elem = [&]() {
+        auto eq = elem.find('=');
+        if (eq != std::string::npos)
+            props[elem.substr(0, eq)] = elem.substr(eq + 1);
+        else if (props.empty() && !elem.empty())
+            props[std::string {implied_key}] = elem;
+        elem.clear();
+    };
+
+    for (size_t pos = 0; pos < arg.size(); pos++) {
+        if (arg[pos] != ',') {
+            elem += arg[pos];
+            continue;
+        }
+        if (pos + 1 < arg.size() && arg[pos + 1] == ',') {
+            elem += ',';
+            pos++;
+            continue;
+        }
+        add_elem();
+    }
+    add_elem();
+
+    return props;
+}
+
+static std::string_view
+PropOr(const qemu_props_type &props, std::string_view key, std::string_view def = {})
+{
+    auto it = props.find(key);
+    return it == props.end() ? def : std::string_view {it->second};
+}
+
+// vhostfd=N, vhostfds=N:M:...
+static std::vector<int>
+VhostFds(const qemu_props_type &props)
+{
+    std::vector<int> fds;
+    std::string_view list = PropOr(props, "vhostfds", PropOr(props, "vhostfd"));
+    while (!list.empty()) {
+        auto end = list.find(':');
+        int fd;
+        if (util::ParseNumber(list.substr(0, end), fd))
+            fds.push_back(fd);
+        if (end == std::string_view::npos)
+            break;
+        list.remove_prefix(end + 1);
+    }
+    return fds;
+}
+
+static bool
+PropEnabled(const qemu_props_type &props, std::string_view key)
+{
+    auto val = PropOr(props, key);
+    return val == "on" || val == "true" || val == "yes";
+}
+
+// Devices in the order their vhost devices get created: vhost-net is
+// set up at -netdev init, in -netdev order and before any -device, so
+// vhost netdevs come first in that order, whether a NIC uses them or not
+static void
+ParseCmdline(std::string_view cmdline, QemuProc &proc)
+{
+    std::vector<std::string_view> args;
+    while (!cmdline.empty()) {
+        auto end = cmdline.find('\0');
+        args.push_back(cmdline.substr(0, end));
+        if (end == std::string_view::npos)
+            break;
+        cmdline.remove_prefix(end + 1);
+    }
+
+    std::vector<std::pair<std::string, qemu_props_type>> netdevs;
+    std::vector<qemu_props_type> devices;
+
+    for (size_t idx = 0; idx + 1 < args.size(); idx++) {
+        auto opt = args[idx];
+        if (opt.starts_with("--"))
+            opt.remove_prefix(1);
+
+        if (opt == "-name") {
+            auto props = ParseQemuProps(args[++idx], "guest");
+            proc.guest_ = PropOr(props, "guest");
+        } else if (opt == "-netdev") {
+            auto props = ParseQemuProps(args[++idx], "type");
+            netdevs.emplace_back(PropOr(props, "id"), std::move(props));
+        } else if (opt == "-device") {
+            auto props = ParseQemuProps(args[++idx], "driver");
+            auto driver = PropOr(props, "driver");
+            if (driver.starts_with("virtio-") || driver.starts_with("vhost-"))
+                devices.push_back(std::move(props));
+        }
+    }
+
+    // one slot per -netdev, filled for the vhost ones
+    std::vector<std::optional<QemuDevice>> vhost_nets(netdevs.size());
+    for (size_t idx = 0; idx < netdevs.size(); idx++) {
+        const auto &np = netdevs[idx].second;
+        QemuDevice dev;
+        dev.vhost_fds_ = VhostFds(np);
+        if (!PropEnabled(np, "vhost") && dev.vhost_fds_.empty())
+            continue;
+
+        // named after the netdev until a NIC turns up for it
+        dev.driver_ = fmt::format("netdev {}", PropOr(np, "type"));
+        dev.id_ = netdevs[idx].first;
+        dev.vhost_ = VhostKind::net;
+        size_t queues = 1;
+        util::ParseNumber(PropOr(np, "queues"), queues);
+        dev.vhost_num_ = std::max(dev.vhost_fds_.size(), queues);
+        vhost_nets[idx] = std::move(dev);
+    }
+
+    std::vector<bool> netdev_used(netdevs.size());
+    std::vector<QemuDevice> net_devs, other_devs;
+    for (const auto &props : devices) {
+        QemuDevice dev;
+        dev.driver_ = PropOr(props, "driver");
+        dev.id_ = PropOr(props, "id", dev.driver_);
+        dev.iothread_ = PropOr(props, "iothread");
+
+        if (dev.driver_.starts_with("virtio-net")) {
+            auto netdev = std::find_if(netdevs.begin(), netdevs.end(), [&](const auto &entry) {
+                return entry.first == PropOr(props, "netdev");
+            });
+            auto idx = static_cast<size_t>(netdev - netdevs.begin());
+            if (netdev != netdevs.end() && vhost_nets[idx].has_value() && !netdev_used[idx]) {
+                netdev_used[idx] = true;
+                vhost_nets[idx]->driver_ = std::move(dev.driver_);
+                vhost_nets[idx]->id_ = std::move(dev.id_);
+                vhost_nets[idx]->iothread_ = std::move(dev.iothread_);
+            } else {
+                net_devs.push_back(std::move(dev));
+            }
+            continue;
+        }
+
+        if (dev.driver_.starts_with("vhost-scsi"))
+            dev.vhost_ = VhostKind::scsi;
+        else if (dev.driver_.starts_with("vhost-vsock"))
+            dev.vhost_ = VhostKind::vsock;
+        if (dev.vhost_ != VhostKind::none) {
+            dev.vhost_fds_ = VhostFds(props);
+            dev.vhost_num_ = 1;
+        }
+        other_devs.push_back(std::move(dev));
+    }
+
+    proc.devices_.clear();
+    for (auto &dev : vhost_nets)
+        if (dev.has_value())
+            proc.devices_.push_back(std::move(*dev));
+    std::move(net_devs.begin(), net_devs.end(), std::back_inserter(proc.devices_));
+    std::move(other_devs.begin(), other_devs.end(), std::back_inserter(proc.devices_));
+}
+
+static VhostKind
+VhostFdKind(const fs::path &link)
+{
+    std::error_code ec;
+    auto target = fs::read_symlink(link, ec);
+    if (ec)
+        return VhostKind::none;
+
+    auto str = target.string();
+    if (str == "/dev/vhost-net")
+        return VhostKind::net;
+    if (str == "/dev/vhost-scsi")
+        return VhostKind::scsi;
+    if (str == "/dev/vhost-vsock")
+        return VhostKind::vsock;
+    return VhostKind::none;
+}
+
+static void
+ReadQemuProc(const fs::path &dir, QemuProc &proc)
+{
+    ParseCmdline(ReadProcFile(dir / "cmdline").value_or(""), proc);
+
+    std::error_code ec;
+    for (const auto &entry : fs::directory_iterator {dir / "fd", ec}) {
+        int fd;
+        if (!util::ParseNumber(entry.path().filename().string(), fd))
+            continue;
+        auto kind = VhostFdKind(entry.path());
+        if (kind != VhostKind::none)
+            proc.vhost_fds_[fd] = kind;
+    }
+
+    for (const auto &entry : fs::directory_iterator {dir / "task", ec}) {
+        int tid;
+        if (!util::ParseNumber(entry.path().filename().string(), tid))
+            continue;
+        auto comm = ReadComm(entry.path());
+        if (comm.starts_with(worker_comm_prefix))
+            proc.workers_.push_back(ReadThread(entry.path(), tid, std::move(comm)));
+        else if (comm.starts_with(iothread_comm_prefix))
+            proc.iothreads_.push_back(ReadThread(entry.path(), tid, std::move(comm)));
+    }
+}
+
+// vhost doesn't tell which device a worker serves; workers are created
+// in the same order as the vhost devices, so hand them out by tid
+static std::vector<ProcThread>
+AssignWorkers(QemuProc &proc)
+{
+    auto by_tid = [](const ProcThread &lhs, const ProcThread &rhs) { return lhs.tid_ < rhs.tid_; };
+    std::sort(proc.workers_.begin(), proc.workers_.end(), by_tid);
+    std::sort(proc.iothreads_.begin(), proc.iothreads_.end(), by_tid);
+
+    // devices opened by QEMU itself take the remaining fds of their kind
+    std::map<int, VhostKind> free_fds = proc.vhost_fds_;
+    for (const auto &dev : proc.devices_)
+        for (auto fd : dev.vhost_fds_)
+            free_fds.erase(fd);
+
+    size_t next = 0;
+    for (auto &dev : proc.devices_) {
+        for (size_t num = dev.vhost_fds_.size(); num < dev.vhost_num_; num++) {
+            auto it = std::find_if(free_fds.begin(), free_fds.end(), [&](const auto &entry) {
+                return entry.second == dev.vhost_;
+            });
+            if (it == free_fds.end())
+                break;
+            dev.vhost_fds_.push_back(it->first);
+            free_fds.erase(it);
+        }
+
+        for (size_t num = 0; num < dev.vhost_num_ && next < proc.workers_.size(); num++)
+            dev.workers_.push_back(proc.workers_[next++]);
+    }
+
+    return {proc.workers_.begin() + next, proc.workers_.end()};
+}
+
+// thread comm is truncated, so are long iothread ids in it
+static bool
+IothreadMatches(const ProcThread &thread, std::string_view id)
+{
+    std::string_view name {thread.comm_};
+    name.remove_prefix(iothread_comm_prefix.size());
+    if (thread.comm_.size() == comm_len_max)
+        return !id.empty() && id.starts_with(name);
+    return name == id;
+}
+
+struct CpuClock
+{
+    uint64_t hz_ {100};
+    // seconds since boot, 0 if unknown
+    double   uptime_ {0};
+};
+
+static void
+PrintThread(const QemuProc &proc, const QemuDevice *dev, const ProcThread &thread,
+            std::string_view role, const CpuClock &clock)
+{
+    double cpu_secs = static_cast<double>(thread.cpu_ticks_) / clock.hz_;
+    double alive = clock.uptime_ - static_cast<double>(thread.start_ticks_) / clock.hz_;
+    std::optional<double> cpu_pct;
+    if (clock.uptime_ > 0 && alive > 0)
+        cpu_pct = 100.0 * cpu_secs / alive;
+
+    if (cmdl_opts.json_output_) {
+        fmt::print("{{\"pid\":{},\"guest\":\"{}\",\"device\":{},\"driver\":{},\"thread\":\"{}\","
+                   "\"tid\":{},\"comm\":\"{}\",\"cpu_seconds\":{:.2f},\"cpu_pct\":{},"
+                   "\"last_cpu\":{},\"affinity\":\"{}\"}}\n",
+                   proc.pid_, proc.guest_,
+                   dev ? fmt::format("\"{}\"", dev->id_) : "null",
+                   dev ? fmt::format("\"{}\"", dev->driver_) : "null",
+                   role, thread.tid_, thread.comm_, cpu_secs,
+                   cpu_pct ? fmt::format("{:.1f}", *cpu_pct) : "null",
+                   thread.last_cpu_, thread.affinity_);
+        return;
+    }
+
+    fmt::print("      tid {:<8} {:<16} {:>10.2f}s {:>6}  cpu {:<4} affinity {}\n",
+               thread.tid_, thread.comm_, cpu_secs,
+               cpu_pct ? fmt::format("{:.1f}%", *cpu_pct) : "-",
+               thread.last_cpu_, thread.affinity_.empty() ? "-" : thread.affinity_);
+}
+
+static void
+PrintQemuProc(QemuProc &proc, const CpuClock &clock)
+{
+    auto unassigned = AssignWorkers(proc);
+
+    if (!cmdl_opts.json_output_)
+        fmt::print("QEMU {} ({})\n", proc.pid_, proc.guest_.empty() ? "-" : proc.guest_);
+
+    for (const auto &dev : proc.devices_) {
+        if (!cmdl_opts.json_output_) {
+            std::string backend;
+            if (dev.vhost_ != VhostKind::none) {
+                backend = fmt::format("{} fds", VhostKindName(dev.vhost_));
+                for (size_t idx = 0; idx < dev.vhost_fds_.size(); idx++)
+                    backend += fmt::format("{}{}", idx ? "," : " ", dev.vhost_fds_[idx]);
+                if (dev.vhost_fds_.empty())
+                    backend += " -";
+            }
+            if (!dev.iothread_.empty())
+                backend += fmt::format("{}iothread {}", backend.empty() ? "" : "  ", dev.iothread_);
+            if (backend.empty())
+                fmt::print("  {:<16} {}\n", dev.id_, dev.driver_);
+            else
+                fmt::print("  {:<16} {:<22} {}\n", dev.id_, dev.driver_, backend);
+
+            if (dev.vhost_ != VhostKind::none && dev.workers_.size() < dev.vhost_num_)
+                fmt::print("      ! {} of {} vhost workers found\n", dev.workers_.size(), dev.vhost_num_);
+        }
+
+        for (const auto &worker : dev.workers_)
+            PrintThread(proc, &dev, worker, "vhost", clock);
+        for (const auto &thread : proc.iothreads_)
+            if (!dev.iothread_.empty() && IothreadMatches(thread, dev.iothread_))
+                PrintThread(proc, &dev, thread, "iothread", clock);
+    }
+
+    if (!unassigned.empty() && !cmdl_opts.json_output_)
+        fmt::print("  vhost workers without a device\n");
+    for (const auto &worker : unassigned)
+        PrintThread(proc, nullptr, worker, "vhost", clock);
+}
+
+void ShowVhostWorkers()
+{
+    fs::path root {cmdl_opts.proc_root_path_.empty() ? proc_path : cmdl_opts.proc_root_path_};
+
+    std::error_code ec;
+    fs::directory_iterator dir_it {root, ec};
+    if (ec) {
+        fmt::print("Failed to read {}: {}\n", root.string(), ec.message());
+        throw std::runtime_error("Failed to read processes");
+    }
+
+    CpuClock clock;
+    if (auto hz = sysconf(_SC_CLK_TCK); hz > 0)
+        clock.hz_ = static_cast<uint64_t>(hz);
+    if (auto uptime = ReadProcFile(root / "uptime"))
+        clock.uptime_ = std::strtod(uptime->c_str(), nullptr);
+
+    // single pass: QEMU processes and pre-6.4 vhost kernel threads,
+    // the latter belong to the process whose pid they're named after
+    std::map<int, QemuProc> procs;
+    std::map<int, std::vector<ProcThread>> kthread_workers;
+    for (const auto &entry : dir_it) {
+        int pid;
+        if (!util::ParseNumber(entry.path().filename().string(), pid))
+            continue;
+
+        auto comm = ReadComm(entry.path());
+        if (comm.starts_with(qemu_comm_prefix)) {
+            auto &proc = procs[pid];
+            proc.pid_ = pid;
+            ReadQemuProc(entry.path(), proc);
+        } else if (comm.starts_with(worker_comm_prefix)) {
+            int owner;
+            if (util::ParseNumber(std::string_view {comm}.substr(worker_comm_prefix.size()), owner))
+                kthread_workers[owner].push_back(ReadThread(entry.path(), pid, std::move(comm)));
+        }
+    }
+
+    for (auto &[owner, workers] : kthread_workers) {
+        auto it = procs.find(owner);
+        if (it != procs.end())
+            std::move(workers.begin(), workers.end(), std::back_inserter(it->second.workers_));
+    }
+
+    if (procs.empty()) {
+        fmt::print("No QEMU processes found\n");
+        return;
+    }
+
+    for (auto &[pid, proc] : procs)
+        PrintQemuProc(proc, clock);
+}
+
+} // namespace vhost
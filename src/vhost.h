@@ -0,0 +1,20 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2025 Petr Vyazovik <xen@f-m.fm>
+
+#pragma once
+
+#include "config.h"
+
+// Host side of virtio devices: QEMU processes, the virtio devices on
+// their command lines and the threads serving them. vhost-net/scsi/vsock
+// workers are "vhost-<QEMU pid>" tasks (threads of QEMU since Linux 6.4,
+// kernel threads before), I/O threads are QEMU threads named
+// "IO <iothread id>". /proc is walked once: comm of every process, then
+// cmdline, fd and task of the QEMU ones.
+namespace vhost {
+
+// Show QEMU processes, their virtio devices and per-thread CPU use
+// and affinity (--proc-root for a saved or fake proc tree)
+void ShowVhostWorkers();
+
+} // namespace vhost
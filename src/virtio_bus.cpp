@@ -2,10 +2,12 @@
 // Copyright (C) 2025 Petr Vyazovik <xen@f-m.fm>
 
 #include "virtio_bus.h"
+#include "instrument.h"
+#include "sysfs_source.h"
 
 #include <algorithm>
-#include <bitset>
-#include <fstream>
+#include <array>
+#include <cctype>
 #include <fmt/core.h>
 
 namespace virtio {
@@ -17,193 +19,527 @@ constexpr uint32_t virtio_dev_id_buf_len {6};
 constexpr uint32_t virtio_dev_status_buf_len {10};
 constexpr uint32_t virtio_dev_features_buf_len {64};
 
-static VirtIODevType
-DevGetType(const fs::path &vd_dev_path)
-{
-    std::string tmp_buf;
+constexpr std::string_view virtiofs_sysfs_path {"/sys/fs/virtiofs"};
 
-    // read device id
-    auto path = vd_dev_path / "device";
-    std::ifstream vdev_id_file {path.c_str(), std::ios::in};
-    if (!vdev_id_file.is_open()) {
-        fmt::print("Failed to obtain device type for {}\n", vd_dev_path.c_str());
-        throw std::runtime_error("Failed to process VirtIO device");
-    }
-
-    std::getline(vdev_id_file, tmp_buf);
-    if (tmp_buf.length() != virtio_dev_id_buf_len) {
-        fmt::print("Failed to read device type for {}\n", vd_dev_path.c_str());
-        throw std::runtime_error("Failed to process VirtIO device");
-    }
+AttrParseResult
+ParseDevTypeAttr(std::string_view buf, uint32_t &type)
+{
+    // "0x%04x"
+    return ParseFixedHex(buf, virtio_dev_id_buf_len - 2, type);
+}
 
-    uint32_t type;
-    auto res = std::sscanf(tmp_buf.c_str(), "0x%04x", &type);
-    if (res != 1) {
-        fmt::print("Failed to parse device type for {}\n", vd_dev_path.c_str());
-        throw std::runtime_error("Failed to process VirtIO device");
-    }
+AttrParseResult
+ParseDevStatusAttr(std::string_view buf, uint32_t &status)
+{
+    // "0x%08x"
+    return ParseFixedHex(buf, virtio_dev_status_buf_len - 2, status);
+}
 
-    if (type > e_to_type(VirtIODevType::dev_type_max)) {
-        fmt::print("Parsed device type (%u) for {} > max defined\n",
-                   vd_dev_path.c_str());
+AttrParseResult
+ParseDevFeaturesAttr(std::string_view buf, uint64_t &features, uint64_t &features_hi)
+{
+    // see drivers/virtio/virtio.c: features_show()
+    // Kernels supporting extended features print 128 bits. Bits 64-127
+    // (e.g. virtio-net UDP tunnel GSO, 65-68) are not decoded, so they
+    // are returned separately for the caller to report.
+    features_hi = 0;
+    if (buf.size() == 2 * virtio_dev_features_buf_len) {
+        uint64_t high;
+        auto res = ParseFeaturesBitString(buf.substr(virtio_dev_features_buf_len), high);
+        if (!res) {
+            res.pos_ += virtio_dev_features_buf_len;
+            return res;
+        }
+        features_hi = high;
+        buf = buf.substr(0, virtio_dev_features_buf_len);
     }
 
-    return VirtIODevType {type};
+    return ParseFeaturesBitString(buf, features);
 }
 
-static uint32_t
-DevGetStatus(const fs::path &vd_dev_path)
+AttrParseResult
+ParseDevFeaturesAttr(std::string_view buf, uint64_t &features)
 {
-    std::string tmp_buf;
-
-    // read device status
-    auto path = vd_dev_path / "status";
-    std::ifstream vdev_status_file {path.c_str(), std::ios::in};
-    if (!vdev_status_file.is_open()) {
-        fmt::print("Failed to obtain device status for {}\n", vd_dev_path.c_str());
-        throw std::runtime_error("Failed to process VirtIO device");
-    }
-
-    std::getline(vdev_status_file, tmp_buf);
-    if (tmp_buf.length() != virtio_dev_status_buf_len) {
-        fmt::print("Failed to read device status for {}\n", vd_dev_path.c_str());
-        throw std::runtime_error("Failed to process VirtIO device");
-    }
+    uint64_t features_hi;
+    return ParseDevFeaturesAttr(buf, features, features_hi);
+}
 
-    uint32_t status;
-    auto res = std::sscanf(tmp_buf.c_str(), "0x%08x", &status);
-    if (res != 1) {
-        fmt::print("Failed to parse device status for {}\n", vd_dev_path.c_str());
-        throw std::runtime_error("Failed to process VirtIO device");
+std::string DevScanErrorMsg(const DevScanErrorRecord &rec)
+{
+    switch (rec.err_) {
+    case DevScanError::read_failed:
+        return fmt::format("failed to read {}", rec.attr_);
+    case DevScanError::parse_failed:
+        return fmt::format("failed to parse {}: {}", rec.attr_, rec.msg_);
+    default:
+        return std::string {DevScanErrorDesc(rec.err_)};
     }
-
-    return status;
 }
 
-static uint64_t
-DevGetFeatures(const fs::path &vd_dev_path)
+// Read and parse single attribute of the pinned device directory
+template <typename T, typename F>
+static bool
+DevReadAttr(const SysfsDir &dir, std::string_view attr, F parse,
+            T &val, DevScanErrorRecord &err)
 {
-    std::string tmp_buf;
-
-    // read device features
-    auto path = vd_dev_path / "features";
-    std::ifstream vdev_features_file {path.c_str(), std::ios::in};
-    if (!vdev_features_file.is_open()) {
-        fmt::print("Failed to obtain device features for {}\n", vd_dev_path.c_str());
-        throw std::runtime_error("Failed to process VirtIO device");
+    auto buf = dir.ReadAttr(attr);
+    if (!buf.has_value()) {
+        err.err_ = dir.Removed() ? DevScanError::removed : DevScanError::read_failed;
+        err.attr_ = attr;
+        return false;
     }
 
-    std::getline(vdev_features_file, tmp_buf);
-    if (tmp_buf.length() != virtio_dev_features_buf_len) {
-        fmt::print("Failed to read device features for {}\n", vd_dev_path.c_str());
-        throw std::runtime_error("Failed to process VirtIO device");
+    AttrParseResult parse_res;
+    {
+        VI_PHASE_SCOPE(parse);
+        parse_res = parse(buf.value(), val);
+    }
+    if (!parse_res) {
+        err.err_ = DevScanError::parse_failed;
+        err.attr_ = attr;
+        err.msg_ = fmt::format("{} at offset {}", AttrParseErrorDesc(parse_res.err_), parse_res.pos_);
+        return false;
     }
 
-    // see drivers/virtio/virtio.c: features_show()
-    std::ranges::reverse(tmp_buf);
-
-    std::bitset<virtio_dev_features_buf_len> feat_bset(tmp_buf);
-    return feat_bset.to_ulong();
+    return true;
 }
 
 static std::string
-DevAuxInfoNotImpl([[maybe_unused]] const fs::path &dev_path)
-{
-    return {};
-}
-
-static std::string
-NetdevGetAuxInfo(const fs::path &dev_path)
+NetdevGetAuxInfo(const SysfsDir &dir, const fs::path &dev_path)
 {
     // return iface name
-    auto path = dev_path / "net";
-    if (!fs::directory_entry(path).exists()) {
-        fmt::print("{} doesn't exist for network device\n", path.c_str());
+    auto entries = dir.ListDir("net");
+    if (!entries.has_value()) {
+        if (!dir.Removed())
+            fmt::print("{} doesn't exist for network device\n", (dev_path / "net").c_str());
         return {};
     }
 
     std::string iface_name{};
 
     // single entry expected in net/
-    for (const auto &iface_entry : fs::directory_iterator {path}) {
-        iface_name = iface_entry.path().filename().string();
+    for (const auto &iface_entry : entries.value()) {
+        iface_name = iface_entry;
     }
 
     return iface_name;
 }
 
 static std::string
-BlockdevGetAuxInfo(const fs::path &dev_path)
+BlockdevGetAuxInfo(const SysfsDir &dir, const fs::path &dev_path)
 {
     // return block dev full name
-    auto path = dev_path / "block";
-    if (!fs::directory_entry(path).exists()) {
-        fmt::print("{} doesn't exist for block device\n", path.c_str());
+    auto entries = dir.ListDir("block");
+    if (!entries.has_value()) {
+        if (!dir.Removed())
+            fmt::print("{} doesn't exist for block device\n", (dev_path / "block").c_str());
         return {};
     }
 
     std::string block_dev_name{"/dev/"};
 
     // single entry expected in block/
-    for (const auto &block_dev_entry : fs::directory_iterator {path}) {
-        block_dev_name += block_dev_entry.path().filename().string();
+    for (const auto &block_dev_entry : entries.value()) {
+        block_dev_name += block_dev_entry;
     }
 
     return block_dev_name;
 }
 
-// Return some information about device based on the type
+// balloon features which change how guest memory is given back, as
+// reported in the aux info column
+constexpr std::array<std::pair<VirtIOBalloonFeature, std::string_view>, 4> balloon_aux_features {{
+    {VirtIOBalloonFeature::VIRTIO_BALLOON_F_STATS_VQ, "stats"},
+    {VirtIOBalloonFeature::VIRTIO_BALLOON_F_DEFLATE_ON_OOM, "oom"},
+    {VirtIOBalloonFeature::VIRTIO_BALLOON_F_FREE_PAGE_HINT, "hint"},
+    {VirtIOBalloonFeature::VIRTIO_BALLOON_F_REPORTING, "reporting"},
+}};
+
 static std::string
-DevGetAuxInfo(const VirtIODevType dev_type, const fs::path &dev_path)
+BalloonGetAuxInfo(const SysfsDir &dir)
+{
+    // return negotiated balloon features, e.g. "stats,oom,reporting"
+    auto buf = dir.ReadAttr("features");
+    uint64_t features;
+    if (!buf.has_value() || !ParseDevFeaturesAttr(buf.value(), features))
+        return {};
+
+    std::string aux_info {};
+    for (const auto &[feature, name] : balloon_aux_features) {
+        if (!(features & (1ULL << e_to_type(feature))))
+            continue;
+        if (!aux_info.empty())
+            aux_info += ',';
+        aux_info += name;
+    }
+
+    return aux_info;
+}
+
+static std::string
+FsGetAuxInfo(const fs::path &dev_path)
 {
+    // return mount tag: virtio_fs registers /sys/fs/virtiofs/<N>/ with
+    // the tag and a link back to the device (Linux 6.10+)
+    auto dev = ActiveSysfs().Canonical(dev_path);
+    auto entries = ActiveSysfs().ListDir(virtiofs_sysfs_path);
+    if (!dev.has_value() || !entries.has_value())
+        return {};
+
+    for (const auto &entry : entries.value()) {
+        auto fs_path = fs::path {virtiofs_sysfs_path} / entry;
+        if (ActiveSysfs().Canonical(fs_path / "device") == dev)
+            return ActiveSysfs().ReadAttr(fs_path / "tag").value_or(std::string {});
+    }
+
+    return {};
+}
+
+static std::string
+JoinNames(const std::vector<std::string> &names, std::string_view prefix = {})
+{
+    std::string joined {};
+    for (const auto &name : names) {
+        if (!joined.empty())
+            joined += ',';
+        joined += prefix;
+        joined += name;
+    }
+    return joined;
+}
+
+static std::string
+DevGetAuxInfo(const VirtIODevType dev_type, const SysfsDir &dir, const fs::path &dev_path,
+              const AuxInfoIndex &aux_index)
+{
+    VI_PHASE_SCOPE(aux_info);
+
+    using DevClass = AuxInfoIndex::DevClass;
+    auto name = dev_path.filename().string();
+    std::string aux_info {};
+
     switch (dev_type) {
     case VirtIODevType::network_card:
-        return NetdevGetAuxInfo(dev_path);
+        // captures may come without /sys/class
+        if (aux_index.ClassDevs(name, DevClass::net).empty())
+            return NetdevGetAuxInfo(dir, dev_path);
+        return JoinNames(aux_index.ClassDevs(name, DevClass::net));
     case VirtIODevType::block:
-        return BlockdevGetAuxInfo(dev_path);
+        if (aux_index.ClassDevs(name, DevClass::block).empty())
+            return BlockdevGetAuxInfo(dir, dev_path);
+        return JoinNames(aux_index.ClassDevs(name, DevClass::block), "/dev/");
+    case VirtIODevType::mem_balloon_traditional:
+        return BalloonGetAuxInfo(dir);
+    case VirtIODevType::fs:
+        return FsGetAuxInfo(dev_path);
+    case VirtIODevType::scsi_host:
+        aux_info = JoinNames(aux_index.ClassDevs(name, DevClass::scsi_host));
+        break;
+    case VirtIODevType::gpu:
+        aux_info = JoinNames(aux_index.ClassDevs(name, DevClass::drm));
+        break;
+    case VirtIODevType::input:
+        aux_info = JoinNames(aux_index.ClassDevs(name, DevClass::input));
+        break;
+    case VirtIODevType::console:
+        aux_info = JoinNames(aux_index.ClassDevs(name, DevClass::virtio_ports));
+        break;
+    case VirtIODevType::nitro_sec_mod:
+        aux_info = JoinNames(aux_index.ClassDevs(name, DevClass::misc));
+        break;
+    case VirtIODevType::transport_9p:
+        aux_info = dir.ReadAttr("mount_tag").value_or(std::string {});
+        break;
     default:
-        return DevAuxInfoNotImpl(dev_path);
+        break;
     }
+
+    // nothing registered on top of the device, at least the bound
+    // driver then (e.g. virtio_rng, vmw_vsock_virtio_transport)
+    if (aux_info.empty())
+        aux_info = aux_index.Driver(name);
+    return aux_info;
+}
+
+// Return some information about device based on the type
+std::string
+DevGetAuxInfo(const VirtIODevType dev_type, const fs::path &dev_path)
+{
+    return DevGetAuxInfo(dev_type, dev_path, AuxInfoIndex::Build(dev_path.parent_path()));
+}
+
+std::string
+DevGetAuxInfo(const VirtIODevType dev_type, const fs::path &dev_path, const AuxInfoIndex &aux_index)
+{
+    auto dir = ActiveSysfs().OpenDir(dev_path);
+    if (!dir)
+        return {};
+    return DevGetAuxInfo(dev_type, *dir, dev_path, aux_index);
+}
+
+// sysfs classes virtio drivers register their devices in
+constexpr std::array<std::pair<AuxInfoIndex::DevClass, std::string_view>,
+                     e_to_type(AuxInfoIndex::DevClass::dev_class_max) + 1> aux_classes {{
+    {AuxInfoIndex::DevClass::net, "net"},
+    {AuxInfoIndex::DevClass::block, "block"},
+    {AuxInfoIndex::DevClass::scsi_host, "scsi_host"},
+    {AuxInfoIndex::DevClass::drm, "drm"},
+    {AuxInfoIndex::DevClass::input, "input"},
+    {AuxInfoIndex::DevClass::misc, "misc"},
+    {AuxInfoIndex::DevClass::virtio_ports, "virtio-ports"},
+}};
+
+// "virtio<N>"
+static bool
+IsVirtioDevName(std::string_view name)
+{
+    constexpr std::string_view prefix {"virtio"};
+    return name.size() > prefix.size() && name.starts_with(prefix) &&
+           std::all_of(name.begin() + prefix.size(), name.end(),
+                       [](const char c) { return std::isdigit(static_cast<unsigned char>(c)); });
+}
+
+// Virtio device a class device link points into, if the class device is
+// registered right under it: virtioN/<entry> (scsi hosts) or
+// virtioN/<subdir>/<entry>. Deeper ones, like partitions or input event
+// nodes, belong to another class device.
+static std::optional<std::string>
+ClassDevParent(const fs::path &target, std::string_view entry)
+{
+    std::vector<std::string> comps;
+    for (const auto &comp : target)
+        comps.push_back(comp.string());
+
+    for (size_t pos = comps.size(); pos-- > 0;) {
+        if (!IsVirtioDevName(comps[pos]))
+            continue;
+        if ((pos + 1 < comps.size() && comps[pos + 1] == entry) ||
+            (pos + 2 < comps.size() && comps[pos + 2] == entry))
+            return comps[pos];
+        break;
+    }
+
+    return std::nullopt;
+}
+
+AuxInfoIndex AuxInfoIndex::Build(const fs::path &vd_path)
+{
+    VI_PHASE_SCOPE(aux_info);
+
+    AuxInfoIndex index;
+    const auto &sysfs = ActiveSysfs();
+    // <root>/bus/virtio/devices
+    auto bus_path = (vd_path.has_filename() ? vd_path : vd_path.parent_path()).parent_path();
+    auto root = bus_path.parent_path().parent_path();
+
+    for (const auto &[dev_class, class_name] : aux_classes) {
+        auto class_path = root / "class" / class_name;
+        for (const auto &entry : sysfs.ListDir(class_path).value_or(std::vector<std::string> {})) {
+            auto target = sysfs.ReadLink(class_path / entry);
+            if (!target.has_value())
+                continue;
+            auto parent = ClassDevParent(target.value(), entry);
+            if (parent.has_value())
+                index.entries_[parent.value()].class_devs_[e_to_type(dev_class)].push_back(entry);
+        }
+    }
+
+    auto drivers_path = bus_path / "drivers";
+    for (const auto &driver : sysfs.ListDir(drivers_path).value_or(std::vector<std::string> {})) {
+        for (const auto &entry : sysfs.ListDir(drivers_path / driver).value_or(std::vector<std::string> {}))
+            if (IsVirtioDevName(entry))
+                index.entries_[entry].driver_ = driver;
+    }
+
+    // directory order is arbitrary, e.g. "renderD128,card0"
+    for (auto &[name, entry] : index.entries_)
+        for (auto &devs : entry.class_devs_)
+            std::sort(devs.begin(), devs.end(), DevNameNaturalLess);
+
+    return index;
+}
+
+const std::vector<std::string> &
+AuxInfoIndex::ClassDevs(const std::string &dev_name, const DevClass dev_class) const
+{
+    static const std::vector<std::string> none;
+
+    auto it = entries_.find(dev_name);
+    return it == entries_.end() ? none : it->second.class_devs_[e_to_type(dev_class)];
+}
+
+std::string_view AuxInfoIndex::Driver(const std::string &dev_name) const
+{
+    auto it = entries_.find(dev_name);
+    return it == entries_.end() ? std::string_view {} : std::string_view {it->second.driver_};
+}
+
+DevDescResult
+TryCreateDevDesc(const fs::path &dev_path)
+{
+    return TryCreateDevDesc(dev_path, AuxInfoIndex::Build(dev_path.parent_path()));
+}
+
+DevDescResult
+TryCreateDevDesc(const fs::path &dev_path, const AuxInfoIndex &aux_index)
+{
+    auto name = dev_path.filename().string();
+    VI_DEV_SCOPE(name);
+
+    DevScanErrorRecord err {name};
+
+    // pin the directory, so that all attributes come from the same
+    // device even if it's removed and the name is reused meanwhile
+    auto dir = ActiveSysfs().OpenDir(dev_path);
+    if (!dir) {
+        err.err_ = DevScanError::removed;
+        return {std::nullopt, std::move(err)};
+    }
+
+    uint32_t type, status;
+    uint64_t features, features_hi;
+    auto parse_features = [&features_hi](std::string_view buf, uint64_t &val) {
+        return ParseDevFeaturesAttr(buf, val, features_hi);
+    };
+    if (!DevReadAttr(*dir, "device", ParseDevTypeAttr, type, err) ||
+        !DevReadAttr(*dir, "status", ParseDevStatusAttr, status, err) ||
+        !DevReadAttr(*dir, "features", parse_features, features, err))
+        return {std::nullopt, std::move(err)};
+
+    if (features_hi) {
+        fmt::print(stderr, "Feature bits 64-127 of {} are set but not decoded: 0x{:x}\n",
+                   dev_path.c_str(), features_hi);
+    }
+
+    if (type > e_to_type(VirtIODevType::dev_type_max)) {
+        fmt::print("Parsed device type ({}) for {} > max defined\n",
+                   type, dev_path.c_str());
+    }
+
+    auto device_type = VirtIODevType {type};
+    auto aux_info = DevGetAuxInfo(device_type, *dir, dev_path, aux_index);
+
+    if (dir->Removed()) {
+        err.err_ = DevScanError::removed;
+        return {std::nullopt, std::move(err)};
+    }
+
+    return {VirtIODevDesc {device_type, status, features, aux_info, dev_path}, {}};
 }
 
 VirtIODevDesc
 CreateDevDesc(const fs::path &dev_path)
 {
-    auto device_type = DevGetType(dev_path);
-    auto device_status = DevGetStatus(dev_path);
-    auto device_features = DevGetFeatures(dev_path);
-    auto aux_info = DevGetAuxInfo(device_type, dev_path);
+    auto res = TryCreateDevDesc(dev_path);
+    if (!res) {
+        fmt::print("Failed to process VirtIO device {}: {}\n",
+                   dev_path.c_str(), DevScanErrorMsg(res.error_));
+        throw std::runtime_error("Failed to process VirtIO device");
+    }
 
-    return {device_type, device_status, device_features,
-            aux_info, dev_path};
+    return std::move(res.desc_.value());
 }
 
-static virtio_devs_ct
-GetDevDescs(const fs::path &vd_path)
+std::vector<std::string>
+GetVirtioDevNames(const fs::path &vd_path)
 {
-    virtio_devs_ct devs;
+    VI_PHASE_SCOPE(dir_iter);
 
-    for (const auto &bus_entry : fs::directory_iterator {vd_path}) {
-        if (!fs::is_symlink(bus_entry)) {
-            fmt::print("VirtIO bus entry is not a symlink\n");
-            return {};
-        }
+    auto entries = ActiveSysfs().ListDir(vd_path);
+    if (!entries.has_value()) {
+        fmt::print("Failed to list VirtIO bus directory {}\n", vd_path.c_str());
+        throw std::runtime_error("Failed to populate VirtIO devices tree\n");
+    }
+
+    return entries.value();
+}
 
-        auto res = devs.insert({bus_entry.path().filename().string(),
-                                CreateDevDesc(bus_entry.path())});
-        if (!res.second) {
-            fmt::print("Failed to insert VirtIO dev entry into map\n");
-            throw std::runtime_error("Failed to populate VirtIO devices tree\n");
+DevDescResult
+ScanBusEntry(const fs::path &vd_path, const std::string &name, const AuxInfoIndex &aux_index)
+{
+    auto path = vd_path / name;
+    if (!ActiveSysfs().IsSymlink(path)) {
+        // an entry that is gone (or already replugged) is not a symlink either
+        auto err = ActiveSysfs().Exists(path) && !ActiveSysfs().IsSymlink(path)
+                   ? DevScanError::not_symlink
+                   : DevScanError::removed;
+        return {std::nullopt, {name, err}};
+    }
+
+    return TryCreateDevDesc(path, aux_index);
+}
+
+DevScanResult
+ScanVirtioDevs(const fs::path &vd_path)
+{
+    DevScanResult res;
+    auto aux_index = AuxInfoIndex::Build(vd_path);
+
+    for (const auto &name : GetVirtioDevNames(vd_path)) {
+        auto dev = ScanBusEntry(vd_path, name, aux_index);
+        if (!dev)
+            res.errors_.push_back(std::move(dev.error_));
+        else
+            res.devs_.emplace(name, std::move(dev.desc_.value()));
+    }
+
+    return res;
+}
+
+bool DevNameNaturalLess(std::string_view lhs, std::string_view rhs)
+{
+    auto digits_len = [](std::string_view str, size_t pos) {
+        size_t len = 0;
+        while (pos + len < str.size() && std::isdigit(static_cast<unsigned char>(str[pos + len])))
+            len++;
+        return len;
+    };
+
+    size_t l = 0, r = 0;
+    while (l < lhs.size() && r < rhs.size()) {
+        auto l_len = digits_len(lhs, l);
+        auto r_len = digits_len(rhs, r);
+
+        if (l_len && r_len) {
+            // skip leading zeros, then longer number is greater
+            auto l_num = lhs.substr(l, l_len);
+            auto r_num = rhs.substr(r, r_len);
+            l_num.remove_prefix(std::min(l_num.find_first_not_of('0'), l_num.size()));
+            r_num.remove_prefix(std::min(r_num.find_first_not_of('0'), r_num.size()));
+            if (l_num.size() != r_num.size())
+                return l_num.size() < r_num.size();
+            if (l_num != r_num)
+                return l_num < r_num;
+            l += l_len;
+            r += r_len;
+            continue;
         }
+
+        if (lhs[l] != rhs[r])
+            return lhs[l] < rhs[r];
+        l++;
+        r++;
     }
 
-    return devs;
+    return lhs.size() - l < rhs.size() - r;
 }
 
 virtio_devs_ct GetVirtioDevMap()
 {
-    fs::path virtio_path {virtio_devs_path};
-    return GetDevDescs(virtio_path);
+    return GetVirtioDevMap(fs::path {virtio_devs_path});
+}
+
+virtio_devs_ct GetVirtioDevMap(const fs::path &vd_path)
+{
+    auto res = ScanVirtioDevs(vd_path);
+
+    for (const auto &err : res.errors_) {
+        // unplugged while being read, not worth a message
+        if (err.err_ != DevScanError::removed)
+            fmt::print(stderr, "Skipping {}: {}\n", err.name_, DevScanErrorMsg(err));
+    }
+
+    return std::move(res.devs_);
 }
 
 } // namespace virtio
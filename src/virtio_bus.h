@@ -3,12 +3,18 @@
 
 #pragma once
 
+#include "attr_parse.h"
 #include "virtio_defs.h"
 
+#include <array>
 #include <cstdint>
 #include <string_view>
 #include <filesystem>
 #include <map>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 template <typename E>
 constexpr auto e_to_type(E e) noexcept
@@ -31,7 +37,136 @@ constexpr std::string_view virtio_devs_path {"/sys/bus/virtio/devices"};
 
 using virtio_devs_ct = std::map<std::string, VirtIODevDesc>;
 
+enum class DevScanError
+{
+    none,
+    // device went away while it was being read
+    removed,
+    not_symlink,
+    read_failed,
+    parse_failed
+};
+
+constexpr std::string_view DevScanErrorDesc(const DevScanError err)
+{
+    switch (err) {
+    case DevScanError::none:
+	return "no error";
+    case DevScanError::removed:
+	return "removed during scan";
+    case DevScanError::not_symlink:
+	return "bus entry is not a symlink";
+    case DevScanError::read_failed:
+	return "failed to read attribute";
+    case DevScanError::parse_failed:
+	return "failed to parse attribute";
+    default:
+	return "< unknown >";
+    }
+}
+
+// Failure to read a single device, doesn't stop the scan
+struct DevScanErrorRecord
+{
+    std::string  name_;
+    DevScanError err_ {DevScanError::none};
+    // offending attribute and parser message, if any
+    std::string  attr_ {};
+    std::string  msg_ {};
+};
+
+struct DevDescResult
+{
+    std::optional<VirtIODevDesc> desc_;
+    DevScanErrorRecord           error_;
+
+    explicit operator bool() const { return desc_.has_value(); }
+};
+
+// devices read successfully plus the ones that failed
+struct DevScanResult
+{
+    virtio_devs_ct                  devs_;
+    std::vector<DevScanErrorRecord> errors_;
+};
+
+std::string DevScanErrorMsg(const DevScanErrorRecord &rec);
+
+// Reverse index of what the kernel registered on top of virtio devices:
+// class devices (/sys/class/<class>/*) and bound drivers
+// (/sys/bus/virtio/drivers/*/), keyed by the virtio device name. Built
+// in a single pass per scan, so aux info of all devices costs
+// O(class entries) instead of a directory walk per device.
+class AuxInfoIndex
+{
+    public:
+        enum class DevClass
+        {
+            net,
+            block,
+            scsi_host,
+            drm,
+            input,
+            misc,
+            virtio_ports,
+            dev_class_max = virtio_ports
+        };
+
+        // @vd_path is the bus devices directory, classes and drivers
+        // are looked up relative to the same sysfs root
+        static AuxInfoIndex Build(const std::filesystem::path &vd_path = virtio_devs_path);
+
+        // class devices registered right under the virtio device, e.g.
+        // {"card0", "renderD128"} for drm; empty if there are none
+        const std::vector<std::string> &ClassDevs(const std::string &dev_name, const DevClass dev_class) const;
+        // bound driver, empty if none
+        std::string_view Driver(const std::string &dev_name) const;
+
+    private:
+        struct Entry
+        {
+            std::array<std::vector<std::string>, e_to_type(DevClass::dev_class_max) + 1> class_devs_;
+            std::string driver_;
+        };
+
+        std::unordered_map<std::string, Entry> entries_;
+};
+
+// Devices that could be read, failures other than hot-unplug are
+// reported on stderr
 virtio_devs_ct GetVirtioDevMap();
+// same as above, but for a bus directory other than virtio_devs_path
+virtio_devs_ct GetVirtioDevMap(const std::filesystem::path &vd_path);
+// Partial results and per-device errors, never fails because of
+// a single device
+DevScanResult ScanVirtioDevs(const std::filesystem::path &vd_path = virtio_devs_path);
+// Names of the bus entries
+std::vector<std::string> GetVirtioDevNames(const std::filesystem::path &vd_path = virtio_devs_path);
+// Read single bus entry, checking that it's a symlink to the device.
+// Scans of the whole bus pass an index built once for all entries.
+DevDescResult ScanBusEntry(const std::filesystem::path &vd_path, const std::string &name,
+                           const AuxInfoIndex &aux_index);
+DevDescResult TryCreateDevDesc(const std::filesystem::path &dev_path);
+DevDescResult TryCreateDevDesc(const std::filesystem::path &dev_path, const AuxInfoIndex &aux_index);
+// same as above, but throws on failure
 VirtIODevDesc CreateDevDesc(const std::filesystem::path &dev_path);
+// Some information about device based on the type (e.g. iface name).
+// Lookups for several devices pass an index built once for all of them.
+std::string DevGetAuxInfo(const VirtIODevType dev_type,
+                          const std::filesystem::path &dev_path);
+std::string DevGetAuxInfo(const VirtIODevType dev_type, const std::filesystem::path &dev_path,
+                          const AuxInfoIndex &aux_index);
+
+// Natural ordering of device names: "virtio2" < "virtio10"
+bool DevNameNaturalLess(std::string_view lhs, std::string_view rhs);
+
+// Parsers for the raw contents (w/o trailing newline) of the device
+// attributes. See drivers/virtio/virtio.c for the format.
+AttrParseResult ParseDevTypeAttr(std::string_view buf, uint32_t &type);
+AttrParseResult ParseDevStatusAttr(std::string_view buf, uint32_t &status);
+AttrParseResult ParseDevFeaturesAttr(std::string_view buf, uint64_t &features);
+// Same, but also returns bits 64-127 of the extended (128-bit) format
+AttrParseResult ParseDevFeaturesAttr(std::string_view buf, uint64_t &features,
+                                     uint64_t &features_hi);
 
 } //namespace virtio
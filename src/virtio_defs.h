@@ -2,7 +2,10 @@
 // Copyright (C) 2025 Petr Vyazovik <xen@f-m.fm>
 
 #pragma once
+#include <array>
 #include <cstdint>
+#include <initializer_list>
+#include <span>
 #include <string_view>
 
 namespace virtio {
@@ -418,4 +421,151 @@ constexpr std::string_view VirtIONetDevFeatureDesc(const VirtIONetFeature featur
     }
 };
 
+// Feature bit which only takes effect if at least one of the bits in
+// requires_ is negotiated as well, otherwise the device/driver silently
+// ignore it. See "Feature bit requirements" of the device in the spec.
+struct FeatureDep
+{
+    uint32_t bit_;
+    uint64_t requires_;
+};
+
+template <typename E>
+constexpr FeatureDep FeatureRequiresAny(const E feature, std::initializer_list<E> any_of)
+{
+    FeatureDep dep {static_cast<uint32_t>(feature), 0};
+    for (auto req : any_of)
+        dep.requires_ |= 1ULL << static_cast<uint32_t>(req);
+    return dep;
+}
+
+// VirtIO spec 1.3 paragraph 5.1.3.1
+constexpr std::array net_feature_deps {
+    FeatureRequiresAny(VirtIONetFeature::VIRTIO_NET_F_GUEST_TSO4, {VirtIONetFeature::VIRTIO_NET_F_GUEST_CSUM}),
+    FeatureRequiresAny(VirtIONetFeature::VIRTIO_NET_F_GUEST_TSO6, {VirtIONetFeature::VIRTIO_NET_F_GUEST_CSUM}),
+    FeatureRequiresAny(VirtIONetFeature::VIRTIO_NET_F_GUEST_ECN, {VirtIONetFeature::VIRTIO_NET_F_GUEST_TSO4,
+                                                                  VirtIONetFeature::VIRTIO_NET_F_GUEST_TSO6}),
+    FeatureRequiresAny(VirtIONetFeature::VIRTIO_NET_F_GUEST_UFO, {VirtIONetFeature::VIRTIO_NET_F_GUEST_CSUM}),
+    FeatureRequiresAny(VirtIONetFeature::VIRTIO_NET_F_GUEST_USO4, {VirtIONetFeature::VIRTIO_NET_F_GUEST_CSUM}),
+    FeatureRequiresAny(VirtIONetFeature::VIRTIO_NET_F_GUEST_USO6, {VirtIONetFeature::VIRTIO_NET_F_GUEST_CSUM}),
+
+    FeatureRequiresAny(VirtIONetFeature::VIRTIO_NET_F_HOST_TSO4, {VirtIONetFeature::VIRTIO_NET_F_CSUM}),
+    FeatureRequiresAny(VirtIONetFeature::VIRTIO_NET_F_HOST_TSO6, {VirtIONetFeature::VIRTIO_NET_F_CSUM}),
+    FeatureRequiresAny(VirtIONetFeature::VIRTIO_NET_F_HOST_ECN, {VirtIONetFeature::VIRTIO_NET_F_HOST_TSO4,
+                                                                 VirtIONetFeature::VIRTIO_NET_F_HOST_TSO6}),
+    FeatureRequiresAny(VirtIONetFeature::VIRTIO_NET_F_HOST_UFO, {VirtIONetFeature::VIRTIO_NET_F_CSUM}),
+    FeatureRequiresAny(VirtIONetFeature::VIRTIO_NET_F_HOST_USO, {VirtIONetFeature::VIRTIO_NET_F_CSUM}),
+    FeatureRequiresAny(VirtIONetFeature::VIRTIO_NET_F_RSC_EXT, {VirtIONetFeature::VIRTIO_NET_F_HOST_TSO4,
+                                                                VirtIONetFeature::VIRTIO_NET_F_HOST_TSO6}),
+
+    FeatureRequiresAny(VirtIONetFeature::VIRTIO_NET_F_CTRL_GUEST_OFFLOADS, {VirtIONetFeature::VIRTIO_NET_F_CTRL_VQ}),
+    FeatureRequiresAny(VirtIONetFeature::VIRTIO_NET_F_CTRL_RX, {VirtIONetFeature::VIRTIO_NET_F_CTRL_VQ}),
+    FeatureRequiresAny(VirtIONetFeature::VIRTIO_NET_F_CTRL_VLAN, {VirtIONetFeature::VIRTIO_NET_F_CTRL_VQ}),
+    FeatureRequiresAny(VirtIONetFeature::VIRTIO_NET_F_CTRL_RX_EXTRA, {VirtIONetFeature::VIRTIO_NET_F_CTRL_RX}),
+    FeatureRequiresAny(VirtIONetFeature::VIRTIO_NET_F_GUEST_ANNOUNCE, {VirtIONetFeature::VIRTIO_NET_F_CTRL_VQ}),
+    FeatureRequiresAny(VirtIONetFeature::VIRTIO_NET_F_MQ, {VirtIONetFeature::VIRTIO_NET_F_CTRL_VQ}),
+    FeatureRequiresAny(VirtIONetFeature::VIRTIO_NET_F_CTRL_MAC_ADDR, {VirtIONetFeature::VIRTIO_NET_F_CTRL_VQ}),
+    FeatureRequiresAny(VirtIONetFeature::VIRTIO_NET_F_DEVICE_STATS, {VirtIONetFeature::VIRTIO_NET_F_CTRL_VQ}),
+    FeatureRequiresAny(VirtIONetFeature::VIRTIO_NET_F_VQ_NOTF_COAL, {VirtIONetFeature::VIRTIO_NET_F_CTRL_VQ}),
+    FeatureRequiresAny(VirtIONetFeature::VIRTIO_NET_F_NOTF_COAL, {VirtIONetFeature::VIRTIO_NET_F_CTRL_VQ}),
+    FeatureRequiresAny(VirtIONetFeature::VIRTIO_NET_F_RSS, {VirtIONetFeature::VIRTIO_NET_F_CTRL_VQ}),
+};
+
+constexpr std::span<const FeatureDep> FeatureDeps(const VirtIODevType type)
+{
+    switch (type) {
+    case VirtIODevType::network_card:
+	return net_feature_deps;
+    default:
+	return {};
+    }
+}
+
+// Bits of @features which have no effect because none of the bits they
+// require is in effect. Chains are followed, e.g. GUEST_ECN is broken if
+// GUEST_TSO4 is its only support and lacks GUEST_CSUM.
+constexpr uint64_t BrokenFeatureDeps(const VirtIODevType type, const uint64_t features)
+{
+    auto effective = features;
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (const auto &dep : FeatureDeps(type)) {
+            if ((effective >> dep.bit_ & 1) && !(effective & dep.requires_)) {
+                effective &= ~(1ULL << dep.bit_);
+                changed = true;
+            }
+        }
+    }
+    return features & ~effective;
+}
+
+static_assert(BrokenFeatureDeps(VirtIODevType::network_card, 1ULL << 7) == 1ULL << 7,
+              "GUEST_TSO4 w/o GUEST_CSUM must be reported");
+static_assert(BrokenFeatureDeps(VirtIODevType::network_card, 1ULL << 13 | 1ULL << 12 | 1ULL << 0) == 0,
+              "HOST_ECN needs any of HOST_TSO4/HOST_TSO6");
+static_assert(BrokenFeatureDeps(VirtIODevType::network_card, 1ULL << 9 | 1ULL << 7) == (1ULL << 9 | 1ULL << 7),
+              "GUEST_ECN on top of a broken GUEST_TSO4 must be reported");
+
+// Feature bits for traditional memory balloon device.
+// See include/uapi/linux/virtio_balloon.h in Linux sources
+enum class VirtIOBalloonFeature : uint32_t
+{
+    VIRTIO_BALLOON_F_MUST_TELL_HOST = 0, // Tell before reclaiming pages
+    VIRTIO_BALLOON_F_STATS_VQ       = 1, // Memory Stats virtqueue
+    VIRTIO_BALLOON_F_DEFLATE_ON_OOM = 2, // Deflate balloon on OOM
+    VIRTIO_BALLOON_F_FREE_PAGE_HINT = 3, // VQ to report free pages
+    VIRTIO_BALLOON_F_PAGE_POISON    = 4, // Guest is using page poisoning
+    VIRTIO_BALLOON_F_REPORTING      = 5, // Page reporting virtqueue
+
+    VIRTIO_COMMON_FIELDS(EE)
+};
+
+constexpr std::string_view VirtIOBalloonDevFeatureDesc(const VirtIOBalloonFeature feature)
+{
+    switch (feature) {
+    case VirtIOBalloonFeature::VIRTIO_BALLOON_F_MUST_TELL_HOST:
+	return "guest tells host before reclaiming pages";
+    case VirtIOBalloonFeature::VIRTIO_BALLOON_F_STATS_VQ:
+	return "guest memory statistics virtqueue";
+    case VirtIOBalloonFeature::VIRTIO_BALLOON_F_DEFLATE_ON_OOM:
+	return "balloon is deflated on guest OOM";
+    case VirtIOBalloonFeature::VIRTIO_BALLOON_F_FREE_PAGE_HINT:
+	return "guest hints free pages (e.g. for migration)";
+    case VirtIOBalloonFeature::VIRTIO_BALLOON_F_PAGE_POISON:
+	return "guest is using page poisoning";
+    case VirtIOBalloonFeature::VIRTIO_BALLOON_F_REPORTING:
+	return "guest reports free pages to host";
+    default:
+	return "< no desc >";
+    }
+};
+
+// Feature bits for SCSI host device.
+// See include/uapi/linux/virtio_scsi.h in Linux sources
+enum class VirtIOScsiFeature : uint32_t
+{
+    VIRTIO_SCSI_F_INOUT   = 0, // Requests with both in and out buffers
+    VIRTIO_SCSI_F_HOTPLUG = 1, // Hotplug/hot-unplug events
+    VIRTIO_SCSI_F_CHANGE  = 2, // Parameter change (e.g. capacity) events
+    VIRTIO_SCSI_F_T10_PI  = 3, // T10 protection information
+
+    VIRTIO_COMMON_FIELDS(EE)
+};
+
+constexpr std::string_view VirtIOScsiDevFeatureDesc(const VirtIOScsiFeature feature)
+{
+    switch (feature) {
+    case VirtIOScsiFeature::VIRTIO_SCSI_F_INOUT:
+	return "bidirectional requests (in and out buffers)";
+    case VirtIOScsiFeature::VIRTIO_SCSI_F_HOTPLUG:
+	return "host reports LUN hotplug and hot-unplug";
+    case VirtIOScsiFeature::VIRTIO_SCSI_F_CHANGE:
+	return "host reports LUN parameter changes";
+    case VirtIOScsiFeature::VIRTIO_SCSI_F_T10_PI:
+	return "T10 protection information in requests";
+    default:
+	return "< no desc >";
+    }
+};
+
 } // namespace virtio
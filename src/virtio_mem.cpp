@@ -0,0 +1,263 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2025 Petr Vyazovik <xen@f-m.fm>
+
+#include "virtio_mem.h"
+#include "sysfs_source.h"
+#include "util.h"
+#include "virtio_bus.h"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+extern cfg::CmdLOpts cmdl_opts;
+
+namespace virtiomem {
+
+constexpr std::string_view iomem_path {"/proc/iomem"};
+constexpr std::string_view memory_sysfs_path {"/sys/devices/system/memory"};
+constexpr std::string_view node_sysfs_path {"/sys/devices/system/node"};
+constexpr std::string_view memory_block_prefix {"memory"};
+constexpr std::string_view node_prefix {"node"};
+// zone online memory has to be in to be reliably unpluggable
+constexpr std::string_view movable_zone {"Movable"};
+
+struct MemRange
+{
+    uint64_t start_ {0};
+    // inclusive, as in /proc/iomem
+    uint64_t end_ {0};
+};
+
+// Memory of a device with the same state, zone and node
+struct BlockGroupKey
+{
+    std::string state_;
+    // zone for online blocks, empty otherwise
+    std::string zone_;
+    int         node_ {-1};
+
+    bool operator<(const BlockGroupKey &rhs) const
+    {
+        return std::tie(state_, zone_, node_) < std::tie(rhs.state_, rhs.zone_, rhs.node_);
+    }
+};
+
+struct VirtioMemDev
+{
+    std::string                        name_;
+    std::optional<MemRange>            region_;
+    uint64_t                           blocks_ {0};
+    std::map<BlockGroupKey, uint64_t>  groups_;
+};
+
+// Top-level and nested "start-end : name" entries named after
+// virtio devices; addresses read as 0 unless running as root
+static std::unordered_map<std::string, MemRange>
+ReadDevRegions()
+{
+    std::string path {cmdl_opts.iomem_path_.empty() ? iomem_path : cmdl_opts.iomem_path_};
+    std::ifstream input {path};
+    if (!input) {
+        fmt::print("Failed to open {}\n", path);
+        throw std::runtime_error("Failed to read memory regions");
+    }
+
+    std::unordered_map<std::string, MemRange> regions;
+    std::string line;
+    while (std::getline(input, line)) {
+        std::string_view entry {line};
+        entry.remove_prefix(std::min(entry.size(), entry.find_first_not_of(' ')));
+
+        auto dash = entry.find('-');
+        auto sep = entry.find(" : ");
+        if (dash == std::string_view::npos || sep == std::string_view::npos || dash > sep)
+            continue;
+
+        auto name = entry.substr(sep + 3);
+        if (!name.starts_with("virtio"))
+            continue;
+
+        MemRange range;
+        if (!util::ParseNumber(entry.substr(0, dash), range.start_, 16) ||
+            !util::ParseNumber(entry.substr(dash + 1, sep - dash - 1), range.end_, 16) ||
+            range.end_ == 0)
+            continue;
+        regions.emplace(name, range);
+    }
+
+    return regions;
+}
+
+// memory block id -> NUMA node, from the memoryN links of every node
+static std::unordered_map<uint64_t, int>
+ReadBlockNodes()
+{
+    std::unordered_map<uint64_t, int> nodes;
+    const auto &sysfs = virtio::ActiveSysfs();
+
+    for (const auto &node_entry : sysfs.ListDir(node_sysfs_path).value_or(std::vector<std::string> {})) {
+        int node;
+        if (!node_entry.starts_with(node_prefix) ||
+            !util::ParseNumber(std::string_view {node_entry}.substr(node_prefix.size()), node))
+            continue;
+
+        auto entries = sysfs.ListDir(std::filesystem::path {node_sysfs_path} / node_entry);
+        for (const auto &entry : entries.value_or(std::vector<std::string> {})) {
+            uint64_t block;
+            if (entry.starts_with(memory_block_prefix) &&
+                util::ParseNumber(std::string_view {entry}.substr(memory_block_prefix.size()), block))
+                nodes.emplace(block, node);
+        }
+    }
+
+    return nodes;
+}
+
+static std::string
+FormatSize(const uint64_t bytes)
+{
+    if (bytes >= (1ULL << 30) && bytes % (1ULL << 30) == 0)
+        return fmt::format("{} GiB", bytes >> 30);
+    if (bytes >= (1ULL << 30))
+        return fmt::format("{:.2f} GiB", static_cast<double>(bytes) / (1ULL << 30));
+    return fmt::format("{} MiB", bytes >> 20);
+}
+
+// Single pass over the memory blocks: the block id in the directory
+// name is the phys_index, so only blocks inside a virtio-mem region
+// have their state and zones read
+static void
+ScanMemoryBlocks(std::vector<VirtioMemDev> &devs, const uint64_t block_size)
+{
+    const auto &sysfs = virtio::ActiveSysfs();
+    auto entries = sysfs.ListDir(memory_sysfs_path);
+    if (!entries.has_value())
+        return;
+
+    auto block_nodes = ReadBlockNodes();
+    std::filesystem::path memory_path {memory_sysfs_path};
+
+    for (const auto &entry : entries.value()) {
+        uint64_t block;
+        if (!entry.starts_with(memory_block_prefix) ||
+            !util::ParseNumber(std::string_view {entry}.substr(memory_block_prefix.size()), block))
+            continue;
+
+        auto addr = block * block_size;
+        auto dev = std::find_if(devs.begin(), devs.end(), [addr](const VirtioMemDev &dev) {
+            return dev.region_.has_value() && addr >= dev.region_->start_ && addr <= dev.region_->end_;
+        });
+        if (dev == devs.end())
+            continue;
+
+        BlockGroupKey key;
+        key.state_ = sysfs.ReadAttr(memory_path / entry / "state").value_or("unknown");
+        // an online block is in exactly one zone, offline ones list
+        // the zones they could go to
+        if (key.state_ == "online")
+            key.zone_ = sysfs.ReadAttr(memory_path / entry / "valid_zones").value_or("");
+        auto node = block_nodes.find(block);
+        key.node_ = node == block_nodes.end() ? -1 : node->second;
+
+        dev->blocks_++;
+        dev->groups_[key] += block_size;
+    }
+}
+
+static void
+PrintDev(const VirtioMemDev &dev, const uint64_t block_size)
+{
+    uint64_t offline = 0, unmovable = 0;
+    for (const auto &[key, bytes] : dev.groups_) {
+        if (key.state_ != "online")
+            offline += bytes;
+        else if (key.zone_ != movable_zone)
+            unmovable += bytes;
+    }
+
+    if (cmdl_opts.json_output_) {
+        std::string groups;
+        for (const auto &[key, bytes] : dev.groups_)
+            groups += fmt::format("{}{{\"state\":\"{}\",\"zone\":\"{}\",\"node\":{},\"bytes\":{}}}",
+                                  groups.empty() ? "" : ",", key.state_, key.zone_, key.node_, bytes);
+        fmt::print("{{\"name\":\"{}\",\"region_start\":{},\"region_size\":{},\"block_size\":{},"
+                   "\"added\":{},\"offline\":{},\"online_unmovable\":{},\"blocks\":[{}]}}\n",
+                   dev.name_,
+                   dev.region_ ? fmt::format("{}", dev.region_->start_) : "null",
+                   dev.region_ ? fmt::format("{}", dev.region_->end_ - dev.region_->start_ + 1) : "null",
+                   block_size, dev.blocks_ * block_size, offline, unmovable, groups);
+        return;
+    }
+
+    if (!dev.region_.has_value()) {
+        fmt::print("{}  region unknown (/proc/iomem addresses need root)\n", dev.name_);
+        return;
+    }
+
+    fmt::print("{}  region {:#x}-{:#x} ({})  memory block {}\n", dev.name_,
+               dev.region_->start_, dev.region_->end_,
+               FormatSize(dev.region_->end_ - dev.region_->start_ + 1), FormatSize(block_size));
+    // Linux adds whole memory blocks; with device blocks smaller than
+    // that (sub-block mode) some of an added block may be unplugged
+    fmt::print("  added {} ({} memory blocks, partly plugged ones count whole)\n",
+               FormatSize(dev.blocks_ * block_size), dev.blocks_);
+
+    for (const auto &[key, bytes] : dev.groups_)
+        fmt::print("  {:<14} {:<10} {:>10}  node {}\n", key.state_, key.zone_.empty() ? "-" : key.zone_,
+                   FormatSize(bytes), key.node_ < 0 ? "-" : fmt::format("{}", key.node_));
+
+    if (offline)
+        fmt::print("  ! {} added but not online\n", FormatSize(offline));
+    if (unmovable)
+        fmt::print("  ! {} online outside ZONE_MOVABLE, unplug may fail\n", FormatSize(unmovable));
+}
+
+void ShowVirtioMemBlocks()
+{
+    std::vector<VirtioMemDev> devs;
+    for (const auto &[name, desc] : virtio::GetVirtioDevMap()) {
+        if (desc.dev_type_ != virtio::VirtIODevType::mem)
+            continue;
+        VirtioMemDev dev;
+        dev.name_ = name;
+        devs.push_back(std::move(dev));
+    }
+
+    if (devs.empty()) {
+        fmt::print("No virtio-mem devices found\n");
+        return;
+    }
+
+    auto regions = ReadDevRegions();
+    for (auto &dev : devs) {
+        auto it = regions.find(dev.name_);
+        if (it != regions.end())
+            dev.region_ = it->second;
+    }
+
+    // hex w/o prefix, e.g. "8000000"
+    uint64_t block_size = 0;
+    auto block_size_attr = virtio::ActiveSysfs().ReadAttr(
+            std::filesystem::path {memory_sysfs_path} / "block_size_bytes");
+    if (!block_size_attr.has_value() || !util::ParseNumber(*block_size_attr, block_size, 16) || !block_size) {
+        fmt::print("Failed to read memory block size\n");
+        throw std::runtime_error("Failed to read memory blocks");
+    }
+
+    ScanMemoryBlocks(devs, block_size);
+
+    for (const auto &dev : devs)
+        PrintDev(dev, block_size);
+}
+
+} // namespace virtiomem
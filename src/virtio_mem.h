@@ -0,0 +1,19 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2025 Petr Vyazovik <xen@f-m.fm>
+
+#pragma once
+
+#include "config.h"
+
+// virtio-mem devices and the memory they hotplugged. virtio_mem claims
+// the device region in /proc/iomem under the device name, the memory
+// blocks (/sys/devices/system/memory/memoryN) within it are the ones it
+// added. Blocks are summarized by state, zone and NUMA node. The device
+// block size isn't in sysfs: in sub-block mode (device blocks smaller
+// than a memory block) a partly plugged memory block counts whole.
+namespace virtiomem {
+
+// Show added and online memory of every virtio-mem device
+void ShowVirtioMemBlocks();
+
+} // namespace virtiomem
@@ -0,0 +1,269 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2025 Petr Vyazovik <xen@f-m.fm>
+
+#include "virtiofs.h"
+#include "transport.h"
+#include "util.h"
+#include "virtio_bus.h"
+
+#include <fmt/core.h>
+
+#include <fstream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+extern cfg::CmdLOpts cmdl_opts;
+
+namespace virtiofs {
+
+constexpr std::string_view mountinfo_path {"/proc/self/mountinfo"};
+constexpr std::string_view virtiofs_fs_type {"virtiofs"};
+// VIRTIO_FS_SHMCAP_ID_CACHE, see include/uapi/linux/virtio_fs.h
+constexpr uint8_t shm_id_dax_cache {0};
+
+// DAX mode of a mount, see Documentation/filesystems/dax.rst
+enum class DaxMode
+{
+    // no dax option: per-inode, if the server sets FUSE_ATTR_DAX
+    inode_default,
+    inode,
+    always,
+    never
+};
+
+constexpr std::string_view DaxModeName(const DaxMode mode)
+{
+    switch (mode) {
+    case DaxMode::inode_default:
+	return "inode (default)";
+    case DaxMode::inode:
+	return "inode";
+    case DaxMode::always:
+	return "always";
+    case DaxMode::never:
+	return "never";
+    default:
+	return "< unknown >";
+    }
+}
+
+// What a mount makes of the DAX window of its device: only dax=always
+// maps all file contents through it. Per-inode DAX, the default, maps
+// just the files the server flags with FUSE_ATTR_DAX and falls back to
+// the page cache for the rest, dax=never doesn't use the window at all
+enum class DaxWindowUse
+{
+    // no window, or its size is unknown
+    none,
+    full,
+    per_inode,
+    unused
+};
+
+constexpr DaxWindowUse
+MountDaxWindowUse(const std::optional<uint64_t> window, const DaxMode mode)
+{
+    if (!window.value_or(0))
+        return DaxWindowUse::none;
+    switch (mode) {
+    case DaxMode::always:
+	return DaxWindowUse::full;
+    case DaxMode::never:
+	return DaxWindowUse::unused;
+    default:
+	return DaxWindowUse::per_inode;
+    }
+}
+
+static_assert(MountDaxWindowUse(std::nullopt, DaxMode::never) == DaxWindowUse::none, "window size unknown");
+static_assert(MountDaxWindowUse(0, DaxMode::never) == DaxWindowUse::none, "no window");
+static_assert(MountDaxWindowUse(1ULL << 30, DaxMode::always) == DaxWindowUse::full, "dax=always");
+static_assert(MountDaxWindowUse(1ULL << 30, DaxMode::inode_default) == DaxWindowUse::per_inode,
+              "mount w/o dax option");
+static_assert(MountDaxWindowUse(1ULL << 30, DaxMode::inode) == DaxWindowUse::per_inode, "dax=inode");
+static_assert(MountDaxWindowUse(1ULL << 30, DaxMode::never) == DaxWindowUse::unused, "dax=never");
+
+struct VirtioFsMount
+{
+    std::string mount_point_;
+    // superblock options
+    std::string options_;
+    DaxMode     dax_ {DaxMode::inode_default};
+    // cache= option, if the mount has one; virtiofsd picks the cache
+    // mode on the host otherwise
+    std::string cache_;
+};
+
+// mountinfo escapes space, tab, newline and backslash as \ooo
+static std::string
+Unescape(std::string_view field)
+{
+    std::string out;
+    for (size_t pos = 0; pos < field.size(); pos++) {
+        if (field[pos] == '\\' && pos + 3 < field.size() &&
+            field[pos + 1] >= '0' && field[pos + 1] <= '3') {
+            out += static_cast<char>((field[pos + 1] - '0') << 6 |
+                                     (field[pos + 2] - '0') << 3 |
+                                     (field[pos + 3] - '0'));
+            pos += 3;
+            continue;
+        }
+        out += field[pos];
+    }
+    return out;
+}
+
+static std::vector<std::string_view>
+SplitFields(std::string_view line, const char sep)
+{
+    std::vector<std::string_view> fields;
+    while (!line.empty()) {
+        auto end = line.find(sep);
+        if (end != 0)
+            fields.push_back(line.substr(0, end));
+        if (end == std::string_view::npos)
+            break;
+        line = line.substr(end + 1);
+    }
+    return fields;
+}
+
+static void
+ParseMountOptions(std::string_view options, VirtioFsMount &mount)
+{
+    for (auto opt : SplitFields(options, ',')) {
+        // "dax" is the pre-5.17 spelling of dax=always
+        if (opt == "dax" || opt == "dax=always")
+            mount.dax_ = DaxMode::always;
+        else if (opt == "dax=never")
+            mount.dax_ = DaxMode::never;
+        else if (opt == "dax=inode")
+            mount.dax_ = DaxMode::inode;
+        else if (opt.starts_with("cache="))
+            mount.cache_ = opt.substr(6);
+    }
+}
+
+// Parse mountinfo lines:
+// <id> <parent> <maj:min> <root> <mount point> <options> [optional...] - <type> <source> <super options>
+static std::vector<std::pair<std::string, VirtioFsMount>>
+ReadVirtioFsMounts()
+{
+    std::string path {cmdl_opts.mountinfo_path_.empty() ? mountinfo_path : cmdl_opts.mountinfo_path_};
+    std::ifstream input {path};
+    if (!input) {
+        fmt::print("Failed to open {}\n", path);
+        throw std::runtime_error("Failed to read mounts");
+    }
+
+    std::vector<std::pair<std::string, VirtioFsMount>> mounts;
+    std::string line;
+    while (std::getline(input, line)) {
+        auto fields = SplitFields(line, ' ');
+
+        size_t sep = 6;
+        while (sep < fields.size() && fields[sep] != "-")
+            sep++;
+        if (sep + 2 >= fields.size())
+            continue;
+        if (fields[sep + 1] != virtiofs_fs_type)
+            continue;
+
+        // dax= and friends are superblock options
+        VirtioFsMount mount;
+        mount.mount_point_ = Unescape(fields[4]);
+        if (sep + 3 < fields.size()) {
+            mount.options_ = fields[sep + 3];
+            ParseMountOptions(mount.options_, mount);
+        }
+
+        mounts.emplace_back(Unescape(fields[sep + 2]), std::move(mount));
+    }
+
+    return mounts;
+}
+
+// nullopt if the capabilities can't be read, 0 if there's no window
+static std::optional<uint64_t>
+DaxWindowSize(const virtio::VirtIODevDesc &desc)
+{
+    auto info = virtio::DevGetTransportInfo(desc);
+    if (!info.pci_.has_value() || !info.pci_->caps_readable_)
+        return std::nullopt;
+
+    for (const auto &cap : info.pci_->caps_)
+        if (cap.cfg_type_ == virtio::VirtIOPciCapType::shared_memory_cfg && cap.id_ == shm_id_dax_cache)
+            return cap.length_;
+
+    return 0;
+}
+
+// "8 GiB", "512 MiB"
+static std::string
+FormatSize(const uint64_t bytes)
+{
+    if (bytes >= (1ULL << 30) && bytes % (1ULL << 30) == 0)
+        return fmt::format("{} GiB", bytes >> 30);
+    return fmt::format("{} MiB", bytes >> 20);
+}
+
+void ShowVirtioFsMounts()
+{
+    auto mounts = ReadVirtioFsMounts();
+    bool found = false;
+
+    for (const auto &[name, desc] : virtio::GetVirtioDevMap()) {
+        if (desc.dev_type_ != virtio::VirtIODevType::fs)
+            continue;
+        found = true;
+
+        auto window = DaxWindowSize(desc);
+        const auto &tag = desc.aux_info_;
+
+        std::string window_txt = !window.has_value() ? "unknown (run as root)"
+                                 : *window ? FormatSize(*window) : "none";
+        if (!cmdl_opts.json_output_)
+            fmt::print("{}  tag \"{}\"  DAX window {}\n", name, tag, window_txt);
+
+        bool mounted = false;
+        for (const auto &[source, mount] : mounts) {
+            if (tag.empty() || source != tag)
+                continue;
+            mounted = true;
+
+            auto window_use = MountDaxWindowUse(window, mount.dax_);
+
+            if (cmdl_opts.json_output_) {
+                fmt::print("{{\"name\":\"{}\",\"tag\":\"{}\",\"dax_window\":{},\"mount_point\":\"{}\","
+                           "\"dax\":\"{}\",\"cache\":\"{}\",\"options\":\"{}\",\"dax_unused\":{},"
+                           "\"dax_per_inode\":{}}}\n",
+                           name, util::JsonEscape(tag), window.has_value() ? fmt::format("{}", *window) : "null",
+                           util::JsonEscape(mount.mount_point_), DaxModeName(mount.dax_),
+                           util::JsonEscape(mount.cache_), util::JsonEscape(mount.options_), window_use == DaxWindowUse::unused,
+                           window_use == DaxWindowUse::per_inode);
+                continue;
+            }
+
+            fmt::print("  {:<24} dax={:<16} cache={:<8} {}{}\n",
+                       mount.mount_point_, DaxModeName(mount.dax_),
+                       mount.cache_.empty() ? "-" : mount.cache_, mount.options_,
+                       window_use == DaxWindowUse::unused ? "  ! DAX window unused" :
+                       window_use == DaxWindowUse::per_inode ? "  ~ DAX only for inodes the server flags" : "");
+        }
+
+        if (mounted)
+            continue;
+        if (cmdl_opts.json_output_)
+            fmt::print("{{\"name\":\"{}\",\"tag\":\"{}\",\"dax_window\":{},\"mount_point\":null}}\n",
+                       name, util::JsonEscape(tag), window.has_value() ? fmt::format("{}", *window) : "null");
+        else
+            fmt::print("  not mounted\n");
+    }
+
+    if (!found)
+        fmt::print("No virtio-fs devices found\n");
+}
+
+} // namespace virtiofs
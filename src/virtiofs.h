@@ -0,0 +1,16 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2025 Petr Vyazovik <xen@f-m.fm>
+
+#pragma once
+
+#include "config.h"
+
+// virtio-fs devices and their mounts. Devices are matched to mounts by
+// the tag (the mount source in mountinfo), the DAX window is the shared
+// memory region with id 0 advertised through the PCI capabilities.
+namespace virtiofs {
+
+// Show mount points, DAX mode and window of every virtio-fs device
+void ShowVirtioFsMounts();
+
+} // namespace virtiofs